@@ -0,0 +1,104 @@
+// Copyright 2023 Gareth Cross
+#include "benchmark_utils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <mutex>
+#include <random>
+#include <set>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include "assertions.hpp"
+#include "synthetic_dataset.hpp"
+
+namespace benchmarks {
+
+void FaceSizes(benchmark::internal::Benchmark* const benchmark) {
+  benchmark->ArgName("face")->Arg(512)->Arg(1024)->Arg(2048);
+}
+
+void OutputSizes(benchmark::internal::Benchmark* const benchmark) {
+  benchmark->ArgNames({"width", "height", "face"});
+  for (const auto& [width, height] : {std::pair{640, 480}, std::pair{1280, 720}, std::pair{1920, 1080}}) {
+    for (const int face_size : {512, 1024}) {
+      benchmark->Args({width, height, face_size});
+    }
+  }
+}
+
+images::SimpleImage MakeSyntheticImage(const int width, const int height, const int components,
+                                       const images::ImageDepth depth, const uint32_t seed) {
+  images::SimpleImage image{width, height, components, depth};
+  std::mt19937 engine{seed};
+  std::uniform_real_distribution<float> noise{-0.02f, 0.02f};
+  const float max_value = depth == images::ImageDepth::Bits16 ? 65535.0f : 255.0f;
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      for (int c = 0; c < components; ++c) {
+        // A different low frequency pattern per channel:
+        const float phase = static_cast<float>(c + 1) * 0.37f;
+        const float value = 0.5f + 0.25f * std::sin(static_cast<float>(x) * 0.011f * (phase + 1.0f)) +
+                            0.2f * std::cos(static_cast<float>(y) * 0.007f + phase) + noise(engine);
+        const float scaled = std::clamp(value, 0.0f, 1.0f) * max_value;
+        const std::size_t index = (static_cast<std::size_t>(y) * width + x) * components + c;
+        if (depth == images::ImageDepth::Bits16) {
+          reinterpret_cast<uint16_t*>(image.data.data())[index] = static_cast<uint16_t>(scaled);
+        } else {
+          image.data[index] = static_cast<uint8_t>(scaled);
+        }
+      }
+    }
+  }
+  return image;
+}
+
+// A single frame of a single camera.
+static synthetic_dataset::DatasetOptions SingleFrameOptions(const int face_size) {
+  synthetic_dataset::DatasetOptions options{};
+  options.face_size = face_size;
+  options.num_frames = 1;
+  options.num_cameras = 1;
+  return options;
+}
+
+std::vector<images::SimpleImage> MakeSyntheticFaces(const int face_size) {
+  return synthetic_dataset::MakeFaces(SingleFrameOptions(face_size), 0, 0);
+}
+
+std::filesystem::path ScratchDirectory() {
+  const std::filesystem::path directory = std::filesystem::temp_directory_path() / "cubemap_benchmarks";
+  std::error_code err{};
+  std::filesystem::create_directories(directory, err);
+  ASSERT(!err, "Failed to create directory: {}. Error = {}", directory.u8string(), err.message());
+  return directory;
+}
+
+// Names of files already written by this process.
+static std::mutex g_written_mutex{};
+static std::set<std::string> g_written{};
+
+// True the first time it is called w/ `name`.
+static bool ShouldWrite(const std::string& name) {
+  const std::lock_guard<std::mutex> lock{g_written_mutex};
+  return g_written.insert(name).second;
+}
+
+std::filesystem::path SyntheticDataset(const int face_size) {
+  const std::filesystem::path root = ScratchDirectory() / fmt::format("dataset_{}", face_size);
+  if (ShouldWrite(root.u8string())) {
+    synthetic_dataset::WriteDataset(root, SingleFrameOptions(face_size), std::thread::hardware_concurrency());
+  }
+  return root;
+}
+
+std::filesystem::path SyntheticPng(const std::string& name, const images::SimpleImage& image) {
+  const std::filesystem::path path = ScratchDirectory() / name;
+  if (ShouldWrite(name)) {
+    images::WritePng(path, image, false);
+  }
+  return path;
+}
+
+}  // namespace benchmarks
@@ -0,0 +1,38 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "images.hpp"
+
+// Synthetic inputs shared by the benchmarks. Everything is generated deterministically, so runs are comparable.
+namespace benchmarks {
+
+// Face sizes of the oversampled cubemaps we benchmark w/. Use as `BENCHMARK(...)->Apply(FaceSizes)`.
+void FaceSizes(benchmark::internal::Benchmark* benchmark);
+
+// Output resolutions (width, height) and face sizes we benchmark the renderers at.
+void OutputSizes(benchmark::internal::Benchmark* benchmark);
+
+// An image w/ smooth gradients plus some noise, so that PNG compression behaves roughly like it does on renders.
+images::SimpleImage MakeSyntheticImage(int width, int height, int components, images::ImageDepth depth,
+                                       uint32_t seed);
+
+// The 12 faces of a cubemap (6 RGB, then 6 inverse depth), as returned by `LoadCubemapImages`. See `synthetic_dataset`.
+std::vector<images::SimpleImage> MakeSyntheticFaces(int face_size);
+
+// Directory the benchmarks write their files into (under the system temporary directory).
+std::filesystem::path ScratchDirectory();
+
+// Write a dataset w/ one frame of camera 0 at `face_size` (in the layout `LoadCubemapImages` reads), and return its
+// root directory. The dataset is only written once per face size.
+std::filesystem::path SyntheticDataset(int face_size);
+
+// Write `image` to a PNG file in the scratch directory, and return its path. Written only once per name.
+std::filesystem::path SyntheticPng(const std::string& name, const images::SimpleImage& image);
+
+}  // namespace benchmarks
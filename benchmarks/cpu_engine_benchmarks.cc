@@ -0,0 +1,78 @@
+// Copyright 2023 Gareth Cross
+#include <cstring>
+#include <thread>
+
+#include "benchmark_utils.hpp"
+#include "cpu_engine.hpp"
+#include "remap_table.hpp"
+
+namespace benchmarks {
+
+// A fisheye camera w/ a ~180 degree field of view that fills an image of the given size.
+static camera_models::CameraIntrinsics SyntheticFisheye(const int width, const int height) {
+  camera_models::CameraIntrinsics intrinsics{};
+  intrinsics.model = camera_models::CameraModel::Fisheye;
+  intrinsics.fx = intrinsics.fy = static_cast<float>(width) / 3.2f;
+  intrinsics.cx = static_cast<float>(width) / 2.0f;
+  intrinsics.cy = static_cast<float>(height) / 2.0f;
+  intrinsics.coeffs = {0.05f, -0.01f, 0.002f, 0.0f, 0.0f};
+  return intrinsics;
+}
+
+static cpu_engine::RenderParams SyntheticRenderParams() {
+  cpu_engine::RenderParams params{};
+  params.oversampled_fov = static_cast<float>(95.0 * M_PI / 180.0);
+  return params;
+}
+
+// Render one frame w/ all hardware threads. Arguments: width, height, face size.
+static void BM_CpuEngineRender(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const std::vector<images::SimpleImage> faces = MakeSyntheticFaces(static_cast<int>(state.range(2)));
+  const cpu_engine::CpuEngine engine{SyntheticFisheye(width, height), images::ImageView{},   width, height,
+                                     SyntheticRenderParams(),          std::thread::hardware_concurrency()};
+  images::SimpleImage rgb{};
+  images::SimpleImage inv_range{};
+  for (auto _ : state) {
+    engine.Render(faces, rgb, inv_range);
+    benchmark::DoNotOptimize(rgb.data.data());
+  }
+  state.SetItemsProcessed(state.iterations() * width * height);  //  Pixels.
+}
+BENCHMARK(BM_CpuEngineRender)->Apply(OutputSizes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Compute the camera rays from a remap table sampled every `stride` pixels. Arguments: width, height, stride.
+static void BM_ComputeCameraRaysFromTable(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const int stride = static_cast<int>(state.range(2));
+
+  // Build the coarse table by sampling the rays of the camera model:
+  const std::vector<glm::vec3> rays = cpu_engine::ComputeCameraRays(SyntheticFisheye(width, height), width, height);
+  const int grid_width = remap_table::GridDimension(width, stride);
+  const int grid_height = remap_table::GridDimension(height, stride);
+  images::SimpleImage table{grid_width, grid_height, 3, images::ImageDepth::Bits32};
+  for (int y = 0; y < grid_height; ++y) {
+    for (int x = 0; x < grid_width; ++x) {
+      const glm::vec3& ray = rays[std::min(y * stride, height - 1) * width + std::min(x * stride, width - 1)];
+      std::memcpy(&table.data[(static_cast<std::size_t>(y) * grid_width + x) * sizeof(ray)], &ray, sizeof(ray));
+    }
+  }
+
+  const cpu_engine::RemapTableRays source{table.View(), stride, cpu_engine::TableInterpolation::Bicubic,
+                                          cpu_engine::TableEncoding::Float32};
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(cpu_engine::ComputeCameraRays(source, width, height));
+  }
+  state.SetItemsProcessed(state.iterations() * width * height);  //  Pixels.
+}
+BENCHMARK(BM_ComputeCameraRaysFromTable)
+    ->ArgNames({"width", "height", "stride"})
+    ->Args({1280, 720, 1})
+    ->Args({1280, 720, 8})
+    ->Args({1920, 1080, 1})
+    ->Args({1920, 1080, 8})
+    ->Unit(benchmark::kMillisecond);
+
+}  // namespace benchmarks
@@ -0,0 +1,103 @@
+// Copyright 2023 Gareth Cross
+#include <glad/gl.h>
+
+#include <GLFW/glfw3.h>
+
+#include "benchmark_utils.hpp"
+#include "gl_utils.hpp"
+
+namespace benchmarks {
+
+// A hidden window w/ an OpenGL 4.3 context, created on first use and current for the rest of the process. Returns
+// null if no context could be created. On machines w/o a GPU, set `LIBGL_ALWAYS_SOFTWARE=1` to use Mesa's software
+// renderer (llvmpipe).
+static GLFWwindow* SharedContext() {
+  static GLFWwindow* const window = []() -> GLFWwindow* {
+    if (!glfwInit()) {
+      return nullptr;
+    }
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+#ifdef __APPLE__
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+#endif
+    GLFWwindow* const created = glfwCreateWindow(64, 64, "cubemap_benchmarks", nullptr, nullptr);
+    if (created == nullptr) {
+      return nullptr;
+    }
+    glfwMakeContextCurrent(created);
+    if (gladLoadGL(glfwGetProcAddress) == 0) {
+      return nullptr;
+    }
+    return created;
+  }();
+  return window;
+}
+
+// Skip the benchmark (and return false) if there is no context.
+static bool RequireContext(benchmark::State& state) {
+  if (SharedContext() == nullptr) {
+    state.SkipWithError("No OpenGL 4.3 context (set LIBGL_ALWAYS_SOFTWARE=1 to use a software renderer).");
+    return false;
+  }
+  state.SetLabel(gl_utils::RendererName());
+  return true;
+}
+
+// Upload the 12 faces of a frame into the cubemap texture arrays, as the main loop does.
+static void BM_TextureArrayUpload(benchmark::State& state) {
+  if (!RequireContext(state)) {
+    return;
+  }
+  const int face_size = static_cast<int>(state.range(0));
+  const std::vector<images::SimpleImage> faces = MakeSyntheticFaces(face_size);
+  gl_utils::TextureArray rgb_cube{};
+  gl_utils::TextureArray inv_depth_cube{};
+  for (auto _ : state) {
+    for (int face = 0; face < 6; ++face) {
+      rgb_cube.Fill(face, faces[face]);
+      inv_depth_cube.Fill(face, faces[face + 6]);
+    }
+    glFinish();
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(face_size) * face_size * 6 * (3 + 2));
+}
+BENCHMARK(BM_TextureArrayUpload)->Apply(FaceSizes)->Unit(benchmark::kMillisecond)->UseRealTime();
+
+// Read back the color and inverse range framebuffers through PBOs, as the main loop does (w/o the lag).
+static void BM_PboReadback(benchmark::State& state) {
+  if (!RequireContext(state)) {
+    return;
+  }
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const gl_utils::FramebufferObject rgb_fbo{width, height, gl_utils::FramebufferType::Color};
+  const gl_utils::FramebufferObject inv_range_fbo{width, height, gl_utils::FramebufferType::InverseRange};
+  gl_utils::PixelbufferQueue color_pbos{1, width, height, 3, images::ImageDepth::Bits8};
+  gl_utils::PixelbufferQueue inv_range_pbos{1, width, height, 1, images::ImageDepth::Bits16};
+  const auto clear = [&] {
+    glViewport(0, 0, width, height);
+    glClearColor(0.2f, 0.4f, 0.6f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT);
+  };
+  for (auto _ : state) {
+    rgb_fbo.RenderInto(clear);
+    inv_range_fbo.RenderInto(clear);
+    color_pbos.QueueReadFromFbo(rgb_fbo);
+    inv_range_pbos.QueueReadFromFbo(inv_range_fbo);
+    benchmark::DoNotOptimize(color_pbos.PopOldestRead());
+    benchmark::DoNotOptimize(inv_range_pbos.PopOldestRead());
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(width) * height * (3 + 2));
+}
+BENCHMARK(BM_PboReadback)
+    ->ArgNames({"width", "height"})
+    ->Args({640, 480})
+    ->Args({1280, 720})
+    ->Args({1920, 1080})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace benchmarks
@@ -0,0 +1,104 @@
+// Copyright 2023 Gareth Cross
+#include <fstream>
+#include <utility>
+
+#include <fmt/format.h>
+
+#include "benchmark_utils.hpp"
+#include "images.hpp"
+
+namespace benchmarks {
+
+// Decode an 8-bit RGB face.
+static void BM_LoadPng8(benchmark::State& state) {
+  const int size = static_cast<int>(state.range(0));
+  const std::filesystem::path path = SyntheticPng(
+      fmt::format("rgb_{}.png", size), MakeSyntheticImage(size, size, 3, images::ImageDepth::Bits8, 0));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(images::LoadPng(path, images::ImageDepth::Bits8));
+  }
+  state.SetBytesProcessed(state.iterations() * size * size * 3);
+}
+BENCHMARK(BM_LoadPng8)->Apply(FaceSizes)->Unit(benchmark::kMillisecond);
+
+// Decode a 16-bit inverse depth face.
+static void BM_LoadPng16(benchmark::State& state) {
+  const int size = static_cast<int>(state.range(0));
+  const std::filesystem::path path = SyntheticPng(
+      fmt::format("depth_{}.png", size), MakeSyntheticImage(size, size, 1, images::ImageDepth::Bits16, 6));
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(images::LoadPng(path, images::ImageDepth::Bits16));
+  }
+  state.SetBytesProcessed(state.iterations() * size * size * 2);
+}
+BENCHMARK(BM_LoadPng16)->Apply(FaceSizes)->Unit(benchmark::kMillisecond);
+
+// Encode an output image (w/ the vertical flip the converter applies) at zlib levels 0 to 9.
+// Arguments: width, height, components, compression level.
+static void BM_WritePng(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const int components = static_cast<int>(state.range(2));
+  const int level = static_cast<int>(state.range(3));
+  const images::ImageDepth depth = components == 3 ? images::ImageDepth::Bits8 : images::ImageDepth::Bits16;
+  const images::SimpleImage image = MakeSyntheticImage(width, height, components, depth, 0);
+  const std::filesystem::path path =
+      ScratchDirectory() / fmt::format("write_{}x{}x{}_{}.png", width, height, components, level);
+  for (auto _ : state) {
+    images::WritePng(path, image, true, level);
+  }
+  state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(image.data.size()));
+  state.counters["file_bytes"] = static_cast<double>(std::filesystem::file_size(path));
+}
+BENCHMARK(BM_WritePng)
+    ->ArgNames({"width", "height", "components", "level"})
+    ->Apply([](benchmark::internal::Benchmark* const benchmark) {
+      for (const auto& [width, height] : {std::pair{1280, 720}, std::pair{1920, 1080}}) {
+        for (const int components : {3, 1}) {
+          for (const int level : {0, 1, 3, 6, 9}) {
+            benchmark->Args({width, height, components, level});
+          }
+        }
+      }
+    })
+    ->Unit(benchmark::kMillisecond);
+
+// Read a raw float remap table of the given output size.
+static void BM_LoadRawFloatImage(benchmark::State& state) {
+  const int width = static_cast<int>(state.range(0));
+  const int height = static_cast<int>(state.range(1));
+  const std::filesystem::path path = ScratchDirectory() / fmt::format("table_{}x{}.bin", width, height);
+  {
+    const std::vector<float> rays(static_cast<std::size_t>(width) * height * 3, 0.5f);
+    std::ofstream stream{path, std::ios::out | std::ios::binary | std::ios::trunc};
+    stream.write(reinterpret_cast<const char*>(rays.data()), static_cast<std::streamsize>(rays.size() * 4));
+  }
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(images::LoadRawFloatImage(path, width, height, 3));
+  }
+  state.SetBytesProcessed(state.iterations() * width * height * 3 * 4);
+}
+BENCHMARK(BM_LoadRawFloatImage)
+    ->ArgNames({"width", "height"})
+    ->Args({1280, 720})
+    ->Args({1920, 1080})
+    ->Args({3840, 2160})
+    ->Unit(benchmark::kMillisecond);
+
+// Load all 12 faces of one frame, sequentially (parallel = 0) or in parallel (parallel = 1).
+static void BM_LoadCubemapImages(benchmark::State& state) {
+  const int face_size = static_cast<int>(state.range(0));
+  const bool parallelize = state.range(1) != 0;
+  const std::filesystem::path dataset = SyntheticDataset(face_size);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(images::LoadCubemapImages(dataset, 0, 0, parallelize));
+  }
+  state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_LoadCubemapImages)
+    ->ArgNames({"face", "parallel"})
+    ->ArgsProduct({{512, 1024, 2048}, {0, 1}})
+    ->Unit(benchmark::kMillisecond)
+    ->UseRealTime();
+
+}  // namespace benchmarks
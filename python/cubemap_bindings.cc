@@ -0,0 +1,206 @@
+// Copyright 2023 Gareth Cross
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <pybind11/numpy.h>
+#include <pybind11/pybind11.h>
+#include <pybind11/stl.h>
+
+#include "assertions.hpp"
+#include "converter.hpp"
+#include "remap_table.hpp"
+#include "synthetic_dataset.hpp"
+
+namespace py = pybind11;
+
+using RgbFaces = py::array_t<uint8_t, py::array::c_style | py::array::forcecast>;
+using InvDepthFaces = py::array_t<uint16_t, py::array::c_style | py::array::forcecast>;
+
+// Camera tables from the keyword arguments of `Converter`, which match the options of `cubemap_converter`.
+static converter::CameraTables MakeCameraTables(const std::string& remap_table, const int width, const int height,
+                                                const int table_stride, const std::string& table_encoding,
+                                                const std::string& table_interpolation,
+                                                const std::string& camera_model, const std::vector<float>& intrinsics,
+                                                const std::vector<float>& distortion, const std::string& mask) {
+  if (remap_table.empty() == camera_model.empty()) {
+    throw py::value_error("Specify exactly one of remap_table or camera_model.");
+  }
+  if (table_encoding != "float32" && table_encoding != "oct16") {
+    throw py::value_error("table_encoding must be float32 or oct16, got: " + table_encoding);
+  }
+  if (table_interpolation != "bilinear" && table_interpolation != "bicubic") {
+    throw py::value_error("table_interpolation must be bilinear or bicubic, got: " + table_interpolation);
+  }
+  for (const std::string& path : {remap_table, mask}) {
+    if (!path.empty() && !std::filesystem::is_regular_file(path)) {
+      throw py::value_error("File does not exist: " + path);
+    }
+  }
+  // Only a remap table w/ a header provides its own dimensions, so they may be omitted (zero) in that case:
+  const bool needs_dimensions = !camera_model.empty() || !remap_table::IsRemapTableFile(remap_table);
+  if (width < 0 || height < 0 || (needs_dimensions && (width == 0 || height == 0))) {
+    throw py::value_error("width and height must be positive, got: " + std::to_string(width) + "x" +
+                          std::to_string(height));
+  }
+  converter::CameraTables tables{};
+  tables.table_path = remap_table;
+  tables.width = width;
+  tables.height = height;
+  tables.table_stride = table_stride;
+  tables.table_encoding =
+      table_encoding == "oct16" ? cpu_engine::TableEncoding::Oct16 : cpu_engine::TableEncoding::Float32;
+  tables.table_interpolation = table_interpolation == "bicubic" ? cpu_engine::TableInterpolation::Bicubic
+                                                                : cpu_engine::TableInterpolation::Bilinear;
+  if (!camera_model.empty()) {
+    if (camera_model != "fisheye" && camera_model != "brown-conrady") {
+      throw py::value_error("camera_model must be fisheye or brown-conrady, got: " + camera_model);
+    }
+    const std::size_t num_coeffs = camera_model == "fisheye" ? 4 : 5;
+    if (intrinsics.size() != 4 || distortion.size() != num_coeffs) {
+      throw py::value_error("Camera model " + camera_model + " requires 4 intrinsics and " +
+                            std::to_string(num_coeffs) + " distortion coefficients.");
+    }
+    camera_models::CameraIntrinsics& model = tables.camera_model;
+    model.model = camera_models::ParseCameraModel(camera_model);
+    model.fx = intrinsics[0];
+    model.fy = intrinsics[1];
+    model.cx = intrinsics[2];
+    model.cy = intrinsics[3];
+    std::copy(distortion.begin(), distortion.end(), model.coeffs.begin());
+  }
+  tables.valid_mask_path = mask;
+  return tables;
+}
+
+// Faces must be [6, size, size, 3] (RGB) and [6, size, size] (inverse depth).
+static void CheckFaces(const RgbFaces& rgb, const InvDepthFaces& inv_depth) {
+  if (rgb.ndim() != 4 || rgb.shape(0) != 6 || rgb.shape(1) != rgb.shape(2) || rgb.shape(3) != 3) {
+    throw py::value_error("rgb_faces must have shape [6, size, size, 3].");
+  }
+  if (inv_depth.ndim() != 3 || inv_depth.shape(0) != 6 || inv_depth.shape(1) != inv_depth.shape(2)) {
+    throw py::value_error("inv_depth_faces must have shape [6, size, size].");
+  }
+}
+
+// Copy the faces into the images the engine renders from. Does not require the GIL.
+static std::vector<images::SimpleImage> CopyFaces(const RgbFaces& rgb, const InvDepthFaces& inv_depth) {
+  std::vector<images::SimpleImage> faces{};
+  faces.reserve(12);
+  const auto append_faces = [&faces](const uint8_t* data, const int size, const int components,
+                                     const images::ImageDepth depth) {
+    for (int face = 0; face < 6; ++face) {
+      images::SimpleImage& image = faces.emplace_back(size, size, components, depth);
+      std::memcpy(image.data.data(), data + face * image.data.size(), image.data.size());
+    }
+  };
+  append_faces(rgb.data(), static_cast<int>(rgb.shape(1)), 3, images::ImageDepth::Bits8);
+  append_faces(reinterpret_cast<const uint8_t*>(inv_depth.data()), static_cast<int>(inv_depth.shape(1)), 1,
+               images::ImageDepth::Bits16);
+  return faces;
+}
+
+// Wrap `image` in a NumPy array w/o copying it: the array owns the image. The rows are stored bottom-up, so the array
+// starts at the last row and steps backwards, which presents the image top-down.
+static py::array WrapImage(images::SimpleImage image) {
+  auto owner = std::make_unique<images::SimpleImage>(std::move(image));
+  const images::SimpleImage& view = *owner;
+  const auto element_size = static_cast<py::ssize_t>(view.depth);
+  const auto row_stride = static_cast<py::ssize_t>(view.Stride());
+  std::vector<py::ssize_t> shape{view.height, view.width};
+  std::vector<py::ssize_t> strides{-row_stride, view.components * element_size};
+  if (view.components > 1) {
+    shape.push_back(view.components);
+    strides.push_back(element_size);
+  }
+  const uint8_t* const last_row = view.data.data() + row_stride * (view.height - 1);
+  const py::dtype dtype =
+      view.depth == images::ImageDepth::Bits16 ? py::dtype::of<uint16_t>() : py::dtype::of<uint8_t>();
+  py::capsule base{owner.get(), [](void* ptr) { delete static_cast<images::SimpleImage*>(ptr); }};
+  owner.release();
+  return py::array{dtype, shape, strides, last_row, base};
+}
+
+// The faces of a frame of the synthetic dataset (see `cubemap_dataset_generator`), in the layout `convert` expects.
+static py::tuple MakeSyntheticFaces(const int face_size, const std::size_t frame, const std::size_t camera,
+                                    const uint32_t seed) {
+  if (face_size <= 0) {
+    throw py::value_error("face_size must be positive, got: " + std::to_string(face_size));
+  }
+  synthetic_dataset::DatasetOptions options{};
+  options.face_size = face_size;
+  options.seed = seed;
+  std::vector<images::SimpleImage> faces{};
+  {
+    py::gil_scoped_release release{};
+    faces = synthetic_dataset::MakeFaces(options, frame, camera);
+  }
+  RgbFaces rgb({6, face_size, face_size, 3});
+  InvDepthFaces inv_depth({6, face_size, face_size});
+  for (int face = 0; face < 6; ++face) {
+    const std::vector<uint8_t>& rgb_data = faces[face].data;
+    const std::vector<uint8_t>& inv_depth_data = faces[face + 6].data;
+    std::memcpy(rgb.mutable_data(face), rgb_data.data(), rgb_data.size());
+    std::memcpy(inv_depth.mutable_data(face), inv_depth_data.data(), inv_depth_data.size());
+  }
+  return py::make_tuple(std::move(rgb), std::move(inv_depth));
+}
+
+PYBIND11_MODULE(cubemap, m) {
+  m.doc() = "Convert cubemaps to native images, in-process.";
+
+  // Failures of the converter (eg. a malformed remap table) raise RuntimeError instead of terminating Python:
+  SetAssertionsThrow(true);
+
+  py::class_<converter::Converter>(m, "Converter", R"doc(
+Converts the 12 cubemap faces of a frame to a native RGB image and inverse range image, on the CPU.
+
+Construct w/ either a remap table or a camera model, using the same options as `cubemap_converter`.
+`convert` releases the GIL, and may be called from several threads at once.
+)doc")
+      .def(py::init([](const std::string& remap_table, const int width, const int height, const int table_stride,
+                       const std::string& table_encoding, const std::string& table_interpolation,
+                       const std::string& camera_model, const std::vector<float>& intrinsics,
+                       const std::vector<float>& distortion, const std::string& mask, const std::size_t num_threads) {
+             converter::ConverterOptions options{};
+             if (num_threads > 0) {
+               options.num_threads = num_threads;
+             }
+             return std::make_unique<converter::Converter>(
+                 MakeCameraTables(remap_table, width, height, table_stride, table_encoding, table_interpolation,
+                                  camera_model, intrinsics, distortion, mask),
+                 options);
+           }),
+           py::kw_only(), py::arg("remap_table") = "", py::arg("width") = 0, py::arg("height") = 0,
+           py::arg("table_stride") = 1, py::arg("table_encoding") = "float32",
+           py::arg("table_interpolation") = "bicubic", py::arg("camera_model") = "",
+           py::arg("intrinsics") = std::vector<float>{}, py::arg("distortion") = std::vector<float>{},
+           py::arg("mask") = "", py::arg("num_threads") = 0)
+      .def(
+          "convert",
+          [](const converter::Converter& self, const RgbFaces& rgb_faces, const InvDepthFaces& inv_depth_faces) {
+            CheckFaces(rgb_faces, inv_depth_faces);
+            converter::Output output{};
+            {
+              py::gil_scoped_release release{};
+              output = self.Convert(0, CopyFaces(rgb_faces, inv_depth_faces));
+            }
+            return py::make_tuple(WrapImage(std::move(output.rgb)), WrapImage(std::move(output.inv_range)));
+          },
+          py::arg("rgb_faces"), py::arg("inv_depth_faces"), R"doc(
+Convert one frame. `rgb_faces` is uint8 [6, size, size, 3] and `inv_depth_faces` is uint16 [6, size, size], in the
+order and row order of the PNG files of a dataset. Returns (rgb, inv_range): uint8 [height, width, 3] and uint16
+[height, width]. The outputs are views of the converted images, not copies.
+)doc")
+      .def_property_readonly("width", &converter::Converter::Width)
+      .def_property_readonly("height", &converter::Converter::Height);
+
+  m.def("make_synthetic_faces", &MakeSyntheticFaces, py::kw_only(), py::arg("face_size"), py::arg("frame") = 0,
+        py::arg("camera") = 0, py::arg("seed") = 0, R"doc(
+Generate the faces of one frame of the synthetic dataset of `cubemap_dataset_generator`. Returns (rgb_faces,
+inv_depth_faces), in the layout `Converter.convert` expects.
+)doc");
+}
@@ -0,0 +1,71 @@
+"""
+Smoke test of the `cubemap` module: convert one synthetic frame on the CPU, and check the layout of the outputs.
+
+Run w/ the directory of the built module on the path (CTest does this):
+
+    PYTHONPATH=build/python python -m unittest python/test_cubemap.py
+"""
+import os
+import tempfile
+import unittest
+
+import numpy as np
+
+import cubemap
+
+WIDTH = 64
+HEIGHT = 48
+FACE_SIZE = 32
+FISHEYE = dict(camera_model="fisheye", intrinsics=[24.0, 24.0, 32.0, 24.0], distortion=[0.0, 0.0, 0.0, 0.0])
+
+
+class ConverterTest(unittest.TestCase):
+    def test_convert_synthetic_frame(self):
+        rgb_faces, inv_depth_faces = cubemap.make_synthetic_faces(face_size=FACE_SIZE, frame=3)
+        self.assertEqual(rgb_faces.shape, (6, FACE_SIZE, FACE_SIZE, 3))
+        self.assertEqual(inv_depth_faces.shape, (6, FACE_SIZE, FACE_SIZE))
+        self.assertEqual(rgb_faces.dtype, np.uint8)
+        self.assertEqual(inv_depth_faces.dtype, np.uint16)
+
+        converter = cubemap.Converter(width=WIDTH, height=HEIGHT, num_threads=1, **FISHEYE)
+        self.assertEqual((converter.width, converter.height), (WIDTH, HEIGHT))
+        rgb, inv_range = converter.convert(rgb_faces, inv_depth_faces)
+
+        self.assertEqual(rgb.shape, (HEIGHT, WIDTH, 3))
+        self.assertEqual(inv_range.shape, (HEIGHT, WIDTH))
+        self.assertEqual(rgb.dtype, np.uint8)
+        self.assertEqual(inv_range.dtype, np.uint16)
+        # Rows are stored bottom-up, so the views step backwards over them:
+        self.assertLess(rgb.strides[0], 0)
+        self.assertLess(inv_range.strides[0], 0)
+        self.assertEqual(rgb.strides[1:], (3, 1))
+        self.assertEqual(inv_range.strides[1], 2)
+        # Every pixel sees a wall of the room:
+        self.assertTrue(np.all(inv_range > 0))
+        self.assertGreater(int(rgb.max()), 0)
+
+    def test_convert_rejects_bad_faces(self):
+        converter = cubemap.Converter(width=WIDTH, height=HEIGHT, num_threads=1, **FISHEYE)
+        rgb_faces, inv_depth_faces = cubemap.make_synthetic_faces(face_size=FACE_SIZE)
+        with self.assertRaises(ValueError):
+            converter.convert(rgb_faces[:5], inv_depth_faces)
+
+    def test_invalid_arguments_raise(self):
+        with self.assertRaises(ValueError):
+            cubemap.Converter(**FISHEYE)  # No dimensions.
+        with self.assertRaises(ValueError):
+            cubemap.Converter(remap_table=os.path.join(tempfile.gettempdir(), "does_not_exist.cmrt"))
+        with self.assertRaises(ValueError):
+            cubemap.Converter(width=WIDTH, height=HEIGHT, mask="does_not_exist.png", **FISHEYE)
+
+    def test_converter_failure_raises(self):
+        # A table of the wrong size fails inside the converter, which must raise rather than terminate:
+        with tempfile.NamedTemporaryFile(suffix=".bin") as table:
+            table.write(b"\0" * 16)
+            table.flush()
+            with self.assertRaises(RuntimeError):
+                cubemap.Converter(remap_table=table.name, width=WIDTH, height=HEIGHT)
+
+
+if __name__ == "__main__":
+    unittest.main()
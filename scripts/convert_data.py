@@ -5,14 +5,26 @@ import numpy as np
 import pprint
 import shutil
 import subprocess
-import tempfile
 import tomli
 import typing as T
 
 from pathlib import Path
 
 from fisheye_model import unproject_fisheye
-from utils import create_grid
+from remap_grid import (
+    INTERPOLATION_METHODS,
+    create_grid_points,
+    grid_dimensions,
+    validate_grid,
+)
+from remap_table_file import serialize_remap_table
+from table_encoding import TABLE_ENCODINGS, decode_table, encode_table
+from table_cache import (
+    CacheEntry,
+    compute_mask_bounds,
+    default_cache_dir,
+    get_or_create_table,
+)
 
 SCRIPT_PATH = Path(__file__).parent.resolve()
 
@@ -37,7 +49,9 @@ def get_camera_matrix(camera: T.Dict[str, T.Any]) -> np.ndarray:
             )
 
 
-def create_fisheye_remap_table(camera: T.Dict[str, T.Any]) -> np.ndarray:
+def create_fisheye_remap_table(
+    camera: T.Dict[str, T.Any], stride: int = 1
+) -> np.ndarray:
     """Create remap table for the kannala-brant fisheye model."""
     width, height = get_image_dimensions(camera)
     K = get_camera_matrix(camera)
@@ -51,11 +65,16 @@ def create_fisheye_remap_table(camera: T.Dict[str, T.Any]) -> np.ndarray:
             )
 
     # construct table
-    p_native = create_grid(width=width, height=height)
-    return unproject_fisheye(p_native, K=K, coeffs=coeffs).reshape([height, width, 3])
+    grid_width, grid_height = grid_dimensions(width=width, height=height, stride=stride)
+    p_native = create_grid_points(width=width, height=height, stride=stride)
+    return unproject_fisheye(p_native, K=K, coeffs=coeffs).reshape(
+        [grid_height, grid_width, 3]
+    )
 
 
-def create_brown_conrady_remap_table(camera: T.Dict[str, T.Any]) -> np.ndarray:
+def create_brown_conrady_remap_table(
+    camera: T.Dict[str, T.Any], stride: int = 1
+) -> np.ndarray:
     """Create remap table for the OpenCV/brown-conrady model."""
     width, height = get_image_dimensions(camera)
     K = get_camera_matrix(camera)
@@ -68,7 +87,8 @@ def create_brown_conrady_remap_table(camera: T.Dict[str, T.Any]) -> np.ndarray:
                 f"Incorrect specification of distortion parameters: {pprint.pformat(camera)}"
             )
 
-    p_native = create_grid(width=width, height=height)
+    grid_width, grid_height = grid_dimensions(width=width, height=height, stride=stride)
+    p_native = create_grid_points(width=width, height=height, stride=stride)
     p_undistorted = cv2.undistortPoints(
         p_native.astype(np.float64), K.astype(np.float64), coeffs
     )
@@ -79,23 +99,117 @@ def create_brown_conrady_remap_table(camera: T.Dict[str, T.Any]) -> np.ndarray:
     v_cam = p_undistorted_unit_depth / np.linalg.norm(
         p_undistorted_unit_depth, axis=1, keepdims=True
     )
-    return v_cam.reshape([height, width, 3])
+    return v_cam.reshape([grid_height, grid_width, 3])
 
 
-def create_remap_table(camera: T.Dict[str, T.Any]) -> np.ndarray:
-    """Create remap table for the provided camera."""
+def create_remap_table(
+    camera: T.Dict[str, T.Any], stride: int = 1
+) -> np.ndarray:
+    """Create remap table for the provided camera, sampling every `stride`-th pixel."""
     if "model" not in camera:
         raise KeyError(f"Camera lacks a model specifier: {pprint.pformat(camera)}")
 
     model = camera["model"]
     if model == "fisheye":
-        return create_fisheye_remap_table(camera)
+        return create_fisheye_remap_table(camera, stride=stride)
     elif model == "brown-conrady":
-        return create_brown_conrady_remap_table(camera)
+        return create_brown_conrady_remap_table(camera, stride=stride)
     else:
         raise KeyError(f"Invalid camera model: {model}")
 
 
+def get_camera_parameters(
+    camera: T.Dict[str, T.Any]
+) -> T.Tuple[T.List[float], T.List[float]]:
+    """The intrinsics [fx, fy, cx, cy] and distortion coefficients, in the order the converter expects."""
+    model = camera.get("model")
+    distortion = camera.get("distortion_coefficients", dict())
+    if model == "fisheye":
+        coeff_names = ("k1", "k2", "k3", "k4")
+    elif model == "brown-conrady":
+        coeff_names = ("k1", "k2", "p1", "p2", "k3")
+    else:
+        raise KeyError(f"Invalid camera model: {model}")
+    K = get_camera_matrix(camera)
+    intrinsics = [float(K[0, 0]), float(K[1, 1]), float(K[0, 2]), float(K[1, 2])]
+    coeffs = [float(distortion[name]) for name in coeff_names]
+    return intrinsics, coeffs
+
+
+def build_remap_table(
+    camera: T.Dict[str, T.Any], stride: int, encoding: str
+) -> T.Tuple[bytes, T.Dict[str, T.Any]]:
+    """
+    Create the remap table file that we pass to the converter, along with metadata describing it.
+    The error of the stored table (after encoding, and interpolation of a coarse table) versus the full resolution
+    float64 table is measured for every interpolation method.
+    """
+    width, height = get_image_dimensions(camera)
+    full_table = create_remap_table(camera=camera, stride=1)
+    grid = (
+        full_table if stride == 1 else create_remap_table(camera=camera, stride=stride)
+    )
+    encoded = encode_table(grid, encoding=encoding)
+
+    # Pixels that do not have a ray (outside the image circle of a fisheye, for example) are masked out:
+    valid = np.all(np.isfinite(full_table), axis=-1)
+    intrinsics, coeffs = get_camera_parameters(camera)
+    contents = serialize_remap_table(
+        rays=encoded,
+        width=width,
+        height=height,
+        stride=stride,
+        encoding=encoding,
+        camera_model=camera["model"],
+        intrinsics=intrinsics + coeffs,
+        valid_mask=None if np.all(valid) else valid.astype(np.uint8) * 255,
+    )
+    metadata = dict(
+        width=width,
+        height=height,
+        stride=stride,
+        encoding=encoding,
+        mask_bounds=compute_mask_bounds(full_table),
+        interpolation_error=validate_grid(
+            grid=decode_table(encoded, encoding=encoding),
+            full_table=full_table,
+            stride=stride,
+        ),
+    )
+    return contents, metadata
+
+
+def check_table_error(table: CacheEntry, interpolation: str, max_error_deg: float):
+    """Report the error of a coarse or compressed table, and fail if it exceeds the limit."""
+    if table.stride == 1 and table.encoding == "float32":
+        return
+    errors = table.metadata["interpolation_error"][interpolation]
+    grid_width, grid_height = grid_dimensions(table.width, table.height, table.stride)
+    print(
+        f"Remap table: {table.width}x{table.height} stored as {grid_width}x{grid_height} {table.encoding} grid "
+        f"(stride = {table.stride}). "
+        f"{interpolation} error: max = {errors['max_error_deg']:.3e} deg, mean = {errors['mean_error_deg']:.3e} deg"
+    )
+    if errors["max_error_deg"] > max_error_deg:
+        raise ValueError(
+            f"Coarse remap table error ({errors['max_error_deg']:.3e} deg) exceeds the limit of {max_error_deg} deg. "
+            "Use a smaller --table-stride, bicubic interpolation, or float32 encoding."
+        )
+
+
+def get_camera_model_args(camera: T.Dict[str, T.Any]) -> T.List[str]:
+    """Arguments that make the converter compute rays from the camera model directly (no remap table)."""
+    intrinsics, coeffs = get_camera_parameters(camera)
+    return [
+        "--camera-model",
+        camera["model"],
+        "--intrinsics",
+        ",".join(repr(x) for x in intrinsics),
+        "--distortion",
+        ",".join(repr(x) for x in coeffs),
+    ]
+
+
 def main(args: argparse.Namespace):
     if args.bin is None:
         args.bin = SCRIPT_PATH.parent / "build" / "cubemap_converter.exe"
@@ -118,14 +232,10 @@ def main(args: argparse.Namespace):
         )
         exit(1)
 
-    temp_dir = Path(tempfile.mkdtemp(prefix="cubemap_converter_"))
+    cache_dir = Path(args.cache_dir) if args.cache_dir else default_cache_dir()
 
     for index, description in enumerate(cameras):
-        remap_table = create_remap_table(camera=description)
-
-        # Write out the table somewhere
-        remap_table_path = temp_dir / f"camera_{index:02}.raw"
-        remap_table.astype(np.float32).tofile(remap_table_path)
+        width, height = get_image_dimensions(description)
 
         # Create a command to convert
         command = [
@@ -135,16 +245,44 @@ def main(args: argparse.Namespace):
             "--output-path",
             str(output_path),
             "--width",
-            str(remap_table.shape[1]),
+            str(width),
             "--height",
-            str(remap_table.shape[0]),
+            str(height),
             "--camera-index",
             str(index),
             "--num-images",
             str(len(gt_poses)),
-            "--remap-table",
-            str(remap_table_path),
+            "--engine",
+            args.engine,
         ]
+        if args.resume:
+            command.append("--resume")
+
+        if args.analytic:
+            # The converter evaluates the camera model per pixel, no table needed.
+            command += get_camera_model_args(description)
+        else:
+            # Fetch the table from the cache (or generate it):
+            table = get_or_create_table(
+                cache_dir=cache_dir,
+                camera=description,
+                table_options=dict(
+                    stride=args.table_stride, encoding=args.table_encoding
+                ),
+                create_fn=build_remap_table,
+            )
+            check_table_error(
+                table,
+                interpolation=args.table_interpolation,
+                max_error_deg=args.max_table_error_deg,
+            )
+            # The table file stores its own stride, encoding and valid mask:
+            command += [
+                "--remap-table",
+                str(table.table_path),
+                "--table-interpolation",
+                args.table_interpolation,
+            ]
         print(f"Running: {' '.join(command)}")
         subprocess.check_call(command)
 
@@ -171,6 +309,52 @@ def parse_args():
     parser.add_argument(
         "-c", "--config", type=str, required=True, help="Path to configuration file."
     )
+    parser.add_argument(
+        "--cache-dir",
+        type=str,
+        default=None,
+        help="Directory in which remap tables are cached (default: ~/.cache/cubemap_converter).",
+    )
+    parser.add_argument(
+        "--analytic",
+        action="store_true",
+        help="Compute rays from the camera model in the converter, instead of generating a remap table.",
+    )
+    parser.add_argument(
+        "--engine",
+        choices=("gl", "cpu"),
+        default="gl",
+        help="Engine the converter uses: OpenGL or CPU.",
+    )
+    parser.add_argument(
+        "--table-stride",
+        type=int,
+        default=1,
+        help="Store the remap table on a coarse grid, sampling every N-th pixel.",
+    )
+    parser.add_argument(
+        "--table-interpolation",
+        choices=INTERPOLATION_METHODS,
+        default="bicubic",
+        help="How the converter interpolates a coarse remap table.",
+    )
+    parser.add_argument(
+        "--table-encoding",
+        choices=TABLE_ENCODINGS,
+        default="float32",
+        help="How rays are stored in the remap table (oct16 is 3x smaller).",
+    )
+    parser.add_argument(
+        "--max-table-error-deg",
+        type=float,
+        default=0.01,
+        help="Maximum allowed angular error (degrees) of a coarse remap table.",
+    )
+    parser.add_argument(
+        "--resume",
+        action="store_true",
+        help="Skip frames that a previous (interrupted) run already converted.",
+    )
     parser.add_argument(
         "-i", "--input", type=str, default=None, required=True, help="Input directory."
     )
@@ -0,0 +1,135 @@
+"""
+End to end test of `cubemap_coordinator`: serve a small synthetic dataset to several local
+`cubemap_converter --coordinator` workers, and check that every frame was written exactly once.
+
+The workers run w/ `--manifest`, which appends one line per frame they wrote to a manifest shared by
+all of them, so a frame converted twice (or not at all) shows up there. CTest runs this as the
+`coordinator_workers` test (`-DCUBEMAP_BUILD_TESTS=ON`):
+
+    python coordinator_test.py --bin-dir build --work-dir /tmp/coordinator_test --num-workers 3
+
+Exit status is 0 if every frame was written once, and 1 otherwise.
+"""
+import argparse
+import shutil
+import subprocess
+import sys
+import time
+import typing as T
+
+from pathlib import Path
+
+from scaling_benchmark import executable, generate_dataset
+
+# Small frames, so the test is quick even w/ a debug build:
+FACE_SIZE = 64
+WIDTH = 64
+HEIGHT = 48
+
+
+def wait_for_socket(path: Path, coordinator: subprocess.Popen, timeout: float = 30.0) -> None:
+    """Wait until the coordinator is listening on `path`."""
+    deadline = time.monotonic() + timeout
+    while not path.exists():
+        if coordinator.poll() is not None:
+            raise RuntimeError(f"The coordinator exited w/ status {coordinator.returncode}.")
+        if time.monotonic() > deadline:
+            raise RuntimeError(f"The coordinator did not create {path} within {timeout} s.")
+        time.sleep(0.05)
+
+
+def count_manifest(path: Path) -> T.Dict[int, int]:
+    """Number of `<index> done` lines per frame index in the manifest at `path`."""
+    counts: T.Dict[int, int] = {}
+    with open(path, "r") as handle:
+        for line in handle:
+            index, _, state = line.strip().partition(" ")
+            if state == "done":
+                counts[int(index)] = counts.get(int(index), 0) + 1
+    return counts
+
+
+def main(args: argparse.Namespace) -> int:
+    bin_dir = Path(args.bin_dir)
+    work_dir = Path(args.work_dir)
+    dataset = generate_dataset(executable(bin_dir, "cubemap_dataset_generator"),
+                               work_dir / "datasets", FACE_SIZE, args.num_frames)
+    output_dir = work_dir / "outputs"
+    if output_dir.exists():
+        shutil.rmtree(output_dir)
+    socket_path = work_dir / "coordinator.sock"
+    # Left behind by an interrupted run, the socket would be mistaken for a listening coordinator:
+    if socket_path.exists():
+        socket_path.unlink()
+
+    coordinator = subprocess.Popen([
+        str(executable(bin_dir, "cubemap_coordinator")), "--socket",
+        str(socket_path), "--num-images",
+        str(args.num_frames), "--chunk-size", "2", "--lease-timeout", "60"
+    ])
+    workers: T.List[subprocess.Popen] = []
+    try:
+        wait_for_socket(socket_path, coordinator)
+        focal_length = WIDTH / 4.0
+        for _ in range(args.num_workers):
+            workers.append(
+                subprocess.Popen([
+                    str(executable(bin_dir, "cubemap_converter")), "-i",
+                    str(dataset), "--num-images",
+                    str(args.num_frames), "-c", "0", "--coordinator",
+                    str(socket_path), "--engine", "cpu", "--camera-model", "fisheye",
+                    "--intrinsics", f"{focal_length},{focal_length},{WIDTH / 2.0},{HEIGHT / 2.0}",
+                    "--distortion", "0,0,0,0", "--width",
+                    str(WIDTH), "--height",
+                    str(HEIGHT), "--cpu-threads", "1", "--writer-threads", "1", "-o",
+                    str(output_dir), "--manifest"
+                ],
+                                 stdout=subprocess.DEVNULL))
+        worker_status = [worker.wait(timeout=args.timeout) for worker in workers]
+        coordinator_status = coordinator.wait(timeout=args.timeout)
+    finally:
+        for process in workers + [coordinator]:
+            if process.poll() is None:
+                process.kill()
+
+    failures = []
+    if any(worker_status):
+        failures.append(f"Workers exited w/ status: {worker_status}")
+    if coordinator_status != 0:
+        failures.append(f"The coordinator exited w/ status {coordinator_status}")
+    counts = count_manifest(output_dir / "manifest" / "camera00.txt")
+    for index in range(args.num_frames):
+        if counts.get(index, 0) != 1:
+            failures.append(f"Frame {index} was written {counts.get(index, 0)} times.")
+        for kind in ("image", "range"):
+            if not (output_dir / kind / "camera00" / f"{index:08}.png").exists():
+                failures.append(f"Frame {index} has no {kind} output.")
+    unexpected = sorted(set(counts) - set(range(args.num_frames)))
+    if unexpected:
+        failures.append(f"Frames outside the dataset were written: {unexpected}")
+
+    for failure in failures:
+        print(failure)
+    if not failures:
+        print(f"{args.num_workers} workers wrote each of the {args.num_frames} frames exactly once.")
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bin-dir",
+                        type=str,
+                        required=True,
+                        help="Directory w/ cubemap_converter, cubemap_coordinator and the generator.")
+    parser.add_argument("--work-dir",
+                        type=str,
+                        required=True,
+                        help="Directory for the dataset and the outputs. The dataset is re-used.")
+    parser.add_argument("--num-workers", type=int, default=3, help="Number of converter processes.")
+    parser.add_argument("--num-frames", type=int, default=24, help="Frames in the dataset.")
+    parser.add_argument("--timeout",
+                        type=float,
+                        default=300.0,
+                        help="Seconds to wait for the workers and the coordinator to finish.")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,142 @@
+"""
+Compare two run reports written by `cubemap_converter --report` and flag regressions.
+
+Throughput regresses when it drops, stage times and memory peaks regress when they grow. A metric
+is flagged when it changes by more than `--threshold` percent. Exits w/ status 1 if any metric
+regressed, so it can gate nightly jobs:
+
+    python cubemap_report_diff.py baseline.json candidate.json --threshold 5
+"""
+import argparse
+import json
+import sys
+import typing as T
+
+from pathlib import Path
+
+# The report version this script understands.
+REPORT_VERSION = 1
+
+# Stage statistics that are compared (count and total depend on the number of frames, max is noisy).
+STAGE_STATISTICS = ("mean_ms", "p50_ms", "p90_ms", "p99_ms")
+
+
+class Metric(T.NamedTuple):
+    name: str
+    baseline: float
+    candidate: float
+    higher_is_better: bool
+
+    def percent_change(self) -> float:
+        """Signed change of the candidate relative to the baseline, in percent."""
+        if self.baseline == 0.0:
+            return 0.0 if self.candidate == 0.0 else float("inf")
+        return (self.candidate - self.baseline) / abs(self.baseline) * 100.0
+
+    def relative_change(self) -> float:
+        """Change of the candidate relative to the baseline, positive when it got worse."""
+        change = self.percent_change() / 100.0
+        return -change if self.higher_is_better else change
+
+
+def load_report(path: Path) -> T.Dict[str, T.Any]:
+    with open(path, "r") as handle:
+        report = json.load(handle)
+    version = report.get("format_version")
+    if version != REPORT_VERSION:
+        raise RuntimeError(f"{path} has report version {version}, expected {REPORT_VERSION}")
+    return report
+
+
+def collect_metrics(baseline: T.Dict[str, T.Any], candidate: T.Dict[str, T.Any],
+                    min_ms: float) -> T.List[Metric]:
+    """Pair up the metrics present in both reports."""
+    metrics = []
+    for key, value in baseline["throughput"].items():
+        if key in candidate["throughput"]:
+            metrics.append(Metric(f"throughput.{key}", value, candidate["throughput"][key], True))
+
+    for stage, stats in baseline["stages"].items():
+        other = candidate["stages"].get(stage)
+        if other is None:
+            continue
+        for key in STAGE_STATISTICS:
+            # Very short stages are dominated by noise:
+            if max(stats[key], other[key]) < min_ms:
+                continue
+            metrics.append(Metric(f"stages.{stage}.{key}", stats[key], other[key], False))
+
+    memory, other_memory = baseline["memory"], candidate["memory"]
+    for owner, value in memory["peak_mb"].items():
+        if owner in other_memory["peak_mb"]:
+            metrics.append(
+                Metric(f"memory.peak_mb.{owner}", value, other_memory["peak_mb"][owner], False))
+    for key in ("total_peak_mb", "peak_rss_mb", "allocations_per_frame"):
+        # Older reports do not count allocations:
+        if key in memory and key in other_memory:
+            metrics.append(Metric(f"memory.{key}", memory[key], other_memory[key], False))
+    return metrics
+
+
+def describe_differences(section: str, baseline: T.Dict[str, T.Any],
+                         candidate: T.Dict[str, T.Any]) -> T.List[str]:
+    """List the keys of a section (config or hardware) whose values differ between the reports."""
+    lines = []
+    for key in sorted(set(baseline) | set(candidate)):
+        if baseline.get(key) != candidate.get(key):
+            lines.append(f"  {section}.{key}: {baseline.get(key)!r} -> {candidate.get(key)!r}")
+    return lines
+
+
+def main(args: argparse.Namespace) -> int:
+    baseline = load_report(Path(args.baseline))
+    candidate = load_report(Path(args.candidate))
+
+    # Differences in setup are not regressions, but explain them:
+    differences = describe_differences("config", baseline["config"], candidate["config"]) + \
+        describe_differences("hardware", baseline["hardware"], candidate["hardware"])
+    if differences:
+        print("The runs were configured differently:")
+        print("\n".join(differences))
+
+    threshold = args.threshold / 100.0
+    regressions = []
+    print(f"{'metric':<40} {'baseline':>12} {'candidate':>12} {'change':>9}")
+    for metric in collect_metrics(baseline, candidate, args.min_ms):
+        change = metric.relative_change()
+        flag = ""
+        if change > threshold:
+            flag = "  REGRESSION"
+            regressions.append(metric)
+        elif change < -threshold:
+            flag = "  improved"
+        print(f"{metric.name:<40} {metric.baseline:>12.3f} {metric.candidate:>12.3f} "
+              f"{metric.percent_change():>+8.1f}%{flag}")
+
+    print(f"Limiting stage: {baseline['bottleneck']['limiting_stage'] or 'none'} -> "
+          f"{candidate['bottleneck']['limiting_stage'] or 'none'}")
+    if regressions:
+        print(f"{len(regressions)} metric(s) regressed by more than {args.threshold}%.")
+        return 1
+    print(f"No regressions beyond {args.threshold}%.")
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("baseline", type=str, help="Report of the reference run.")
+    parser.add_argument("candidate", type=str, help="Report of the run to check.")
+    parser.add_argument(
+        "--threshold",
+        type=float,
+        default=10.0,
+        help="Relative change (in percent) beyond which a metric is flagged.",
+    )
+    parser.add_argument(
+        "--min-ms",
+        type=float,
+        default=0.5,
+        help="Ignore stage statistics shorter than this in both runs, since they are mostly noise.",
+    )
+    sys.exit(main(parser.parse_args()))
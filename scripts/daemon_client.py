@@ -0,0 +1,55 @@
+"""
+Submit conversion jobs to a `cubemap_converter --daemon <socket>`, and print their progress.
+
+Everything after `--` is passed to the daemon as the arguments of one conversion, exactly as they
+would be passed to `cubemap_converter`:
+
+    python daemon_client.py --socket /tmp/cubemap.sock -- -i /data/run1 --num-images 500 -c 0 \
+        -t table.cmrt -o /data/out
+
+Exit status is 0 if the job finished, and 1 if the daemon rejected it or went away.
+"""
+import argparse
+import socket
+import sys
+import typing as T
+
+
+def submit(socket_path: str, arguments: T.List[str]) -> int:
+    """Run one job on the daemon. Returns the number of frames converted, or raises on error."""
+    if any("\t" in argument or "\n" in argument for argument in arguments):
+        raise ValueError("Arguments may not contain tabs or newlines.")
+    with socket.socket(socket.AF_UNIX, socket.SOCK_STREAM) as connection:
+        connection.connect(socket_path)
+        connection.sendall(("\t".join(arguments) + "\n").encode("utf-8"))
+        with connection.makefile("r", encoding="utf-8") as replies:
+            for reply in replies:
+                kind, _, value = reply.rstrip("\n").partition(" ")
+                if kind == "PROGRESS":
+                    print(f"Converted {value} frames...", flush=True)
+                elif kind == "DONE":
+                    return int(value)
+                elif kind == "ERROR":
+                    raise RuntimeError(f"The daemon rejected the job: {value}")
+    raise RuntimeError("The daemon closed the connection before finishing the job.")
+
+
+def main(args: argparse.Namespace) -> int:
+    arguments = args.arguments[1:] if args.arguments[:1] == ["--"] else args.arguments
+    try:
+        num_frames = submit(args.socket, arguments)
+    except (OSError, RuntimeError, ValueError) as error:
+        print(error)
+        return 1
+    print(f"Done: converted {num_frames} frames.")
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--socket", type=str, required=True, help="Socket the daemon listens on.")
+    parser.add_argument("arguments",
+                        nargs=argparse.REMAINDER,
+                        help="Arguments of the conversion, after `--`.")
+    sys.exit(main(parser.parse_args()))
@@ -0,0 +1,193 @@
+"""
+Performance regression gate: run a fixed benchmark scenario, and compare it to a stored baseline.
+
+Each scenario runs `cubemap_converter` on a synthetic dataset (see `scaling_benchmark.py`) w/ fixed
+settings, and checks a few metrics of its report. The best of `--repeat` runs is used, to reduce
+noise. A metric fails when it is worse than the baseline by more than its tolerance, in percent.
+
+Exit status: 0 if every metric is within tolerance, 1 on a regression, and 77 if the scenario was
+skipped (no baseline for this machine, or no display for the OpenGL scenario). CTest runs each
+scenario as a test (`-DCUBEMAP_PERF_TESTS=ON`, label `perf`). To record new baselines:
+
+    cmake --build . --target update_perf_baselines
+"""
+import argparse
+import json
+import os
+import platform
+import sys
+import typing as T
+
+from pathlib import Path
+
+from scaling_benchmark import Settings, executable, generate_dataset, run_converter
+
+# Version of the baseline files.
+BASELINE_VERSION = 1
+
+# Exit status of a skipped test (CTest `SKIP_RETURN_CODE`).
+SKIPPED = 77
+
+
+class GatedMetric(T.NamedTuple):
+    # Path of the metric in the report, eg. `stages.render.p50_ms`.
+    path: str
+    higher_is_better: bool
+    # Allowed change for the worse, in percent.
+    tolerance: float
+
+
+class Scenario(T.NamedTuple):
+    settings: Settings
+    num_frames: int
+    metrics: T.Tuple[GatedMetric, ...]
+    # Added to the environment of the converter.
+    env: T.Dict[str, str] = {}
+
+
+# Thread counts are fixed, so that the baselines do not depend on how busy the machine is.
+SCENARIOS: T.Dict[str, Scenario] = {
+    # Whole frames on the CPU. Allocations per frame are deterministic, so their band is tight.
+    "cpu_engine":
+        Scenario(Settings("cpu", 4, 4, 2, 512, 1280, 720), 40, (
+            GatedMetric("throughput.frames_per_second", True, 15.0),
+            GatedMetric("stages.render.p50_ms", False, 15.0),
+            GatedMetric("memory.allocations_per_frame", False, 5.0),
+        )),
+    # PNG decode of the faces and encode of the outputs. One writer, so encodes do not contend.
+    "png_codec":
+        Scenario(Settings("cpu", 4, 1, 0, 1024, 1920, 1080), 20, (
+            GatedMetric("stages.decode.p50_ms", False, 15.0),
+            GatedMetric("stages.encode.p50_ms", False, 15.0),
+        )),
+    # The full OpenGL pipeline, on Mesa's software renderer so it runs on nodes w/o a GPU.
+    "gl_software":
+        Scenario(Settings("gl", 4, 4, 2, 512, 1280, 720), 40, (
+            GatedMetric("throughput.frames_per_second", True, 20.0),
+            GatedMetric("stages.unpack.p50_ms", False, 20.0),
+            GatedMetric("memory.allocations_per_frame", False, 5.0),
+        ), {"LIBGL_ALWAYS_SOFTWARE": "1"}),
+}
+
+
+def lookup(report: T.Dict[str, T.Any], path: str) -> float:
+    value: T.Any = report
+    for key in path.split("."):
+        value = value[key]
+    return float(value)
+
+
+def has_display() -> bool:
+    if platform.system() != "Linux":
+        return True
+    return bool(os.environ.get("DISPLAY") or os.environ.get("WAYLAND_DISPLAY"))
+
+
+def measure(scenario: Scenario, args: argparse.Namespace) -> T.Tuple[T.Dict[str, float], str]:
+    """Run the scenario `--repeat` times. Returns the best value of each metric and the CPU name."""
+    bin_dir = Path(args.bin_dir)
+    work_dir = Path(args.work_dir)
+    dataset = generate_dataset(executable(bin_dir, "cubemap_dataset_generator"),
+                               work_dir / "datasets", scenario.settings.face_size,
+                               scenario.num_frames)
+    best: T.Dict[str, float] = {}
+    cpu = ""
+    for _ in range(args.repeat):
+        report = run_converter(executable(bin_dir, "cubemap_converter"),
+                               dataset,
+                               scenario.settings,
+                               scenario.num_frames,
+                               work_dir,
+                               write_outputs=False,
+                               env=scenario.env)
+        cpu = report["hardware"]["cpu"]
+        for metric in scenario.metrics:
+            value = lookup(report, metric.path)
+            if metric.path not in best:
+                best[metric.path] = value
+            elif metric.higher_is_better:
+                best[metric.path] = max(best[metric.path], value)
+            else:
+                best[metric.path] = min(best[metric.path], value)
+    return best, cpu
+
+
+def main(args: argparse.Namespace) -> int:
+    scenario = SCENARIOS[args.scenario]
+    baseline_path = Path(args.baseline_dir) / f"{args.scenario}.json"
+    if scenario.settings.engine == "gl" and not has_display():
+        print("Skipped: the OpenGL scenario needs a display (eg. run under `xvfb-run`).")
+        # Updating the other baselines should still succeed:
+        return 0 if args.update else SKIPPED
+
+    baseline = None
+    if not args.update:
+        if not baseline_path.exists():
+            print(f"Skipped: no baseline at {baseline_path}. Record one w/ --update.")
+            return SKIPPED
+        with open(baseline_path, "r") as handle:
+            baseline = json.load(handle)
+        if baseline.get("format_version") != BASELINE_VERSION:
+            raise RuntimeError(f"{baseline_path} has version {baseline.get('format_version')}, "
+                               f"expected {BASELINE_VERSION}")
+
+    values, cpu = measure(scenario, args)
+    if args.update:
+        baseline_path.parent.mkdir(parents=True, exist_ok=True)
+        with open(baseline_path, "w") as handle:
+            json.dump({"format_version": BASELINE_VERSION, "cpu": cpu, "metrics": values},
+                      handle,
+                      indent=2)
+            handle.write("\n")
+        print(f"Wrote baseline: {baseline_path}")
+        return 0
+
+    # Timings from another machine say nothing about this one:
+    if baseline["cpu"] != cpu:
+        print(f"Skipped: the baseline was recorded on `{baseline['cpu']}`, this is `{cpu}`.")
+        return SKIPPED
+
+    regressed = False
+    print(f"{'metric':<36} {'baseline':>12} {'measured':>12} {'change':>9} {'allowed':>9}")
+    for metric in scenario.metrics:
+        reference = baseline["metrics"].get(metric.path)
+        if reference is None:
+            print(f"{metric.path:<36} not in the baseline, update it w/ --update")
+            continue
+        value = values[metric.path]
+        change = 0.0 if reference == 0.0 else (value - reference) / abs(reference) * 100.0
+        worse = -change if metric.higher_is_better else change
+        flag = ""
+        if worse > metric.tolerance * args.tolerance_scale:
+            flag = "  REGRESSION"
+            regressed = True
+        print(f"{metric.path:<36} {reference:>12.3f} {value:>12.3f} {change:>+8.1f}% "
+              f"{metric.tolerance * args.tolerance_scale:>8.1f}%{flag}")
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--scenario", choices=sorted(SCENARIOS), required=True)
+    parser.add_argument("--bin-dir",
+                        type=str,
+                        required=True,
+                        help="Directory w/ cubemap_converter and cubemap_dataset_generator.")
+    parser.add_argument("--work-dir",
+                        type=str,
+                        required=True,
+                        help="Directory for datasets and reports. Datasets are re-used.")
+    parser.add_argument("--baseline-dir",
+                        type=str,
+                        required=True,
+                        help="Directory of the baselines, one `<scenario>.json` per scenario.")
+    parser.add_argument("--repeat", type=int, default=3, help="Runs per scenario.")
+    parser.add_argument("--tolerance-scale",
+                        type=float,
+                        default=1.0,
+                        help="Multiply every tolerance by this, eg. on noisy shared machines.")
+    parser.add_argument("--update",
+                        action="store_true",
+                        help="Record the measurements as the new baseline instead of comparing.")
+    sys.exit(main(parser.parse_args()))
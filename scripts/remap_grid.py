@@ -0,0 +1,93 @@
+"""Coarse remap tables: the camera ray is stored for every `stride`-th pixel and interpolated in between."""
+import numpy as np
+import typing as T
+
+from utils import create_grid
+
+INTERPOLATION_METHODS = ("bilinear", "bicubic")
+
+
+def grid_dimensions(width: int, height: int, stride: int) -> T.Tuple[int, int]:
+    """Number of grid samples needed to cover an image of the given size (including the last row and column)."""
+    assert stride > 0, f"stride = {stride}"
+    return (width - 1 + stride - 1) // stride + 1, (height - 1 + stride - 1) // stride + 1
+
+
+def create_grid_points(width: int, height: int, stride: int) -> np.ndarray:
+    """Row-major pixel coordinates of the grid samples."""
+    grid_width, grid_height = grid_dimensions(width=width, height=height, stride=stride)
+    return create_grid(width=grid_width, height=grid_height) * stride
+
+
+def _interpolation_taps(
+    num_pixels: int, num_samples: int, stride: int, method: str
+) -> T.Tuple[np.ndarray, np.ndarray]:
+    """Indices (clamped to the grid) and weights of the samples contributing to each pixel along one axis."""
+    p_grid = np.arange(0, num_pixels, dtype=np.float64) / stride
+    p0 = np.floor(p_grid).astype(np.int64)
+    t = (p_grid - p0).reshape([-1, 1])
+    if method == "bilinear":
+        offsets = np.array([0, 1])
+        weights = np.concatenate([1.0 - t, t], axis=-1)
+    elif method == "bicubic":
+        # Catmull-Rom, same as `CatmullRomWeights` in fragment_oversampled_cubemap.glsl
+        offsets = np.array([-1, 0, 1, 2])
+        t2 = t * t
+        t3 = t2 * t
+        weights = np.concatenate(
+            [
+                -0.5 * t3 + t2 - 0.5 * t,
+                1.5 * t3 - 2.5 * t2 + 1.0,
+                -1.5 * t3 + 2.0 * t2 + 0.5 * t,
+                0.5 * t3 - 0.5 * t2,
+            ],
+            axis=-1,
+        )
+    else:
+        raise KeyError(f"Invalid interpolation method: {method}")
+    indices = np.clip(p0.reshape([-1, 1]) + offsets, 0, num_samples - 1)
+    return indices, weights
+
+
+def interpolate_grid(
+    grid: np.ndarray, width: int, height: int, stride: int, method: str
+) -> np.ndarray:
+    """
+    Reconstruct the full resolution (height x width x 3) table from the grid.
+    This must match `LookupRemapTable` in fragment_oversampled_cubemap.glsl.
+    """
+    grid_height, grid_width, _ = grid.shape
+    x_indices, x_weights = _interpolation_taps(width, grid_width, stride, method)
+    y_indices, y_weights = _interpolation_taps(height, grid_height, stride, method)
+
+    # Interpolate along x, then along y:
+    rows = np.einsum("gwkc,wk->gwc", grid[:, x_indices, :], x_weights)
+    return np.einsum("hkwc,hk->hwc", rows[y_indices, :, :], y_weights)
+
+
+def angular_error_degrees(v_approx: np.ndarray, v_true: np.ndarray) -> np.ndarray:
+    """Angle between corresponding rays (last axis), in degrees. Non-finite rays are ignored (error = 0)."""
+    v_approx = v_approx / np.linalg.norm(v_approx, axis=-1, keepdims=True)
+    v_true = v_true / np.linalg.norm(v_true, axis=-1, keepdims=True)
+    # atan2 of |cross| and dot is well conditioned for small angles, unlike arccos.
+    sin_angle = np.linalg.norm(np.cross(v_approx, v_true), axis=-1)
+    cos_angle = np.sum(v_approx * v_true, axis=-1)
+    error = np.degrees(np.arctan2(sin_angle, cos_angle))
+    return np.where(np.isfinite(error), error, 0.0)
+
+
+def validate_grid(
+    grid: np.ndarray, full_table: np.ndarray, stride: int
+) -> T.Dict[str, T.Dict[str, float]]:
+    """Compute max/mean angular error (degrees) of each interpolation method versus the full table."""
+    height, width, _ = full_table.shape
+    result = dict()
+    for method in INTERPOLATION_METHODS:
+        reconstructed = interpolate_grid(
+            grid, width=width, height=height, stride=stride, method=method
+        )
+        error = angular_error_degrees(reconstructed, full_table)
+        result[method] = dict(
+            max_error_deg=float(np.max(error)), mean_error_deg=float(np.mean(error))
+        )
+    return result
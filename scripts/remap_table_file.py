@@ -0,0 +1,142 @@
+"""
+Self-describing remap table files, loaded by the converter with `remap_table::OpenRemapTableFile`.
+The layout is documented in source/remap_table.hpp, and the two must be kept in sync.
+"""
+import struct
+import typing as T
+import zlib
+
+import numpy as np
+
+MAGIC = b"CMRTABLE"
+FORMAT_VERSION = 1
+SECTION_ALIGNMENT = 4096
+
+SECTION_RAYS = 1
+SECTION_VALID_MASK = 2
+SECTION_SAMPLING_PLAN = 3
+
+# Values of `cpu_engine::TableEncoding` and `camera_models::CameraModel`.
+ENCODING_IDS = {"float32": 0, "oct16": 1}
+CAMERA_MODEL_IDS = {"fisheye": 1, "brown-conrady": 2}
+
+# magic, version, header_crc32, width, height, stride, encoding, camera_model, num_sections, intrinsics[9], reserved[5]
+_FILE_HEADER = struct.Struct("<8sII6I9f5I")
+# type, crc32, offset, size, width, height, components, depth
+_SECTION_HEADER = struct.Struct("<IIQQIIII")
+assert _FILE_HEADER.size == 96 and _SECTION_HEADER.size == 40
+
+
+def _align(offset: int) -> int:
+    return (offset + SECTION_ALIGNMENT - 1) // SECTION_ALIGNMENT * SECTION_ALIGNMENT
+
+
+def serialize_remap_table(
+    rays: np.ndarray,
+    width: int,
+    height: int,
+    stride: int,
+    encoding: str,
+    camera_model: T.Optional[str] = None,
+    intrinsics: T.Sequence[float] = (),
+    valid_mask: T.Optional[np.ndarray] = None,
+) -> bytes:
+    """
+    Pack an encoded table of rays (grid_height, grid_width, channels) into a remap table file.
+    `intrinsics` are fx, fy, cx, cy and the distortion coefficients of `camera_model` (stored for reference).
+    `valid_mask` is an optional (height, width) uint8 image, where zero marks pixels that should not be rendered.
+    """
+    assert len(intrinsics) <= 9, f"Too many intrinsics: {intrinsics}"
+    sections = [(SECTION_RAYS, rays)]
+    if valid_mask is not None:
+        assert valid_mask.shape == (height, width), f"Mask shape: {valid_mask.shape}"
+        sections.append((SECTION_VALID_MASK, valid_mask.reshape([height, width, 1])))
+
+    section_headers = []
+    payloads = []
+    offset = _align(_FILE_HEADER.size + _SECTION_HEADER.size * len(sections))
+    for section_type, array in sections:
+        payload = array.tobytes()
+        grid_height, grid_width, components = array.shape
+        section_headers.append(
+            _SECTION_HEADER.pack(
+                section_type,
+                zlib.crc32(payload),
+                offset,
+                len(payload),
+                grid_width,
+                grid_height,
+                components,
+                array.dtype.itemsize,
+            )
+        )
+        payloads.append((offset, payload))
+        offset = _align(offset + len(payload))
+
+    def pack_header(header_crc32: int) -> bytes:
+        return _FILE_HEADER.pack(
+            MAGIC,
+            FORMAT_VERSION,
+            header_crc32,
+            width,
+            height,
+            stride,
+            ENCODING_IDS[encoding],
+            CAMERA_MODEL_IDS.get(camera_model, 0),
+            len(sections),
+            *(list(intrinsics) + [0.0] * (9 - len(intrinsics))),
+            *([0] * 5),
+        )
+
+    section_table = b"".join(section_headers)
+    header = pack_header(zlib.crc32(section_table, zlib.crc32(pack_header(0))))
+
+    output = bytearray(offset)
+    output[: len(header)] = header
+    output[len(header) : len(header) + len(section_table)] = section_table
+    for section_offset, payload in payloads:
+        output[section_offset : section_offset + len(payload)] = payload
+    return bytes(output)
+
+
+def read_remap_table_header(path: str) -> T.Dict[str, T.Any]:
+    """Read the header of a remap table file (for inspection)."""
+    with open(path, "rb") as handle:
+        fields = _FILE_HEADER.unpack(handle.read(_FILE_HEADER.size))
+        if fields[0] != MAGIC:
+            raise ValueError(f"Not a remap table file: {path}")
+        header = dict(
+            zip(
+                (
+                    "version",
+                    "header_crc32",
+                    "width",
+                    "height",
+                    "stride",
+                    "encoding",
+                    "camera_model",
+                    "num_sections",
+                ),
+                fields[1:9],
+            )
+        )
+        header["intrinsics"] = list(fields[9:18])
+        header["sections"] = [
+            dict(
+                zip(
+                    (
+                        "type",
+                        "crc32",
+                        "offset",
+                        "size",
+                        "width",
+                        "height",
+                        "components",
+                        "depth",
+                    ),
+                    _SECTION_HEADER.unpack(handle.read(_SECTION_HEADER.size)),
+                )
+            )
+            for _ in range(header["num_sections"])
+        ]
+    return header
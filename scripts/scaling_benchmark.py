@@ -0,0 +1,236 @@
+"""
+Measure how converter throughput scales w/ its settings, by running the full pipeline on synthetic
+datasets over a grid of settings.
+
+For every combination of engine, cpu threads, writer threads, prefetch depth, face size and output
+resolution, `cubemap_converter` is run w/ `--report`, and one row per run is written to a CSV and a
+JSON table: the settings, frames/s, megapixels/s, the limiting stage, and the mean/p50/p99 of every
+stage. Datasets are generated once per face size w/ `cubemap_dataset_generator`, and re-used.
+
+    python scaling_benchmark.py --bin-dir build --work-dir /tmp/scaling --engines cpu \
+        --cpu-threads 1 2 4 8 --null-output
+
+By default outputs are discarded after encoding (`--null-output`), so disk bandwidth does not hide
+the scaling of the compute. Pass `--write-outputs` to include writing files, and add `--manifest` to
+write them durably and record them in a manifest, as for a run that can be resumed.
+"""
+import argparse
+import csv
+import itertools
+import json
+import os
+import subprocess
+import sys
+import typing as T
+
+from pathlib import Path
+
+# The report version this script understands.
+REPORT_VERSION = 1
+
+# Stage statistics copied into the table.
+STAGE_STATISTICS = ("mean_ms", "p50_ms", "p99_ms")
+
+
+class Settings(T.NamedTuple):
+    engine: str
+    cpu_threads: int
+    writer_threads: int
+    prefetch_depth: int
+    face_size: int
+    width: int
+    height: int
+
+    def name(self) -> str:
+        return (f"{self.engine}_t{self.cpu_threads}_w{self.writer_threads}_p{self.prefetch_depth}_"
+                f"f{self.face_size}_{self.width}x{self.height}")
+
+
+def parse_resolution(value: str) -> T.Tuple[int, int]:
+    width, height = value.lower().split("x")
+    return int(width), int(height)
+
+
+def executable(bin_dir: Path, name: str) -> Path:
+    for candidate in (bin_dir / name, bin_dir / f"{name}.exe"):
+        if candidate.exists():
+            return candidate
+    raise RuntimeError(f"Could not find {name} in: {bin_dir}")
+
+
+def generate_dataset(generator: Path, root: Path, face_size: int, num_frames: int) -> Path:
+    """Write a synthetic dataset w/ `num_frames` frames of one camera, unless it already exists."""
+    path = root / f"dataset_{face_size}_{num_frames}"
+    # The generator writes the ground truth after every face, so an interrupted dataset is generated again:
+    if (path / "ground_truth_imu_pose_00.csv").exists():
+        return path
+    print(f"Generating {num_frames} frames w/ {face_size}x{face_size} faces in: {path}")
+    command = [
+        str(generator), "-o",
+        str(path), "--face-size",
+        str(face_size), "--num-frames",
+        str(num_frames)
+    ]
+    subprocess.run(command, check=True, stdout=subprocess.DEVNULL)
+    return path
+
+
+def run_converter(converter: Path,
+                  dataset: Path,
+                  settings: Settings,
+                  num_frames: int,
+                  work_dir: Path,
+                  write_outputs: bool,
+                  manifest: bool = False,
+                  env: T.Optional[T.Dict[str, str]] = None) -> T.Dict[str, T.Any]:
+    """
+    Run a single configuration, and return its report. `manifest` writes the outputs w/ `--manifest`.
+    `env` is added to the environment.
+    """
+    report_path = work_dir / "reports" / f"{settings.name()}.json"
+    report_path.parent.mkdir(parents=True, exist_ok=True)
+    # An equidistant fisheye w/ no distortion, so no remap table is needed at any resolution:
+    focal_length = settings.width / 4.0
+    command = [
+        str(converter), "-i",
+        str(dataset), "--num-images",
+        str(num_frames), "-c", "0", "--camera-model", "fisheye", "--intrinsics",
+        f"{focal_length},{focal_length},{settings.width / 2.0},{settings.height / 2.0}",
+        "--distortion", "0,0,0,0", "--width",
+        str(settings.width), "--height",
+        str(settings.height), "--engine", settings.engine, "--cpu-threads",
+        str(settings.cpu_threads), "--writer-threads",
+        str(settings.writer_threads), "--prefetch-depth",
+        str(settings.prefetch_depth), "--report",
+        str(report_path)
+    ]
+    if write_outputs:
+        output_dir = work_dir / "outputs" / settings.name()
+        command += ["-o", str(output_dir)]
+        if manifest:
+            # A manifest left by a previous run would skip nothing (no --resume), but would keep growing:
+            manifest_path = output_dir / "manifest" / "camera00.txt"
+            if manifest_path.exists():
+                manifest_path.unlink()
+            command += ["--manifest"]
+    else:
+        command += ["--null-output"]
+    subprocess.run(command,
+                   check=True,
+                   stdout=subprocess.DEVNULL,
+                   env={
+                       **os.environ,
+                       **(env or {})
+                   })
+
+    with open(report_path, "r") as handle:
+        report = json.load(handle)
+    if report.get("format_version") != REPORT_VERSION:
+        raise RuntimeError(f"{report_path} has report version {report.get('format_version')}, "
+                           f"expected {REPORT_VERSION}")
+    return report
+
+
+def make_row(settings: Settings, report: T.Dict[str, T.Any]) -> T.Dict[str, T.Any]:
+    """Flatten the settings and the interesting parts of a report into one row of the table."""
+    row: T.Dict[str, T.Any] = settings._asdict()
+    row["frames_per_second"] = report["throughput"]["frames_per_second"]
+    row["megapixels_per_second"] = report["throughput"]["megapixels_per_second"]
+    row["wall_seconds"] = report["wall_seconds"]
+    row["limiting_stage"] = report["bottleneck"]["limiting_stage"]
+    row["peak_rss_mb"] = report["memory"]["peak_rss_mb"]
+    for stage, stats in sorted(report["stages"].items()):
+        for key in STAGE_STATISTICS:
+            row[f"{stage}.{key}"] = stats[key]
+    return row
+
+
+def write_tables(rows: T.List[T.Dict[str, T.Any]], output: Path) -> None:
+    """Write the rows as `output`.csv and `output`.json. Stages missing from a run are empty."""
+    columns: T.List[str] = []
+    for row in rows:
+        columns.extend(key for key in row if key not in columns)
+    with open(output.with_suffix(".csv"), "w", newline="") as handle:
+        writer = csv.DictWriter(handle, fieldnames=columns)
+        writer.writeheader()
+        writer.writerows(rows)
+    with open(output.with_suffix(".json"), "w") as handle:
+        json.dump(rows, handle, indent=2)
+
+
+def main(args: argparse.Namespace) -> int:
+    bin_dir = Path(args.bin_dir)
+    work_dir = Path(args.work_dir)
+    converter = executable(bin_dir, "cubemap_converter")
+    generator = executable(bin_dir, "cubemap_dataset_generator")
+
+    grid = []
+    for engine, cpu_threads, writer_threads, prefetch_depth, face_size, (width, height) in \
+            itertools.product(args.engines, args.cpu_threads, args.writer_threads,
+                              args.prefetch_depths, args.face_sizes, args.resolutions):
+        # The GL engine does not use the cpu threads, so there is no point sweeping them:
+        if engine == "gl" and cpu_threads != args.cpu_threads[0]:
+            continue
+        grid.append(
+            Settings(engine, cpu_threads, writer_threads, prefetch_depth, face_size, width, height))
+    if args.manifest and not args.write_outputs:
+        raise RuntimeError("--manifest requires --write-outputs.")
+    print(f"Running {len(grid)} configurations of {args.num_frames} frames.")
+
+    rows = []
+    for index, settings in enumerate(grid):
+        dataset = generate_dataset(generator, work_dir / "datasets", settings.face_size,
+                                   args.num_frames)
+        report = run_converter(converter, dataset, settings, args.num_frames, work_dir,
+                               args.write_outputs, args.manifest)
+        rows.append(make_row(settings, report))
+        print(f"[{index + 1}/{len(grid)}] {settings.name()}: "
+              f"{rows[-1]['frames_per_second']:.2f} frames/s, limited by "
+              f"{rows[-1]['limiting_stage'] or 'nothing'}")
+
+    output = Path(args.output) if args.output else work_dir / "scaling"
+    write_tables(rows, output)
+    print(f"Wrote: {output.with_suffix('.csv')} and {output.with_suffix('.json')}")
+    return 0
+
+
+if __name__ == "__main__":
+    parser = argparse.ArgumentParser(description=__doc__,
+                                     formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--bin-dir",
+                        type=str,
+                        required=True,
+                        help="Directory w/ cubemap_converter and cubemap_dataset_generator.")
+    parser.add_argument("--work-dir",
+                        type=str,
+                        required=True,
+                        help="Directory for datasets, reports and outputs. Datasets are re-used.")
+    parser.add_argument("--output",
+                        type=str,
+                        default=None,
+                        help="Path of the tables, w/o extension. Defaults to `<work-dir>/scaling`.")
+    parser.add_argument("--num-frames", type=int, default=50, help="Frames per run.")
+    parser.add_argument("--engines", nargs="+", default=["gl", "cpu"], choices=["gl", "cpu"])
+    parser.add_argument("--cpu-threads", nargs="+", type=int, default=[1, 2, 4, 8])
+    parser.add_argument("--writer-threads", nargs="+", type=int, default=[8])
+    parser.add_argument("--prefetch-depths", nargs="+", type=int, default=[0, 2])
+    parser.add_argument("--face-sizes", nargs="+", type=int, default=[1024])
+    parser.add_argument("--resolutions",
+                        nargs="+",
+                        type=parse_resolution,
+                        default=[(1280, 720)],
+                        help="Output resolutions, as WIDTHxHEIGHT.")
+    outputs = parser.add_mutually_exclusive_group()
+    outputs.add_argument("--null-output",
+                         dest="write_outputs",
+                         action="store_false",
+                         help="Encode the outputs and discard them (the default).")
+    outputs.add_argument("--write-outputs",
+                         dest="write_outputs",
+                         action="store_true",
+                         help="Write the outputs to `<work-dir>/outputs`.")
+    parser.set_defaults(write_outputs=False)
+    parser.add_argument("--manifest",
+                        action="store_true",
+                        help="W/ --write-outputs, write the outputs durably and record them in a manifest.")
+    sys.exit(main(parser.parse_args()))
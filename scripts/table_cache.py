@@ -0,0 +1,142 @@
+"""Persistent, content-addressed cache of remap tables."""
+import hashlib
+import json
+import os
+import shutil
+import tempfile
+import typing as T
+
+from dataclasses import dataclass
+from pathlib import Path
+
+import numpy as np
+
+# Bump this whenever the way tables are generated changes, to invalidate old entries.
+CACHE_FORMAT_VERSION = 3
+
+# The keys of a camera description that determine the contents of its remap table.
+CAMERA_KEY_FIELDS = ("model", "dimensions", "camera_matrix", "distortion_coefficients")
+
+TABLE_FILENAME = "remap_table.cmrt"
+METADATA_FILENAME = "metadata.json"
+
+
+def default_cache_dir() -> Path:
+    """Location of the cache if the user does not specify one."""
+    if "XDG_CACHE_HOME" in os.environ:
+        return Path(os.environ["XDG_CACHE_HOME"]) / "cubemap_converter"
+    return Path.home() / ".cache" / "cubemap_converter"
+
+
+def compute_cache_key(
+    camera: T.Dict[str, T.Any], table_options: T.Dict[str, T.Any]
+) -> str:
+    """Hash the model, parameters and dimensions of a camera (and the table options) into a hex digest."""
+    key_data = {k: camera.get(k) for k in CAMERA_KEY_FIELDS}
+    key_data["table_options"] = table_options
+    key_data["cache_format_version"] = CACHE_FORMAT_VERSION
+    serialized = json.dumps(key_data, sort_keys=True, separators=(",", ":"))
+    return hashlib.sha256(serialized.encode("utf-8")).hexdigest()
+
+
+def compute_mask_bounds(remap_table: np.ndarray) -> T.Optional[T.Dict[str, int]]:
+    """Bounding box (inclusive) of the pixels that have a valid ray, or None if no pixel is valid."""
+    valid = np.all(np.isfinite(remap_table), axis=-1)
+    rows = np.flatnonzero(np.any(valid, axis=1))
+    cols = np.flatnonzero(np.any(valid, axis=0))
+    if not len(rows):
+        return None
+    return dict(
+        x_min=int(cols[0]), y_min=int(rows[0]), x_max=int(cols[-1]), y_max=int(rows[-1])
+    )
+
+
+@dataclass
+class CacheEntry:
+    """A remap table stored in the cache."""
+
+    directory: Path
+    metadata: T.Dict[str, T.Any]
+
+    @property
+    def table_path(self) -> Path:
+        return self.directory / TABLE_FILENAME
+
+    @property
+    def width(self) -> int:
+        return self.metadata["width"]
+
+    @property
+    def height(self) -> int:
+        return self.metadata["height"]
+
+    @property
+    def stride(self) -> int:
+        return self.metadata["stride"]
+
+    @property
+    def encoding(self) -> str:
+        return self.metadata["encoding"]
+
+
+def _load_entry(directory: Path) -> T.Optional[CacheEntry]:
+    try:
+        with open(directory / METADATA_FILENAME, "r") as handle:
+            metadata = json.load(handle)
+    except (OSError, json.JSONDecodeError):
+        return None
+    if metadata.get("cache_format_version") != CACHE_FORMAT_VERSION:
+        return None
+    if not (directory / TABLE_FILENAME).is_file():
+        return None
+    return CacheEntry(directory=directory, metadata=metadata)
+
+
+def get_or_create_table(
+    cache_dir: Path,
+    camera: T.Dict[str, T.Any],
+    table_options: T.Dict[str, T.Any],
+    create_fn: T.Callable[..., T.Tuple[bytes, T.Dict[str, T.Any]]],
+) -> CacheEntry:
+    """
+    Look up the remap table for `camera`, generating it with `create_fn(camera, **table_options)` on a miss.
+    `create_fn` returns the contents of the table file and a dict of metadata to store with it (which must include the
+    output `width`, `height`, `stride` and `encoding`).
+
+    Entries are written to a scratch directory and renamed into place, so concurrent converters sharing a cache
+    never observe a partially written table. Files are made read-only, since the converter maps them directly.
+    """
+    key = compute_cache_key(camera, table_options=table_options)
+    entry_dir = cache_dir / key[:2] / key
+
+    entry = _load_entry(entry_dir)
+    if entry is not None:
+        print(f"Remap table cache hit: {entry_dir}")
+        return entry
+
+    print(f"Remap table cache miss, generating: {entry_dir}")
+    table_file_contents, table_metadata = create_fn(camera, **table_options)
+
+    metadata = {k: camera.get(k) for k in CAMERA_KEY_FIELDS}
+    metadata.update(table_metadata)
+    metadata.update(cache_format_version=CACHE_FORMAT_VERSION, key=key)
+
+    entry_dir.parent.mkdir(parents=True, exist_ok=True)
+    scratch_dir = Path(tempfile.mkdtemp(prefix=f".{key}.", dir=entry_dir.parent))
+    try:
+        with open(scratch_dir / TABLE_FILENAME, "wb") as handle:
+            handle.write(table_file_contents)
+        with open(scratch_dir / METADATA_FILENAME, "w") as handle:
+            json.dump(metadata, handle, indent=2, sort_keys=True)
+        for filename in (TABLE_FILENAME, METADATA_FILENAME):
+            os.chmod(scratch_dir / filename, 0o444)
+        try:
+            os.rename(scratch_dir, entry_dir)
+        except OSError:
+            # Another process populated this entry first - use theirs.
+            if _load_entry(entry_dir) is None:
+                raise
+    finally:
+        shutil.rmtree(scratch_dir, ignore_errors=True)
+
+    return CacheEntry(directory=entry_dir, metadata=metadata)
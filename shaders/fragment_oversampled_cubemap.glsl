@@ -12,6 +12,28 @@ uniform mat3 cubemap_R_camera;
 // The remap table.
 uniform sampler2D remap_table;
 
+// Spacing (in output pixels) of the samples in the remap table. 1 means the table is at full resolution.
+uniform int remap_table_stride;
+
+// How to interpolate a coarse remap table: 0 = bilinear, 1 = bicubic (Catmull-Rom).
+uniform int remap_table_interpolation;
+
+// How rays are stored in the remap table: 0 = float32 xyz, 1 = octahedral coordinates in RG16 (unorm).
+uniform int remap_table_encoding;
+
+// Dimensions of the output image in pixels.
+uniform ivec2 output_dims;
+
+// Where camera rays come from: 0 = remap table, 1 = fisheye model, 2 = brown-conrady model.
+// Must match `camera_models::CameraModel`.
+uniform int camera_model;
+
+// Intrinsics of the parametric camera models, as [fx, fy, cx, cy].
+uniform vec4 camera_matrix;
+
+// Distortion coefficients: [k1, k2, k3, k4] (fisheye) or [k1, k2, p1, p2, k3] (brown-conrady).
+uniform float distortion_coeffs[5];
+
 // The oversampled cubemap represented as a texture array.
 uniform sampler2DArray input_cube;
 
@@ -75,10 +97,135 @@ float InverseRangeFromInverseDepth(in float inv_depth_normalized, in vec3 v_face
   return inv_range_normalized;
 }
 
+// Convert octahedral coordinates in [-1, 1] to a unit vector. Matches `decode_octahedral` in table_encoding.py.
+vec3 DecodeOctahedral(in vec2 p) {
+  vec3 v = vec3(p, 1.0f - abs(p.x) - abs(p.y));
+  if (v.z < 0.0f) {
+    v.xy = (1.0f - abs(p.yx)) * vec2(p.x >= 0.0f ? 1.0f : -1.0f, p.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return normalize(v);
+}
+
+// Decode a texel of the remap table to a ray.
+vec3 DecodeRemapTable(in vec4 texel) {
+  if (remap_table_encoding == 1) {
+    // The texture unit has normalized [0, 65535] -> [0, 1].
+    return DecodeOctahedral(texel.xy * 2.0f - 1.0f);
+  }
+  return texel.xyz;
+}
+
+// Fetch a single entry of the remap table, clamping to the edge of the grid.
+// Coarse tables are interpolated after decoding, since octahedral coordinates are discontinuous across the fold.
+vec3 FetchRemapTable(in ivec2 p, in ivec2 grid_dims) {
+  return DecodeRemapTable(texelFetch(remap_table, clamp(p, ivec2(0, 0), grid_dims - 1), 0));
+}
+
+// Catmull-Rom weights for the four taps around a sample with fractional offset `t`.
+vec4 CatmullRomWeights(in float t) {
+  float t2 = t * t;
+  float t3 = t2 * t;
+  return vec4(-0.5f * t3 + t2 - 0.5f * t, 1.5f * t3 - 2.5f * t2 + 1.0f, -1.5f * t3 + 2.0f * t2 + 0.5f * t,
+              0.5f * t3 - 0.5f * t2);
+}
+
+// Coordinates of this fragment in the output image, w/ the same convention as the rows and columns of the remap table.
+vec2 OutputPixel() {
+  return vec2(gl_FragCoord.x, float(output_dims.y - 1) - gl_FragCoord.y);
+}
+
+// Look up the (un-normalized) camera ray for this fragment in the remap table.
+// A coarse table stores the ray for every `remap_table_stride`-th pixel, and we interpolate in between. We do the
+// interpolation ourselves w/ texelFetch, since the fixed function filtering has very few bits of sub-texel precision.
+// This must match `interpolate_grid` in scripts/remap_grid.py, which validates the error of the coarse table.
+vec3 LookupRemapTable() {
+  if (remap_table_stride == 1) {
+    return DecodeRemapTable(texture(remap_table, TexCoords));
+  }
+  ivec2 grid_dims = textureSize(remap_table, 0);
+  vec2 p_grid = OutputPixel() / float(remap_table_stride);
+  ivec2 p0 = ivec2(floor(p_grid));
+  vec2 t = p_grid - vec2(p0);
+
+  if (remap_table_interpolation == 0) {
+    vec3 v00 = FetchRemapTable(p0, grid_dims);
+    vec3 v10 = FetchRemapTable(p0 + ivec2(1, 0), grid_dims);
+    vec3 v01 = FetchRemapTable(p0 + ivec2(0, 1), grid_dims);
+    vec3 v11 = FetchRemapTable(p0 + ivec2(1, 1), grid_dims);
+    return mix(mix(v00, v10, t.x), mix(v01, v11, t.x), t.y);
+  }
+
+  vec4 wx = CatmullRomWeights(t.x);
+  vec4 wy = CatmullRomWeights(t.y);
+  vec3 result = vec3(0.0f, 0.0f, 0.0f);
+  for (int j = 0; j < 4; ++j) {
+    vec3 row = vec3(0.0f, 0.0f, 0.0f);
+    for (int i = 0; i < 4; ++i) {
+      row += wx[i] * FetchRemapTable(p0 + ivec2(i - 1, j - 1), grid_dims);
+    }
+    result += wy[j] * row;
+  }
+  return result;
+}
+
+// Unproject w/ the Kannala-Brandt fisheye model. Must match `camera_models::UnprojectFisheye`.
+vec3 UnprojectFisheye(in vec2 pixel) {
+  vec2 p_img = (pixel - camera_matrix.zw) / camera_matrix.xy;
+  float r = length(p_img);
+  float phi = r > 0.0f ? atan(p_img.y, p_img.x) : 0.0f;
+
+  // Invert the distortion w/ Newton's method:
+  float theta = r;
+  for (int i = 0; i < 10; ++i) {
+    float theta2 = theta * theta;
+    float r_predicted =
+        theta * (1.0f + theta2 * (distortion_coeffs[0] +
+                                  theta2 * (distortion_coeffs[1] +
+                                            theta2 * (distortion_coeffs[2] + theta2 * distortion_coeffs[3]))));
+    float r_D_theta =
+        1.0f + theta2 * (3.0f * distortion_coeffs[0] +
+                         theta2 * (5.0f * distortion_coeffs[1] +
+                                   theta2 * (7.0f * distortion_coeffs[2] + theta2 * 9.0f * distortion_coeffs[3])));
+    theta -= (r_predicted - r) / r_D_theta;
+  }
+  return vec3(cos(phi) * sin(theta), sin(phi) * sin(theta), cos(theta));
+}
+
+// Unproject w/ the brown-conrady model. Must match `camera_models::UnprojectBrownConrady`.
+vec3 UnprojectBrownConrady(in vec2 pixel) {
+  vec2 p_distorted = (pixel - camera_matrix.zw) / camera_matrix.xy;
+  float k1 = distortion_coeffs[0];
+  float k2 = distortion_coeffs[1];
+  float p1 = distortion_coeffs[2];
+  float p2 = distortion_coeffs[3];
+  float k3 = distortion_coeffs[4];
+
+  // Invert the distortion by fixed-point iteration (same as OpenCV):
+  vec2 p = p_distorted;
+  for (int i = 0; i < 5; ++i) {
+    float r2 = dot(p, p);
+    float inv_radial = 1.0f / (1.0f + ((k3 * r2 + k2) * r2 + k1) * r2);
+    vec2 tangential = vec2(2.0f * p1 * p.x * p.y + p2 * (r2 + 2.0f * p.x * p.x),
+                           p1 * (r2 + 2.0f * p.y * p.y) + 2.0f * p2 * p.x * p.y);
+    p = (p_distorted - tangential) * inv_radial;
+  }
+  return vec3(p, 1.0f);
+}
+
+// Compute the (un-normalized) camera ray for this fragment, either from the table or the camera model.
+vec3 ComputeCameraRay() {
+  if (camera_model == 1) {
+    return UnprojectFisheye(OutputPixel());
+  } else if (camera_model == 2) {
+    return UnprojectBrownConrady(OutputPixel());
+  }
+  return LookupRemapTable();
+}
+
 // TODO: This program might be a bit faster if split it into two shaders for RGB and range.
 void main() {
   // Lookup the unit vector:
-  vec3 v_cam = normalize(texture(remap_table, TexCoords).xyz);
+  vec3 v_cam = normalize(ComputeCameraRay());
   vec3 v_cube = cubemap_R_camera * v_cam;
 
   // Read from the valid mask:
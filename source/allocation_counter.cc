@@ -0,0 +1,30 @@
+// Copyright 2023 Gareth Cross
+#include <atomic>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+
+#include "memory_tracking.hpp"
+
+// Count every allocation made through the global `operator new`. The other forms of new/delete (array, nothrow,
+// sized) are implemented in terms of these by the standard library.
+// This replaces the allocator of the whole program, so it is linked into the converter executable only (not into
+// `cubemap_core`, which other programs embed).
+static std::atomic<uint64_t> g_num_allocations{0};
+
+void* operator new(const std::size_t size) {
+  g_num_allocations.fetch_add(1, std::memory_order_relaxed);
+  if (void* const ptr = std::malloc(size == 0 ? 1 : size)) {
+    return ptr;
+  }
+  throw std::bad_alloc{};
+}
+
+void operator delete(void* const ptr) noexcept { std::free(ptr); }
+
+void operator delete(void* const ptr, std::size_t) noexcept { std::free(ptr); }
+
+[[maybe_unused]] static const bool g_registered = [] {
+  memory_tracking::RegisterAllocationCounter(&g_num_allocations);
+  return true;
+}();
@@ -1,5 +1,8 @@
 // Copyright 2023 Gareth Cross
 #pragma once
+#include <atomic>
+#include <stdexcept>
+#include <string>
 
 #ifdef _MSC_VER
 // Silence some warnings that libfmt can trigger w/ Microsoft compiler.
@@ -12,12 +15,31 @@
 #pragma warning(pop)
 #endif  // _MSC_VER
 
-// Generates an exception w/ a formatted string.
+// Thrown by a failed assertion, if assertions throw (see `SetAssertionsThrow`).
+class AssertionError : public std::runtime_error {
+ public:
+  using std::runtime_error::runtime_error;
+};
+
+// Whether a failed assertion throws `AssertionError`, instead of terminating the process.
+inline std::atomic<bool>& AssertionsThrow() {
+  static std::atomic<bool> assertions_throw{false};
+  return assertions_throw;
+}
+
+// Make failed assertions throw for the rest of the process, so that long-running hosts (the daemon, the Python
+// module) can report a failed job instead of going down w/ it.
+inline void SetAssertionsThrow(const bool assertions_throw) { AssertionsThrow().store(assertions_throw); }
+
+// Prints the failed assertion w/ a formatted string, then terminates or throws.
 template <typename... Ts>
 void RaiseAssert(const char* const condition, const char* const file, const int line,
                  const char* const reason_fmt = nullptr, Ts&&... args) {
   const std::string details = reason_fmt ? fmt::format(reason_fmt, std::forward<Ts>(args)...) : "None";
   fmt::print("Assertion failed: {}\nFile: {}\nLine: {}\nDetails: {}\n", condition, file, line, details);
+  if (AssertionsThrow().load()) {
+    throw AssertionError(fmt::format("{} ({}:{})", details, file, line));
+  }
   std::terminate();
 }
 
@@ -0,0 +1,129 @@
+// Copyright 2023 Gareth Cross
+#include "bottleneck.hpp"
+
+#include <algorithm>
+
+#include <fmt/format.h>
+
+namespace timing {
+
+// Speedups below this are within the noise of the estimate.
+static constexpr double kSignificantSpeedup = 1.05;
+
+// What an operator can do about a limiting stage.
+static std::string_view Advice(const std::string_view stage, const bool uses_gpu) {
+  if (stage == "decode") {
+    return "Loading the input faces limits throughput: use faster disks, or a machine w/ more cores for decoding.";
+  } else if (stage == "encode") {
+    return "Encoding the outputs limits throughput: add writer threads, or write to faster disks.";
+  } else if (stage == "gpu") {
+    return "GPU execution limits throughput: use a coarser or oct16 remap table, a faster GPU, or try --engine cpu.";
+  } else if (stage == "render" && !uses_gpu) {
+    return "Rendering on the CPU limits throughput: increase --cpu-threads, or switch to --engine gl.";
+  } else if (stage == "unpack") {
+    return "Uploading the faces to the GPU limits throughput.";
+  }
+  return "Work on the main loop limits throughput.";
+}
+
+BottleneckReport AnalyzeBottlenecks(const SimpleTimer& timer, const PipelineShape& shape, const double wall_seconds) {
+  using Stages = SimpleTimer::Stages;
+  const auto total = [&timer](const Stages stage) { return timer.GetHistogram(stage).TotalSeconds(); };
+  const auto count = [&timer](const Stages stage) { return timer.GetHistogram(stage).Count(); };
+  const double wall = std::max(wall_seconds, 1.0e-9);
+
+  // Blocking waits are nested inside `Pack` and `Write`. The writer queue is also flushed at the end of the run,
+  // outside of `Write`, hence the clamping.
+  const double load = total(Stages::Load);
+  const double wait_writers = total(Stages::WaitWriters);
+  const double wait_pbo = total(Stages::WaitPbo);
+  const double pack = std::max(total(Stages::Pack) - wait_pbo, 0.0);
+  const double write = std::max(total(Stages::Write) - wait_writers, 0.0);
+  const double main_busy = total(Stages::Unpack) + total(Stages::Render) + pack + write;
+
+  // The run can be no faster than the slowest pool of workers running alongside the main loop:
+  const double decode_bound =
+      total(Stages::Decode) / static_cast<double>(std::max(shape.num_decode_threads, std::size_t{1}));
+  const double encode_bound =
+      total(Stages::Encode) / static_cast<double>(std::max(shape.num_writer_threads, std::size_t{1}));
+  const double gpu_bound = total(Stages::GpuRender) + total(Stages::GpuReadback);
+
+  BottleneckReport report{};
+  report.wall_seconds = wall_seconds;
+
+  const auto add_worker = [&](const std::string_view name, const std::size_t num_workers, const double busy) {
+    const double utilization = busy / (wall * static_cast<double>(std::max(num_workers, std::size_t{1})));
+    report.workers.push_back(WorkerUtilization{name, num_workers, busy, std::min(utilization, 1.0)});
+  };
+  add_worker("main", 1, main_busy);
+  add_worker("decoders", shape.num_decode_threads, total(Stages::Decode));
+  add_worker("writers", shape.num_writer_threads, total(Stages::Encode));
+  if (shape.uses_gpu) {
+    add_worker("gpu", 1, gpu_bound);
+  }
+  if (shape.uses_hybrid_cpu) {
+    add_worker("cpu engine", 1, total(Stages::CpuRender));
+  }
+
+  // The main loop waits for all faces of a frame to be decoded, so the whole of `Load` is time blocked on decoding.
+  const auto add_queue = [&](const std::string_view name, const Stages stage) {
+    report.queues.push_back(QueueBlocking{name, count(stage), total(stage), total(stage) / wall});
+  };
+  add_queue("decode", Stages::Load);
+  add_queue("writer queue", Stages::WaitWriters);
+  if (shape.uses_gpu) {
+    add_queue("pbo queue", Stages::WaitPbo);
+  }
+
+  // Predict the wall time w/o the cost of each stage on the main loop, and w/o the bound it imposes (if any):
+  const auto add_stage = [&](const std::string_view name, const Stages stage, const double main_loop_seconds,
+                             const bool frees_decode, const bool frees_encode, const bool frees_gpu) {
+    if (count(stage) == 0) {
+      return;
+    }
+    const double predicted = std::max({wall - main_loop_seconds, frees_decode ? 0.0 : decode_bound,
+                                       frees_encode ? 0.0 : encode_bound, frees_gpu ? 0.0 : gpu_bound, 1.0e-9});
+    report.stages.push_back(StageEstimate{name, main_loop_seconds, wall / std::min(predicted, wall)});
+  };
+  add_stage("decode", Stages::Load, load, true, false, false);
+  add_stage("unpack", Stages::Unpack, total(Stages::Unpack), false, false, false);
+  add_stage("render", Stages::Render, total(Stages::Render), false, false, false);
+  add_stage("pack", Stages::Pack, pack, false, false, false);
+  add_stage("write", Stages::Write, write, false, false, false);
+  add_stage("encode", Stages::Encode, wait_writers, false, true, false);
+  if (shape.uses_gpu) {
+    add_stage("gpu", Stages::GpuRender, wait_pbo, false, false, true);
+  }
+  std::stable_sort(report.stages.begin(), report.stages.end(),
+                   [](const StageEstimate& a, const StageEstimate& b) { return a.speedup > b.speedup; });
+
+  if (report.stages.empty() || report.stages.front().speedup < kSignificantSpeedup) {
+    report.verdict = "No single stage limits throughput.";
+  } else {
+    const StageEstimate& limiting = report.stages.front();
+    report.verdict = fmt::format("Limiting stage: {} (~{:.2f}x faster if it were free). {}", limiting.name,
+                                 limiting.speedup, Advice(limiting.name, shape.uses_gpu));
+  }
+  return report;
+}
+
+void PrintBottleneckReport(const BottleneckReport& report) {
+  fmt::print("Wall time: {:.3f} s\n", report.wall_seconds);
+  fmt::print("{:<12} {:>8} {:>10} {:>12}\n", "workers", "count", "busy [s]", "utilization");
+  for (const WorkerUtilization& worker : report.workers) {
+    fmt::print("{:<12} {:>8} {:>10.3f} {:>11.1f}%\n", worker.name, worker.num_workers, worker.busy_seconds,
+               worker.utilization * 100.0);
+  }
+  fmt::print("{:<12} {:>8} {:>10} {:>12}\n", "blocked on", "count", "total [s]", "of wall");
+  for (const QueueBlocking& queue : report.queues) {
+    fmt::print("{:<12} {:>8} {:>10.3f} {:>11.1f}%\n", queue.name, queue.count, queue.blocked_seconds,
+               queue.fraction * 100.0);
+  }
+  fmt::print("{:<12} {:>8} {:>10} {:>12}\n", "if free", "", "cost [s]", "speedup");
+  for (const StageEstimate& stage : report.stages) {
+    fmt::print("{:<12} {:>8} {:>10.3f} {:>11.2f}x\n", stage.name, "", stage.main_loop_seconds, stage.speedup);
+  }
+  fmt::print("{}\n", report.verdict);
+}
+
+}  // namespace timing
@@ -0,0 +1,70 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "timing.hpp"
+
+namespace timing {
+
+// How many workers of each kind the measured pipeline ran.
+struct PipelineShape {
+  std::size_t num_decode_threads{1};
+  std::size_t num_writer_threads{1};
+  // True for the OpenGL engine, which renders and reads back on the GPU.
+  bool uses_gpu{false};
+  // True if the CPU engine converts frames on its own thread, alongside the OpenGL engine (`--engine hybrid`).
+  bool uses_hybrid_cpu{false};
+};
+
+// Fraction of the run a class of workers spent busy.
+struct WorkerUtilization {
+  std::string_view name;
+  std::size_t num_workers;
+  double busy_seconds;
+  // busy / (wall * workers), in [0, 1].
+  double utilization;
+};
+
+// Time the main loop spent blocked waiting on a queue.
+struct QueueBlocking {
+  std::string_view name;
+  uint64_t count;
+  double blocked_seconds;
+  // Fraction of the wall time.
+  double fraction;
+};
+
+// Estimated effect of making one stage free.
+struct StageEstimate {
+  std::string_view name;
+  // Time the stage costs the main loop, directly or by blocking it.
+  double main_loop_seconds;
+  // Expected wall time if the stage took no time, over the actual wall time.
+  double speedup;
+};
+
+// Result of `AnalyzeBottlenecks`.
+struct BottleneckReport {
+  double wall_seconds{0.0};
+  std::vector<WorkerUtilization> workers{};
+  std::vector<QueueBlocking> queues{};
+  // Sorted by descending speedup, so the first entry is the limiting stage.
+  std::vector<StageEstimate> stages{};
+  std::string verdict{};
+};
+
+// Work out which stage limits the throughput of a run that took `wall_seconds`, from the stage times in `timer`.
+//
+// The main loop is serial: it waits for the faces to be decoded, uploads and renders them, and hands the previous
+// frame to the writers. Decoding is on its critical path, while encoding and the GPU only cost it time when it blocks
+// on the writer queue or on a PBO. Making a stage free removes its cost from the main loop, but the run can never be
+// faster than the remaining workers allow (eg. the total encode time divided by the number of writers).
+BottleneckReport AnalyzeBottlenecks(const SimpleTimer& timer, const PipelineShape& shape, double wall_seconds);
+
+// Print the utilization, blocking and per-stage estimates, followed by the verdict.
+void PrintBottleneckReport(const BottleneckReport& report);
+
+}  // namespace timing
@@ -0,0 +1,101 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <array>
+#include <cmath>
+#include <string_view>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4201)  //  nameless struct/union
+#endif
+#include <glm/glm.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include "assertions.hpp"
+
+// Parametric camera models, used to compute camera rays directly instead of reading them from a remap table.
+// These must match the implementations in `fragment_oversampled_cubemap.glsl`, and the table generation in
+// `scripts/convert_data.py`.
+namespace camera_models {
+
+// Supported camera models. The values are passed to the shader as `camera_model`.
+enum class CameraModel : int {
+  // Kannala-Brandt fisheye, coefficients are [k1, k2, k3, k4].
+  Fisheye = 1,
+  // OpenCV/Brown-Conrady, coefficients are [k1, k2, p1, p2, k3].
+  BrownConrady = 2,
+};
+
+// Number of iterations used to invert the distortion. The fisheye model matches `unproject_fisheye`, and the
+// brown-conrady model matches the default criteria of `cv2.undistortPoints`.
+constexpr int kFisheyeNewtonIterations = 10;
+constexpr int kBrownConradyIterations = 5;
+
+// Intrinsics of a parametric camera.
+struct CameraIntrinsics {
+  CameraModel model{CameraModel::Fisheye};
+  float fx{0.0f};
+  float fy{0.0f};
+  float cx{0.0f};
+  float cy{0.0f};
+  std::array<float, 5> coeffs{};
+};
+
+// Parse the name of a camera model (same names as the TOML configs). Asserts on an invalid name.
+inline CameraModel ParseCameraModel(const std::string_view name) {
+  if (name == "fisheye") {
+    return CameraModel::Fisheye;
+  }
+  ASSERT(name == "brown-conrady", "Invalid camera model: {}", name);
+  return CameraModel::BrownConrady;
+}
+
+// Compute the unit ray for a pixel in the fisheye model, inverting the distortion w/ Newton's method.
+inline glm::vec3 UnprojectFisheye(const CameraIntrinsics& intrinsics, const glm::vec2 pixel) {
+  const glm::vec2 p_img{(pixel.x - intrinsics.cx) / intrinsics.fx, (pixel.y - intrinsics.cy) / intrinsics.fy};
+  const float r = glm::length(p_img);
+  const float phi = r > 0.0f ? std::atan2(p_img.y, p_img.x) : 0.0f;
+  const auto& k = intrinsics.coeffs;
+
+  float theta = r;
+  for (int i = 0; i < kFisheyeNewtonIterations; ++i) {
+    const float theta2 = theta * theta;
+    const float r_predicted = theta * (1.0f + theta2 * (k[0] + theta2 * (k[1] + theta2 * (k[2] + theta2 * k[3]))));
+    const float r_D_theta =
+        1.0f + theta2 * (3.0f * k[0] + theta2 * (5.0f * k[1] + theta2 * (7.0f * k[2] + theta2 * 9.0f * k[3])));
+    theta -= (r_predicted - r) / r_D_theta;
+  }
+  return glm::vec3{std::cos(phi) * std::sin(theta), std::sin(phi) * std::sin(theta), std::cos(theta)};
+}
+
+// Compute the unit ray for a pixel in the brown-conrady model, inverting the distortion by fixed point iteration.
+inline glm::vec3 UnprojectBrownConrady(const CameraIntrinsics& intrinsics, const glm::vec2 pixel) {
+  const glm::vec2 p_distorted{(pixel.x - intrinsics.cx) / intrinsics.fx, (pixel.y - intrinsics.cy) / intrinsics.fy};
+  const float k1 = intrinsics.coeffs[0];
+  const float k2 = intrinsics.coeffs[1];
+  const float p1 = intrinsics.coeffs[2];
+  const float p2 = intrinsics.coeffs[3];
+  const float k3 = intrinsics.coeffs[4];
+
+  glm::vec2 p = p_distorted;
+  for (int i = 0; i < kBrownConradyIterations; ++i) {
+    const float r2 = p.x * p.x + p.y * p.y;
+    const float inv_radial = 1.0f / (1.0f + ((k3 * r2 + k2) * r2 + k1) * r2);
+    const glm::vec2 tangential{2.0f * p1 * p.x * p.y + p2 * (r2 + 2.0f * p.x * p.x),
+                               p1 * (r2 + 2.0f * p.y * p.y) + 2.0f * p2 * p.x * p.y};
+    p = (p_distorted - tangential) * inv_radial;
+  }
+  return glm::normalize(glm::vec3{p.x, p.y, 1.0f});
+}
+
+// Compute the unit ray for a pixel.
+inline glm::vec3 Unproject(const CameraIntrinsics& intrinsics, const glm::vec2 pixel) {
+  if (intrinsics.model == CameraModel::Fisheye) {
+    return UnprojectFisheye(intrinsics, pixel);
+  }
+  return UnprojectBrownConrady(intrinsics, pixel);
+}
+
+}  // namespace camera_models
@@ -0,0 +1,172 @@
+// Copyright 2023 Gareth Cross
+#include "converter.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4201)  //  nameless struct/union
+#endif
+#include <glm/gtc/quaternion.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include "assertions.hpp"
+
+namespace converter {
+
+cpu_engine::RenderParams GetRenderParams() {
+  cpu_engine::RenderParams params{};
+  // The rotation from a DirectX camera to an unreal camera: (UE cam has +x forward, per their pawn convention).
+  constexpr glm::fquat unreal_cam_R_directx_cam = glm::fquat{0.5f, 0.5f, 0.5f, 0.5f};
+  params.cubemap_R_camera = glm::mat3_cast(unreal_cam_R_directx_cam);
+  // The size of the oversampled cubemaps, in radians:
+  // TODO: Would be nice if these were read it from the dataset, instead of being hardcoded.
+  params.oversampled_fov = static_cast<float>(95.0 * M_PI / 180.0);
+  params.ue_clip_plane_meters = 0.1f;
+  return params;
+}
+
+images::SimpleImage LoadValidMask(const std::filesystem::path& mask_path, const int width, const int height) {
+  if (mask_path.empty()) {
+    // No mask, just put a white image in (valid everywhere).
+    images::SimpleImage white_image{width, height, 1, images::ImageDepth::Bits8};
+    std::fill(white_image.data.begin(), white_image.data.end(), 255);
+    return white_image;
+  }
+  images::SimpleImage mask_image = images::LoadPng(mask_path, images::ImageDepth::Bits8);
+  ASSERT(!mask_image.IsEmpty(), "Could not load valid mask from: {}", mask_path.u8string());
+  ASSERT(mask_image.width == width && mask_image.height == height,
+         "Remap table and valid mask do not share the same dimensions. mask = [{}, {}], table = [{}, {}]",
+         mask_image.width, mask_image.height, width, height);
+  return mask_image;
+}
+
+remap_table::RemapTableFile MapRemapTable(const CameraTables& tables) {
+  if (remap_table::IsRemapTableFile(tables.table_path)) {
+    remap_table::RemapTableFile table = remap_table::OpenRemapTableFile(tables.table_path, tables.verify_table);
+    ASSERT((tables.width == 0 || tables.width == table.Width()) &&
+               (tables.height == 0 || tables.height == table.Height()),
+           "Dimensions [{}, {}] do not match the remap table: [{}, {}]", tables.width, tables.height, table.Width(),
+           table.Height());
+    return table;
+  }
+  return remap_table::MapRawRemapTable(tables.table_path, tables.width, tables.height, tables.table_stride,
+                                       tables.table_encoding);
+}
+
+cpu_engine::RemapTableRays GetRemapTableRays(const CameraTables& tables, const remap_table::RemapTableFile& table) {
+  return cpu_engine::RemapTableRays{table.rays, table.Stride(), tables.table_interpolation, table.Encoding()};
+}
+
+images::ImageView SelectValidMask(const CameraTables& tables, const std::optional<remap_table::RemapTableFile>& table,
+                                  images::SimpleImage& storage) {
+  if (tables.valid_mask_path.empty() && table && table->valid_mask) {
+    return *table->valid_mask;
+  }
+  storage = table ? LoadValidMask(tables.valid_mask_path, table->Width(), table->Height())
+                  : LoadValidMask(tables.valid_mask_path, tables.width, tables.height);
+  return storage.View();
+}
+
+cpu_engine::CpuEngine CreateCpuEngine(const CameraTables& tables, const std::size_t num_threads) {
+  std::optional<remap_table::RemapTableFile> table{};
+  if (!tables.table_path.empty()) {
+    table.emplace(MapRemapTable(tables));
+  }
+  const int width = table ? table->Width() : tables.width;
+  const int height = table ? table->Height() : tables.height;
+  ASSERT(width > 0 && height > 0, "Dimensions must be positive: w={}, h={}", width, height);
+  images::SimpleImage mask_storage{};
+  const images::ImageView valid_mask = SelectValidMask(tables, table, mask_storage);
+  if (!table) {
+    return cpu_engine::CpuEngine{tables.camera_model, valid_mask, width, height, GetRenderParams(), num_threads};
+  }
+  return cpu_engine::CpuEngine{GetRemapTableRays(tables, *table), valid_mask, width, height, GetRenderParams(),
+                               num_threads};
+}
+
+Converter::Converter(const CameraTables& tables, const ConverterOptions& options)
+    : engine_(CreateCpuEngine(tables, options.num_threads)), max_queued_(std::max<std::size_t>(options.max_queued, 1)) {
+  worker_ = std::thread{[this] { Work(); }};
+}
+
+Converter::~Converter() {
+  {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    stopping_ = true;
+  }
+  changed_.notify_all();
+  worker_.join();
+}
+
+Output Converter::Convert(const std::size_t index, const std::vector<images::SimpleImage>& faces) const {
+  ASSERT(faces.size() == 12, "Expected 12 cubemap faces, got: {}", faces.size());
+  Output output{index, {}, {}};
+  engine_.Render(faces, output.rgb, output.inv_range);
+  return output;
+}
+
+void Converter::Submit(const std::size_t index, std::vector<images::SimpleImage> faces, OutputCallback on_output) {
+  ASSERT(faces.size() == 12, "Expected 12 cubemap faces, got: {}", faces.size());
+  std::unique_lock<std::mutex> lock{mutex_};
+  changed_.wait(lock, [this] { return queue_.size() < max_queued_; });
+  RethrowError();
+  queue_.push_back(Job{index, std::move(faces), std::move(on_output)});
+  lock.unlock();
+  changed_.notify_all();
+}
+
+void Converter::Flush() {
+  std::unique_lock<std::mutex> lock{mutex_};
+  changed_.wait(lock, [this] { return queue_.empty() && !busy_; });
+  RethrowError();
+}
+
+void Converter::RethrowError() {
+  if (error_) {
+    std::rethrow_exception(std::exchange(error_, nullptr));
+  }
+}
+
+void Converter::Work() {
+  for (;;) {
+    std::unique_lock<std::mutex> lock{mutex_};
+    // Submitted frames are converted before stopping:
+    changed_.wait(lock, [this] { return !queue_.empty() || stopping_; });
+    if (queue_.empty()) {
+      return;
+    }
+    Job job = std::move(queue_.front());
+    queue_.pop_front();
+    busy_ = true;
+    lock.unlock();
+    changed_.notify_all();
+
+    std::exception_ptr error{};
+    try {
+      Output output = Convert(job.index, job.faces);
+      job.faces.clear();
+      if (job.on_output) {
+        job.on_output(std::move(output));
+      }
+    } catch (...) {
+      // Thrown out of the thread it would terminate the host process, so pass it to the caller instead:
+      error = std::current_exception();
+    }
+
+    lock.lock();
+    if (error) {
+      error_ = error;
+      queue_.clear();
+    }
+    busy_ = false;
+    lock.unlock();
+    changed_.notify_all();
+  }
+}
+
+}  // namespace converter
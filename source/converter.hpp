@@ -0,0 +1,139 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <filesystem>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+#include "camera_models.hpp"
+#include "cpu_engine.hpp"
+#include "images.hpp"
+#include "remap_table.hpp"
+
+// In-process conversion, for programs that link `cubemap_core` instead of running `cubemap_converter`.
+namespace converter {
+
+// Where the camera rays come from. Mirrors the camera options of `cubemap_converter`.
+struct CameraTables {
+  // Remap table, w/ or w/o a header. If empty, rays are computed from `camera_model` instead.
+  std::filesystem::path table_path{};
+  // Dimensions of the native image. Tables w/ a header store their own.
+  int width{0};
+  int height{0};
+  // How a raw table (w/o a header) is stored.
+  int table_stride{1};
+  cpu_engine::TableEncoding table_encoding{cpu_engine::TableEncoding::Float32};
+  cpu_engine::TableInterpolation table_interpolation{cpu_engine::TableInterpolation::Bicubic};
+  // Used when there is no remap table.
+  camera_models::CameraIntrinsics camera_model{};
+  // Optional valid mask (png). Takes precedence over a mask embedded in the remap table.
+  std::filesystem::path valid_mask_path{};
+  // Check the section checksums of a remap table w/ a header, not just the header checksum.
+  bool verify_table{false};
+};
+
+// Parameters of the conversion that are the same for both engines.
+cpu_engine::RenderParams GetRenderParams();
+
+// Load the valid mask, or create one that is valid everywhere if `mask_path` is empty.
+images::SimpleImage LoadValidMask(const std::filesystem::path& mask_path, int width, int height);
+
+// Memory map the remap table. Tables w/ a header describe themselves, raw tables are described by `tables`.
+remap_table::RemapTableFile MapRemapTable(const CameraTables& tables);
+
+// Describe how the rays should be read from the table.
+cpu_engine::RemapTableRays GetRemapTableRays(const CameraTables& tables, const remap_table::RemapTableFile& table);
+
+// Select the valid mask: `valid_mask_path` takes precedence over a mask embedded in the remap table. Otherwise the
+// mask is loaded (or created) into `storage`.
+images::ImageView SelectValidMask(const CameraTables& tables, const std::optional<remap_table::RemapTableFile>& table,
+                                  images::SimpleImage& storage);
+
+// Compute the camera rays, from either the table or the camera model. The table is only needed during construction.
+cpu_engine::CpuEngine CreateCpuEngine(const CameraTables& tables, std::size_t num_threads);
+
+// The native images of a frame. Rows are bottom-up, as read back from a framebuffer (see `cpu_engine::CpuEngine`).
+struct Output {
+  std::size_t index;
+  // 8-bit RGB.
+  images::SimpleImage rgb;
+  // 16-bit inverse range.
+  images::SimpleImage inv_range;
+};
+
+using OutputCallback = std::function<void(Output)>;
+
+struct ConverterOptions {
+  // Threads the rows of each frame are split between.
+  std::size_t num_threads{std::max(std::thread::hardware_concurrency(), 1u)};
+  // Max number of submitted frames waiting to be converted, before `Submit` blocks.
+  std::size_t max_queued{2};
+};
+
+// Converts frames on the CPU, w/o a window or any files. Frames can be converted on the calling thread w/ `Convert`,
+// or submitted to a worker thread w/ `Submit`, so that rendering overlaps w/ producing the next frame and consuming
+// the last one.
+class Converter {
+ public:
+  // Load the camera tables. Asserts if they are invalid.
+  explicit Converter(const CameraTables& tables, const ConverterOptions& options = {});
+
+  // Waits for the submitted frames.
+  ~Converter();
+
+  // Non-copyable.
+  Converter(const Converter&) = delete;
+  Converter& operator=(const Converter&) = delete;
+
+  // Convert frame `index` on the calling thread. `faces` are the 12 cubemap faces (6 RGB, then 6 inverse depth), as
+  // returned by `images::LoadCubemapImages`. May be called from several threads at once.
+  [[nodiscard]] Output Convert(std::size_t index, const std::vector<images::SimpleImage>& faces) const;
+
+  // Queue frame `index` for conversion on the worker thread. `on_output` is called on the worker thread, in the order
+  // frames were submitted. Blocks while `max_queued` frames are waiting.
+  // If converting a frame (or its callback) throws on the worker thread, the frames queued behind it are dropped, and
+  // the exception is rethrown by the next call to `Submit` (instead of queuing the frame) or `Flush`.
+  void Submit(std::size_t index, std::vector<images::SimpleImage> faces, OutputCallback on_output);
+
+  // Wait until every submitted frame was converted, and its callback returned. Rethrows a failure of the worker thread
+  // (see `Submit`).
+  void Flush();
+
+  // Dimensions of the native images.
+  [[nodiscard]] int Width() const { return engine_.Width(); }
+  [[nodiscard]] int Height() const { return engine_.Height(); }
+
+ private:
+  struct Job {
+    std::size_t index;
+    std::vector<images::SimpleImage> faces;
+    OutputCallback on_output;
+  };
+
+  // Body of the worker thread.
+  void Work();
+
+  // Rethrow (and clear) the failure of the worker thread, if any. Requires `mutex_` to be held.
+  void RethrowError();
+
+  cpu_engine::CpuEngine engine_;
+  std::size_t max_queued_;
+
+  std::mutex mutex_{};
+  std::condition_variable changed_{};
+  std::deque<Job> queue_{};
+  // True while the worker is converting a frame it took from the queue.
+  bool busy_{false};
+  bool stopping_{false};
+  // A failure of the worker thread, rethrown by the next `Submit` or `Flush`.
+  std::exception_ptr error_{};
+  std::thread worker_{};
+};
+
+}  // namespace converter
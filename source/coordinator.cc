@@ -0,0 +1,291 @@
+// Copyright 2023 Gareth Cross
+#include "coordinator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+#ifndef _WIN32
+#include <poll.h>
+#include <sys/socket.h>
+#include <cerrno>
+#endif
+
+#include <fmt/format.h>
+
+#include "assertions.hpp"
+#include "unix_socket.hpp"
+
+namespace coordinator {
+
+WorkQueue::WorkQueue(std::vector<std::size_t> frames, const std::size_t chunk_size, const std::size_t max_attempts,
+                     const std::chrono::milliseconds lease_timeout)
+    : frames_(std::move(frames)),
+      attempts_(frames_.size(), 0),
+      max_attempts_(std::max(max_attempts, std::size_t{1})),
+      lease_timeout_(lease_timeout) {
+  ASSERT(chunk_size > 0, "Chunk size must be positive");
+  for (std::size_t begin = 0; begin < frames_.size(); begin += chunk_size) {
+    queue_.push_back(Range{begin, std::min(begin + chunk_size, frames_.size())});
+  }
+}
+
+void WorkQueue::AddWorker(const int worker) { workers_.emplace(worker, Worker{}); }
+
+std::optional<std::size_t> WorkQueue::Next(const int worker_id, const Clock::time_point now) {
+  const auto it = workers_.find(worker_id);
+  ASSERT(it != workers_.end(), "Unknown worker: {}", worker_id);
+  Worker& worker = it->second;
+  if (worker.range.Size() == 0) {
+    if (!Refill(worker)) {
+      return std::nullopt;
+    }
+    worker.lease_renewed = now;
+  }
+  const std::size_t position = worker.range.begin++;
+  worker.in_flight.emplace(frames_[position], position);
+  return frames_[position];
+}
+
+bool WorkQueue::Refill(Worker& worker) {
+  if (!queue_.empty()) {
+    worker.range = queue_.front();
+    queue_.pop_front();
+    return true;
+  }
+  // Steal the back half of the largest range held by another worker:
+  Worker* victim = nullptr;
+  for (auto& [id, other] : workers_) {
+    if (&other != &worker && other.range.Size() >= 2 && (!victim || other.range.Size() > victim->range.Size())) {
+      victim = &other;
+    }
+  }
+  if (victim == nullptr) {
+    return false;
+  }
+  const std::size_t middle = victim->range.begin + victim->range.Size() / 2;
+  worker.range = Range{middle, victim->range.end};
+  victim->range.end = middle;
+  ++num_steals_;
+  return true;
+}
+
+bool WorkQueue::Finished(const int worker_id, const std::size_t index, const Clock::time_point now) {
+  const auto worker = workers_.find(worker_id);
+  if (worker == workers_.end()) {
+    return false;
+  }
+  const auto frame = worker->second.in_flight.find(index);
+  if (frame == worker->second.in_flight.end()) {
+    return false;
+  }
+  worker->second.in_flight.erase(frame);
+  worker->second.lease_renewed = now;
+  ++num_finished_;
+  return true;
+}
+
+void WorkQueue::RemoveWorker(const int worker_id) {
+  const auto it = workers_.find(worker_id);
+  if (it == workers_.end()) {
+    return;
+  }
+  const Worker& worker = it->second;
+  if (worker.range.Size() > 0) {
+    queue_.push_front(worker.range);
+  }
+  // Frames that were being converted count as a failed attempt:
+  for (const auto& [index, position] : worker.in_flight) {
+    if (++attempts_[position] >= max_attempts_) {
+      failed_.push_back(index);
+    } else {
+      queue_.push_front(Range{position, position + 1});
+      ++num_requeued_;
+    }
+  }
+  workers_.erase(it);
+}
+
+std::vector<int> WorkQueue::ExpiredWorkers(const Clock::time_point now) const {
+  std::vector<int> expired{};
+  for (const auto& [id, worker] : workers_) {
+    const bool holds_frames = worker.range.Size() > 0 || !worker.in_flight.empty();
+    if (holds_frames && now - worker.lease_renewed > lease_timeout_) {
+      expired.push_back(id);
+    }
+  }
+  return expired;
+}
+
+#ifndef _WIN32
+// A connected worker.
+struct Connection {
+  std::string received{};
+  std::size_t num_finished{0};
+};
+
+// Respond to one message from worker `fd`. Returns false if the worker should be disconnected.
+static bool HandleMessage(const int fd, const std::string& message, WorkQueue& queue, Connection& connection) {
+  if (message == "NEXT") {
+    if (const std::optional<std::size_t> index = queue.Next(fd); index.has_value()) {
+      return unix_socket::SendLine(fd, fmt::format("FRAME {}", *index));
+    }
+    return unix_socket::SendLine(fd, queue.IsComplete() ? "END" : "WAIT");
+  } else if (message.rfind("DONE ", 0) == 0) {
+    std::size_t index = 0;
+    try {
+      index = std::stoul(message.substr(5));
+    } catch (const std::logic_error&) {
+      fmt::print("Worker {} sent an invalid message: {}\n", fd, message);
+      return false;
+    }
+    if (queue.Finished(fd, index)) {
+      ++connection.num_finished;
+    } else {
+      fmt::print("Worker {} finished frame {}, which it was not assigned.\n", fd, index);
+    }
+    return true;
+  }
+  fmt::print("Worker {} sent an invalid message: {}\n", fd, message);
+  return false;
+}
+
+std::size_t RunCoordinator(const std::filesystem::path& socket_path, const std::vector<std::size_t>& frames,
+                           const std::size_t chunk_size, const std::size_t max_attempts,
+                           const std::chrono::milliseconds lease_timeout) {
+  WorkQueue queue{frames, chunk_size, max_attempts, lease_timeout};
+
+  const int listener = unix_socket::Listen(socket_path);
+  fmt::print("Serving {} frames in ranges of {} on: {}\n", queue.NumFrames(), chunk_size, socket_path.u8string());
+
+  std::map<int, Connection> connections{};
+  const auto disconnect = [&](const int fd) {
+    queue.RemoveWorker(fd);
+    fmt::print("Worker {} disconnected after finishing {} frames.\n", fd, connections[fd].num_finished);
+    unix_socket::Close(fd);
+    connections.erase(fd);
+  };
+
+  // Keep going until every worker was told to stop, so none of them are left waiting for an answer:
+  auto last_progress = std::chrono::steady_clock::now();
+  while (!queue.IsComplete() || !connections.empty()) {
+    std::vector<pollfd> fds{pollfd{listener, POLLIN, 0}};
+    for (const auto& [fd, connection] : connections) {
+      fds.push_back(pollfd{fd, POLLIN, 0});
+    }
+    const int num_ready = ::poll(fds.data(), static_cast<nfds_t>(fds.size()), 1000);
+    if (num_ready < 0 && errno == EINTR) {
+      continue;
+    }
+    ASSERT(num_ready >= 0, "poll() failed: {}", std::strerror(errno));
+
+    if (fds[0].revents & POLLIN) {
+      const int fd = unix_socket::Accept(listener);
+      if (fd >= 0) {
+        connections.emplace(fd, Connection{});
+        queue.AddWorker(fd);
+      }
+    }
+    for (std::size_t i = 1; i < fds.size(); ++i) {
+      if (fds[i].revents == 0) {
+        continue;
+      }
+      const int fd = fds[i].fd;
+      Connection& connection = connections[fd];
+      char buffer[4096];
+      const ssize_t num_received = ::recv(fd, buffer, sizeof(buffer), 0);
+      if (num_received < 0 && errno == EINTR) {
+        continue;
+      }
+      bool keep = num_received > 0;
+      if (keep) {
+        connection.received.append(buffer, static_cast<std::size_t>(num_received));
+        while (const std::optional<std::string> message = unix_socket::PopLine(connection.received)) {
+          if (!HandleMessage(fd, *message, queue, connection)) {
+            keep = false;
+            break;
+          }
+        }
+      }
+      if (!keep) {
+        disconnect(fd);
+      }
+    }
+
+    // A hung worker would hold on to its frames forever:
+    for (const int fd : queue.ExpiredWorkers()) {
+      fmt::print("Worker {} finished no frame for {} s, taking back its frames.\n", fd,
+                 std::chrono::duration_cast<std::chrono::seconds>(lease_timeout).count());
+      disconnect(fd);
+    }
+
+    const auto now = std::chrono::steady_clock::now();
+    if (now - last_progress > std::chrono::seconds(5)) {
+      fmt::print("{}/{} frames finished, {} workers, {} steals, {} re-queued, {} failed.\n", queue.NumFinished(),
+                 queue.NumFrames(), connections.size(), queue.NumSteals(), queue.NumRequeued(), queue.Failed().size());
+      last_progress = now;
+    }
+  }
+  unix_socket::Close(listener);
+  std::error_code err{};
+  std::filesystem::remove(socket_path, err);
+
+  fmt::print("Finished {}/{} frames. Steals: {}, re-queued frames: {}.\n", queue.NumFinished(), queue.NumFrames(),
+             queue.NumSteals(), queue.NumRequeued());
+  if (!queue.Failed().empty()) {
+    std::string failed{};
+    for (const std::size_t index : queue.Failed()) {
+      failed += fmt::format("{}{}", failed.empty() ? "" : ", ", index);
+    }
+    fmt::print("Gave up on {} frames after {} attempts each: {}\n", queue.Failed().size(), max_attempts, failed);
+  }
+  return queue.Failed().size();
+}
+
+CoordinatorClient::CoordinatorClient(const std::filesystem::path& socket_path)
+    : socket_(unix_socket::Connect(socket_path)) {}
+
+CoordinatorClient::~CoordinatorClient() { unix_socket::Close(socket_); }
+
+std::optional<std::size_t> CoordinatorClient::Next() {
+  if (done_) {
+    return std::nullopt;
+  }
+  Send("NEXT");
+  const std::optional<std::string> reply = unix_socket::ReceiveLine(socket_, received_);
+  ASSERT(reply.has_value(), "Lost the connection to the coordinator.");
+  if (*reply == "END") {
+    done_ = true;
+    return std::nullopt;
+  } else if (*reply == "WAIT") {
+    return std::nullopt;
+  }
+  ASSERT(reply->rfind("FRAME ", 0) == 0, "Unexpected reply from the coordinator: {}", *reply);
+  return std::stoul(reply->substr(6));
+}
+
+void CoordinatorClient::Finished(const std::size_t index) { Send(fmt::format("DONE {}", index)); }
+
+void CoordinatorClient::Send(const std::string& line) {
+  const std::lock_guard<std::mutex> lock{send_mutex_};
+  ASSERT(unix_socket::SendLine(socket_, line), "Lost the connection to the coordinator.");
+}
+#else
+std::size_t RunCoordinator(const std::filesystem::path&, const std::vector<std::size_t>&, std::size_t, std::size_t,
+                           std::chrono::milliseconds) {
+  ASSERT(false, "The coordinator is not supported on Windows.");
+  return 0;
+}
+
+CoordinatorClient::CoordinatorClient(const std::filesystem::path&) {
+  ASSERT(false, "The coordinator is not supported on Windows.");
+}
+
+CoordinatorClient::~CoordinatorClient() = default;
+
+std::optional<std::size_t> CoordinatorClient::Next() { return std::nullopt; }
+
+void CoordinatorClient::Finished(std::size_t) {}
+#endif
+
+}  // namespace coordinator
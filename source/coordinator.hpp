@@ -0,0 +1,127 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <chrono>
+#include <deque>
+#include <filesystem>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "frame_source.hpp"
+
+// Dynamic distribution of frames across converter processes on one machine.
+//
+// A coordinator listens on a Unix socket, and workers (`cubemap_converter --coordinator <socket>`) connect to it. The
+// frames are split into small contiguous ranges. Each worker takes a range and asks for its frames one at a time. A
+// worker whose range is exhausted takes the next range, or steals the back half of the largest range still held by
+// another worker. Workers acknowledge each frame once it has been written. If a worker disconnects (eg. it crashed),
+// its unacknowledged frames are re-queued, up to a maximum number of attempts per frame. A worker holds its range on a
+// lease, renewed w/ every frame it finishes: a worker that hangs is disconnected once its lease expires, as if it had
+// crashed.
+//
+// The protocol is one line of text per message:
+//   worker -> coordinator: `NEXT`, `DONE <index>`
+//   coordinator -> worker: `FRAME <index>`, `WAIT` (nothing to hand out right now, ask again), `END`
+namespace coordinator {
+
+// Bookkeeping of which worker holds which frames. Does no I/O, so it can be driven by any transport.
+class WorkQueue {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  // Split `frames` into ranges of `chunk_size` frames. A frame is given up on after `max_attempts` workers failed it.
+  // A worker's lease expires if it finishes no frame for `lease_timeout`.
+  WorkQueue(std::vector<std::size_t> frames, std::size_t chunk_size, std::size_t max_attempts,
+            std::chrono::milliseconds lease_timeout = std::chrono::minutes(5));
+
+  // Start tracking a worker.
+  void AddWorker(int worker);
+
+  // Next frame for `worker`, or nullopt if there is nothing to hand out right now. Taking a new range starts a lease.
+  std::optional<std::size_t> Next(int worker, Clock::time_point now = Clock::now());
+
+  // `worker` has written frame `index`, which renews its lease. Returns false if the worker was not converting this
+  // frame.
+  bool Finished(int worker, std::size_t index, Clock::time_point now = Clock::now());
+
+  // `worker` went away: re-queue its unfinished frames.
+  void RemoveWorker(int worker);
+
+  // Workers that hold frames, but whose lease expired at `now`. The caller should disconnect and remove them.
+  [[nodiscard]] std::vector<int> ExpiredWorkers(Clock::time_point now = Clock::now()) const;
+
+  // True once every frame was finished, or given up on.
+  [[nodiscard]] bool IsComplete() const { return num_finished_ + failed_.size() == frames_.size(); }
+
+  [[nodiscard]] std::size_t NumFrames() const { return frames_.size(); }
+  [[nodiscard]] std::size_t NumFinished() const { return num_finished_; }
+  [[nodiscard]] std::size_t NumSteals() const { return num_steals_; }
+  [[nodiscard]] std::size_t NumRequeued() const { return num_requeued_; }
+
+  // Frames that were given up on.
+  [[nodiscard]] const std::vector<std::size_t>& Failed() const { return failed_; }
+
+ private:
+  // Half-open range of positions in `frames_`.
+  struct Range {
+    std::size_t begin;
+    std::size_t end;
+    [[nodiscard]] std::size_t Size() const { return end - begin; }
+  };
+
+  struct Worker {
+    // Frames that have not been handed out yet.
+    Range range{0, 0};
+    // Frames handed out but not finished: index -> position.
+    std::map<std::size_t, std::size_t> in_flight{};
+    // When the worker last took a range or finished a frame.
+    Clock::time_point lease_renewed{};
+  };
+
+  // Refill the range of `worker`, from the queue or by stealing. Returns false if there is nothing left.
+  bool Refill(Worker& worker);
+
+  std::vector<std::size_t> frames_;
+  std::vector<std::size_t> attempts_;
+  std::size_t max_attempts_;
+  std::chrono::milliseconds lease_timeout_;
+  std::deque<Range> queue_{};
+  std::map<int, Worker> workers_{};
+  std::size_t num_finished_{0};
+  std::size_t num_steals_{0};
+  std::size_t num_requeued_{0};
+  std::vector<std::size_t> failed_{};
+};
+
+// Serve `frames` to workers connecting on `socket_path`, until every frame was converted or given up on.
+// Returns the number of frames given up on.
+std::size_t RunCoordinator(const std::filesystem::path& socket_path, const std::vector<std::size_t>& frames,
+                           std::size_t chunk_size, std::size_t max_attempts, std::chrono::milliseconds lease_timeout);
+
+// Frames handed out by a coordinator. Asserts if the coordinator cannot be reached.
+class CoordinatorClient final : public FrameSource {
+ public:
+  explicit CoordinatorClient(const std::filesystem::path& socket_path);
+  ~CoordinatorClient() override;
+
+  CoordinatorClient(const CoordinatorClient&) = delete;
+  CoordinatorClient& operator=(const CoordinatorClient&) = delete;
+
+  std::optional<std::size_t> Next() override;
+
+  [[nodiscard]] bool Done() const override { return done_; }
+
+  void Finished(std::size_t index) override;
+
+ private:
+  void Send(const std::string& line);
+
+  int socket_{-1};
+  std::mutex send_mutex_{};
+  std::string received_{};
+  bool done_{false};
+};
+
+}  // namespace coordinator
@@ -0,0 +1,273 @@
+// Copyright 2023 Gareth Cross
+#include "cpu_engine.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+
+#include "assertions.hpp"
+
+namespace cpu_engine {
+
+// Same as `DecodeOctahedral` in the shader.
+static glm::vec3 DecodeOctahedral(const glm::vec2 p) {
+  glm::vec3 v{p.x, p.y, 1.0f - std::abs(p.x) - std::abs(p.y)};
+  if (v.z < 0.0f) {
+    v.x = (1.0f - std::abs(p.y)) * (p.x >= 0.0f ? 1.0f : -1.0f);
+    v.y = (1.0f - std::abs(p.x)) * (p.y >= 0.0f ? 1.0f : -1.0f);
+  }
+  return glm::normalize(v);
+}
+
+// Fetch an entry of the remap table, clamping to the edge of the grid.
+static glm::vec3 FetchRemapTable(const RemapTableRays& rays, int x, int y) {
+  const images::ImageView& table = rays.table;
+  x = std::clamp(x, 0, table.width - 1);
+  y = std::clamp(y, 0, table.height - 1);
+  const uint8_t* const texel = table.data + y * table.Stride() + x * table.components * static_cast<int>(table.depth);
+  if (rays.encoding == TableEncoding::Oct16) {
+    std::array<uint16_t, 2> encoded{};
+    std::memcpy(encoded.data(), texel, sizeof(encoded));
+    const glm::vec2 p{static_cast<float>(encoded[0]), static_cast<float>(encoded[1])};
+    return DecodeOctahedral(p * (2.0f / 65535.0f) - 1.0f);
+  }
+  glm::vec3 result{};
+  std::memcpy(&result.x, texel, 3 * sizeof(float));
+  return result;
+}
+
+// Same as `CatmullRomWeights` in the shader.
+static std::array<float, 4> CatmullRomWeights(const float t) {
+  const float t2 = t * t;
+  const float t3 = t2 * t;
+  return {-0.5f * t3 + t2 - 0.5f * t, 1.5f * t3 - 2.5f * t2 + 1.0f, -1.5f * t3 + 2.0f * t2 + 0.5f * t,
+          0.5f * t3 - 0.5f * t2};
+}
+
+// Same as `LookupRemapTable` in the shader.
+static glm::vec3 LookupRemapTable(const RemapTableRays& rays, const glm::vec2 pixel) {
+  if (rays.stride == 1) {
+    return FetchRemapTable(rays, static_cast<int>(pixel.x), static_cast<int>(pixel.y));
+  }
+  const glm::vec2 p_grid = pixel / static_cast<float>(rays.stride);
+  const int x0 = static_cast<int>(std::floor(p_grid.x));
+  const int y0 = static_cast<int>(std::floor(p_grid.y));
+  const float tx = p_grid.x - static_cast<float>(x0);
+  const float ty = p_grid.y - static_cast<float>(y0);
+
+  if (rays.interpolation == TableInterpolation::Bilinear) {
+    const glm::vec3 v00 = FetchRemapTable(rays, x0, y0);
+    const glm::vec3 v10 = FetchRemapTable(rays, x0 + 1, y0);
+    const glm::vec3 v01 = FetchRemapTable(rays, x0, y0 + 1);
+    const glm::vec3 v11 = FetchRemapTable(rays, x0 + 1, y0 + 1);
+    return glm::mix(glm::mix(v00, v10, tx), glm::mix(v01, v11, tx), ty);
+  }
+
+  const std::array<float, 4> wx = CatmullRomWeights(tx);
+  const std::array<float, 4> wy = CatmullRomWeights(ty);
+  glm::vec3 result{0.0f, 0.0f, 0.0f};
+  for (int j = 0; j < 4; ++j) {
+    glm::vec3 row{0.0f, 0.0f, 0.0f};
+    for (int i = 0; i < 4; ++i) {
+      row += wx[i] * FetchRemapTable(rays, x0 + i - 1, y0 + j - 1);
+    }
+    result += wy[j] * row;
+  }
+  return result;
+}
+
+std::vector<glm::vec3> ComputeCameraRays(const RaySource& source, const int width, const int height) {
+  ASSERT(width > 0 && height > 0, "Dimensions must be positive: w={}, h={}", width, height);
+  std::vector<glm::vec3> rays(static_cast<std::size_t>(width) * static_cast<std::size_t>(height));
+  for (int y = 0; y < height; ++y) {
+    for (int x = 0; x < width; ++x) {
+      const glm::vec2 pixel{static_cast<float>(x), static_cast<float>(y)};
+      const glm::vec3 ray = std::visit(
+          [&](const auto& src) -> glm::vec3 {
+            if constexpr (std::is_same_v<std::decay_t<decltype(src)>, RemapTableRays>) {
+              return LookupRemapTable(src, pixel);
+            } else {
+              return camera_models::Unproject(src, pixel);
+            }
+          },
+          source);
+      rays[static_cast<std::size_t>(y) * width + x] = glm::normalize(ray);
+    }
+  }
+  return rays;
+}
+
+CpuEngine::CpuEngine(const RaySource& rays, const images::ImageView& valid_mask, const int width, const int height,
+                     const RenderParams& params, const std::size_t num_threads)
+    : width_(width), height_(height), params_(params), num_threads_(std::max(num_threads, std::size_t{1})) {
+  rays_cube_ = ComputeCameraRays(rays, width_, height_);
+  for (glm::vec3& ray : rays_cube_) {
+    ray = params_.cubemap_R_camera * ray;
+  }
+
+  // The shader reads the mask w/ an upper-left origin, so output row `y` uses mask row `height - 1 - y`.
+  valid_.resize(rays_cube_.size(), 1);
+  if (valid_mask.data != nullptr) {
+    ASSERT(valid_mask.width == width_ && valid_mask.height == height_ && valid_mask.components == 1 &&
+               valid_mask.depth == images::ImageDepth::Bits8,
+           "Valid mask must be {}x{} 8-bit grayscale.", width_, height_);
+    for (int y = 0; y < height_; ++y) {
+      const uint8_t* const mask_row = valid_mask.data + (height_ - 1 - y) * valid_mask.Stride();
+      for (int x = 0; x < width_; ++x) {
+        valid_[static_cast<std::size_t>(y) * width_ + x] = mask_row[x] > 0;
+      }
+    }
+  }
+}
+
+void CpuEngine::Render(const std::vector<images::SimpleImage>& faces, images::SimpleImage& rgb,
+                       images::SimpleImage& inv_range) const {
+  ASSERT(faces.size() == 12, "Expected 12 cubemap faces, got: {}", faces.size());
+  for (std::size_t face = 0; face < faces.size(); ++face) {
+    const images::SimpleImage& image = faces[face];
+    ASSERT(!image.IsEmpty(), "Cubemap face {} is empty", face);
+    ASSERT(image.width == image.height && image.width == faces[face < 6 ? 0 : 6].width,
+           "Faces should be square and of equal dimension. face = {}, width = {}, height = {}", face, image.width,
+           image.height);
+  }
+  ASSERT(faces[0].components == 3 && faces[0].depth == images::ImageDepth::Bits8, "RGB faces must be 8-bit RGB");
+  ASSERT(faces[6].components == 1 && faces[6].depth == images::ImageDepth::Bits16,
+         "Inverse depth faces must be 16-bit grayscale");
+
+  rgb = images::SimpleImage{width_, height_, 3, images::ImageDepth::Bits8};
+  inv_range = images::SimpleImage{width_, height_, 1, images::ImageDepth::Bits16};
+
+  // Split rows evenly between threads:
+  const int num_chunks = static_cast<int>(std::min(num_threads_, static_cast<std::size_t>(height_)));
+  std::vector<std::future<void>> chunks{};
+  chunks.reserve(num_chunks);
+  for (int chunk = 0; chunk < num_chunks; ++chunk) {
+    const int row_begin = height_ * chunk / num_chunks;
+    const int row_end = height_ * (chunk + 1) / num_chunks;
+    chunks.push_back(std::async(std::launch::async,
+                                [&, row_begin, row_end] { RenderRows(faces, row_begin, row_end, rgb, inv_range); }));
+  }
+  for (std::future<void>& chunk : chunks) {
+    chunk.get();
+  }
+}
+
+// Same as `TransformToFaceFromCube` in the shader.
+static glm::vec3 TransformToFaceFromCube(const int face, const glm::vec3& v) {
+  switch (face) {
+    case 0:  // Positive X
+      return {-v.z, v.y, v.x};
+    case 1:  // Negative X
+      return {v.z, v.y, -v.x};
+    case 2:  // Positive Y
+      return {v.x, -v.z, v.y};
+    case 3:  // Negative Y
+      return {v.x, v.z, -v.y};
+    case 4:  // Positive Z
+      return {v.x, v.y, v.z};
+    case 5:  // Negative Z
+      return {-v.x, v.y, -v.z};
+    default:
+      break;
+  }
+  return {0.0f, 0.0f, 0.0f};
+}
+
+// Bilinear sample of an 8-bit RGB face at normalized coordinates `uv`, the same as GL_LINEAR w/ GL_CLAMP_TO_EDGE.
+static glm::vec3 SampleBilinearRgb(const images::SimpleImage& face, const glm::vec2 uv) {
+  const float sx = uv.x * static_cast<float>(face.width) - 0.5f;
+  const float sy = uv.y * static_cast<float>(face.height) - 0.5f;
+  const float fx = std::floor(sx);
+  const float fy = std::floor(sy);
+  const float ax = sx - fx;
+  const float ay = sy - fy;
+  const int x0 = std::clamp(static_cast<int>(fx), 0, face.width - 1);
+  const int x1 = std::clamp(static_cast<int>(fx) + 1, 0, face.width - 1);
+  const int y0 = std::clamp(static_cast<int>(fy), 0, face.height - 1);
+  const int y1 = std::clamp(static_cast<int>(fy) + 1, 0, face.height - 1);
+
+  const std::size_t stride = face.Stride();
+  const auto texel = [&](int x, int y) {
+    const uint8_t* const p = &face.data[y * stride + x * 3];
+    return glm::vec3{static_cast<float>(p[0]), static_cast<float>(p[1]), static_cast<float>(p[2])} / 255.0f;
+  };
+  return glm::mix(glm::mix(texel(x0, y0), texel(x1, y0), ax), glm::mix(texel(x0, y1), texel(x1, y1), ax), ay);
+}
+
+// Fetch a normalized 16-bit value, the same as `texelFetch` on a GL_R16 texture.
+static float FetchInverseDepth(const images::SimpleImage& face, const int x, const int y) {
+  uint16_t value{0};
+  std::memcpy(&value, &face.data[y * face.Stride() + x * sizeof(uint16_t)], sizeof(uint16_t));
+  return static_cast<float>(value) / 65535.0f;
+}
+
+// Convert normalized float to unsigned normalized integer, as the GPU does when writing the framebuffer.
+template <typename T>
+static T FloatToUnorm(const float value) {
+  constexpr float max_value = static_cast<float>(std::numeric_limits<T>::max());
+  return static_cast<T>(std::clamp(value, 0.0f, 1.0f) * max_value + 0.5f);
+}
+
+void CpuEngine::RenderRows(const std::vector<images::SimpleImage>& faces, const int row_begin, const int row_end,
+                           images::SimpleImage& rgb, images::SimpleImage& inv_range) const {
+  // Oversampled image-plane width (normalized units, halved):
+  const float oversampled_half_size = std::tan(params_.oversampled_fov * 0.5f);
+  const int depth_max_pixel = faces[6].width - 1;
+
+  for (int y = row_begin; y < row_end; ++y) {
+    for (int x = 0; x < width_; ++x) {
+      const std::size_t index = static_cast<std::size_t>(y) * width_ + x;
+      const glm::vec3& v_cube = rays_cube_[index];
+      const float is_valid = static_cast<float>(valid_[index]);
+
+      float total_weight = 0.0f;
+      glm::vec3 color_rgb{0.0f, 0.0f, 0.0f};
+      float inv_range_max = 0.0f;
+      for (int face = 0; face < 6; ++face) {
+        const glm::vec3 v_face = TransformToFaceFromCube(face, v_cube);
+        if (v_face.z <= 0.0f) {
+          continue;
+        }
+        const glm::vec2 p_face = glm::vec2{v_face.x, v_face.y} / v_face.z;
+        if (std::abs(p_face.x) > oversampled_half_size || std::abs(p_face.y) > oversampled_half_size) {
+          continue;
+        }
+        glm::vec2 uv = glm::clamp((p_face + oversampled_half_size) / (2.0f * oversampled_half_size), 0.0f, 1.0f);
+        uv.y = 1.0f - uv.y;
+
+        // Color, blended across the overlapping region of the faces:
+        const glm::vec3 sampled_rgb = SampleBilinearRgb(faces[face], uv);
+        const float weight_product = (1.0f - glm::smoothstep(1.0f, oversampled_half_size, p_face.x)) *
+                                     (1.0f - glm::smoothstep(1.0f, oversampled_half_size, p_face.y));
+        color_rgb += sampled_rgb * weight_product;
+        total_weight += weight_product;
+
+        // Inverse range, taking the max of the four neighboring texels:
+        const images::SimpleImage& depth_face = faces[face + 6];
+        const int x00 = static_cast<int>(std::floor(uv.x * depth_max_pixel));
+        const int y00 = static_cast<int>(std::floor(uv.y * depth_max_pixel));
+        const int x11 = static_cast<int>(std::ceil(uv.x * depth_max_pixel));
+        const int y11 = static_cast<int>(std::ceil(uv.y * depth_max_pixel));
+        const float v_max =
+            std::max(std::max(FetchInverseDepth(depth_face, x00, y00), FetchInverseDepth(depth_face, x00, y11)),
+                     std::max(FetchInverseDepth(depth_face, x11, y00), FetchInverseDepth(depth_face, x11, y11)));
+
+        // Same as `InverseRangeFromInverseDepth` in the shader:
+        const float inv_depth_meters = v_max / params_.ue_clip_plane_meters;
+        const float inv_range_meters = inv_depth_meters * v_face.z;
+        inv_range_max = std::max(inv_range_max, std::min(inv_range_meters * params_.ue_clip_plane_meters, 1.0f));
+      }
+
+      const glm::vec3 color_out = total_weight > 0.0f ? color_rgb * is_valid / total_weight : glm::vec3{0.0f};
+      uint8_t* const rgb_out = &rgb.data[y * rgb.Stride() + x * 3];
+      rgb_out[0] = FloatToUnorm<uint8_t>(color_out.x);
+      rgb_out[1] = FloatToUnorm<uint8_t>(color_out.y);
+      rgb_out[2] = FloatToUnorm<uint8_t>(color_out.z);
+
+      const uint16_t inv_range_out = FloatToUnorm<uint16_t>(inv_range_max * is_valid);
+      std::memcpy(&inv_range.data[y * inv_range.Stride() + x * sizeof(uint16_t)], &inv_range_out, sizeof(uint16_t));
+    }
+  }
+}
+
+}  // namespace cpu_engine
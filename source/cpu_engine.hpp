@@ -0,0 +1,86 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <variant>
+#include <vector>
+
+#include "camera_models.hpp"
+#include "images.hpp"
+
+// A CPU implementation of the cubemap conversion, for machines without a usable OpenGL context.
+namespace cpu_engine {
+
+// How a coarse remap table is interpolated. The values are passed to the shader as `remap_table_interpolation`.
+enum class TableInterpolation : int {
+  Bilinear = 0,
+  Bicubic = 1,
+};
+
+// How rays are stored in the remap table. The values are passed to the shader as `remap_table_encoding`.
+enum class TableEncoding : int {
+  // float32x3 per pixel.
+  Float32 = 0,
+  // uint16x2 octahedral coordinates per pixel, [0, 65535] maps to [-1, 1].
+  Oct16 = 1,
+};
+
+// Camera rays read from a (possibly coarse) remap table.
+struct RemapTableRays {
+  images::ImageView table{};
+  int stride{1};
+  TableInterpolation interpolation{TableInterpolation::Bicubic};
+  TableEncoding encoding{TableEncoding::Float32};
+};
+
+// Camera rays come either from a remap table, or from a parametric camera model.
+using RaySource = std::variant<RemapTableRays, camera_models::CameraIntrinsics>;
+
+// Parameters shared w/ the OpenGL renderer (these are uniforms of `fragment_oversampled_cubemap.glsl`).
+struct RenderParams {
+  // Rotation from the camera to the DirectX cubemap.
+  glm::mat3x3 cubemap_R_camera{1.0f};
+  // The size of the oversampled cubemap faces, in radians.
+  float oversampled_fov{0.0f};
+  // The clip plane in Unreal Engine in meters.
+  float ue_clip_plane_meters{0.1f};
+};
+
+// Compute the unit camera ray for every output pixel. The result is row-major, and row `y` corresponds to row `y`
+// of the remap table. This matches `ComputeCameraRay` in the shader.
+std::vector<glm::vec3> ComputeCameraRays(const RaySource& source, int width, int height);
+
+// Renders native images from the oversampled cubemaps on the CPU.
+// Mirrors `fragment_oversampled_cubemap.glsl`, and produces images in the same (bottom-up) row order we get when
+// reading back the framebuffer - so outputs are written the same way for both engines.
+class CpuEngine {
+ public:
+  // Construct from the camera rays. `valid_mask` may be empty (null data), in which case every pixel is valid.
+  // Rows are split between `num_threads` threads.
+  CpuEngine(const RaySource& rays, const images::ImageView& valid_mask, int width, int height,
+            const RenderParams& params, std::size_t num_threads);
+
+  // Render color (8-bit RGB) and inverse range (16-bit) from the 12 cubemap faces (6 RGB, then 6 inverse depth).
+  void Render(const std::vector<images::SimpleImage>& faces, images::SimpleImage& rgb,
+              images::SimpleImage& inv_range) const;
+
+  // Dimensions of the output images.
+  [[nodiscard]] int Width() const { return width_; }
+  [[nodiscard]] int Height() const { return height_; }
+
+ private:
+  // Render rows [row_begin, row_end).
+  void RenderRows(const std::vector<images::SimpleImage>& faces, int row_begin, int row_end, images::SimpleImage& rgb,
+                  images::SimpleImage& inv_range) const;
+
+  int width_;
+  int height_;
+  RenderParams params_;
+  std::size_t num_threads_;
+
+  // Unit ray per output pixel, already rotated into the cubemap frame.
+  std::vector<glm::vec3> rays_cube_;
+
+  // Validity of each output pixel, in output row order.
+  std::vector<uint8_t> valid_;
+};
+
+}  // namespace cpu_engine
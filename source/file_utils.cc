@@ -0,0 +1,199 @@
+// Copyright 2023 Gareth Cross
+#include "file_utils.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <utility>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include "assertions.hpp"
+
+namespace file_utils {
+
+#ifdef _WIN32
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const HANDLE file = CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+  ASSERT(file != INVALID_HANDLE_VALUE, "Failed to open file: {}", path.u8string());
+
+  LARGE_INTEGER file_size{};
+  const BOOL got_size = GetFileSizeEx(file, &file_size);
+  if (!got_size || file_size.QuadPart == 0) {
+    CloseHandle(file);
+    ASSERT(got_size, "Failed to get size of file: {}", path.u8string());
+    return;
+  }
+
+  // The mapping object keeps the file open, so we can close our handle right away.
+  mapping_handle_ = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+  CloseHandle(file);
+  ASSERT(mapping_handle_ != nullptr, "Failed to create file mapping: {}", path.u8string());
+
+  data_ = static_cast<const uint8_t*>(MapViewOfFile(mapping_handle_, FILE_MAP_READ, 0, 0, 0));
+  ASSERT(data_ != nullptr, "Failed to map view of file: {}", path.u8string());
+  size_ = static_cast<std::size_t>(file_size.QuadPart);
+}
+
+void MappedFile::Cleanup() noexcept {
+  if (data_) {
+    UnmapViewOfFile(data_);
+  }
+  if (mapping_handle_) {
+    CloseHandle(mapping_handle_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+  mapping_handle_ = nullptr;
+}
+#else
+MappedFile::MappedFile(const std::filesystem::path& path) {
+  const int fd = open(path.c_str(), O_RDONLY);
+  ASSERT(fd >= 0, "Failed to open file: {}", path.u8string());
+
+  struct stat file_stat {};
+  const int stat_result = fstat(fd, &file_stat);
+  if (stat_result != 0 || file_stat.st_size == 0) {
+    close(fd);
+    ASSERT(stat_result == 0, "Failed to stat file: {}", path.u8string());
+    return;
+  }
+
+  // The mapping keeps a reference to the file, so we can close the descriptor right away.
+  void* const mapped = mmap(nullptr, static_cast<std::size_t>(file_stat.st_size), PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  ASSERT(mapped != MAP_FAILED, "Failed to mmap file: {}", path.u8string());
+  data_ = static_cast<const uint8_t*>(mapped);
+  size_ = static_cast<std::size_t>(file_stat.st_size);
+}
+
+void MappedFile::Cleanup() noexcept {
+  if (data_) {
+    munmap(const_cast<uint8_t*>(data_), size_);
+  }
+  data_ = nullptr;
+  size_ = 0;
+}
+#endif
+
+MappedFile::MappedFile(MappedFile&& other) noexcept { *this = std::move(other); }
+
+MappedFile& MappedFile::operator=(MappedFile&& other) noexcept {
+  if (this != &other) {
+    Cleanup();
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+#ifdef _WIN32
+    std::swap(mapping_handle_, other.mapping_handle_);
+#endif
+  }
+  return *this;
+}
+
+// Path of the temporary file `WriteFileDurably` writes to, before renaming it.
+static std::filesystem::path TemporaryPath(const std::filesystem::path& path) {
+  std::filesystem::path tmp_path = path;
+  tmp_path += ".tmp";
+  return tmp_path;
+}
+
+#ifdef _WIN32
+// Write all of `data`, in chunks that fit in a DWORD.
+static bool WriteAll(const HANDLE file, const uint8_t* data, std::size_t size) {
+  while (size > 0) {
+    const DWORD chunk = static_cast<DWORD>(std::min<std::size_t>(size, 1 << 30));
+    DWORD written = 0;
+    if (!WriteFile(file, data, chunk, &written, nullptr)) {
+      return false;
+    }
+    data += written;
+    size -= written;
+  }
+  return true;
+}
+
+void WriteFileDurably(const std::filesystem::path& path, const uint8_t* data, const std::size_t size) {
+  const std::filesystem::path tmp_path = TemporaryPath(path);
+  const HANDLE file =
+      CreateFileW(tmp_path.c_str(), GENERIC_WRITE, 0, nullptr, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, nullptr);
+  ASSERT(file != INVALID_HANDLE_VALUE, "Failed to open output file: {}", tmp_path.u8string());
+  const bool written = WriteAll(file, data, size) && FlushFileBuffers(file);
+  CloseHandle(file);
+  ASSERT(written, "Failed to write output file: {}", tmp_path.u8string());
+  ASSERT(MoveFileExW(tmp_path.c_str(), path.c_str(), MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH),
+         "Failed to rename {} to {}", tmp_path.u8string(), path.u8string());
+}
+
+AppendOnlyFile::AppendOnlyFile(const std::filesystem::path& path) : path_(path) {
+  handle_ = CreateFileW(path.c_str(), FILE_APPEND_DATA, FILE_SHARE_READ | FILE_SHARE_WRITE, nullptr, OPEN_ALWAYS,
+                        FILE_ATTRIBUTE_NORMAL, nullptr);
+  ASSERT(handle_ != INVALID_HANDLE_VALUE, "Failed to open file for appending: {}", path.u8string());
+}
+
+AppendOnlyFile::~AppendOnlyFile() { CloseHandle(handle_); }
+
+void AppendOnlyFile::AppendDurably(const std::string& text) {
+  ASSERT(WriteAll(handle_, reinterpret_cast<const uint8_t*>(text.data()), text.size()) && FlushFileBuffers(handle_),
+         "Failed to append to file: {}", path_.u8string());
+}
+#else
+// Write all of `data`, retrying on interruption.
+static bool WriteAll(const int fd, const uint8_t* data, std::size_t size) {
+  while (size > 0) {
+    const ssize_t written = write(fd, data, size);
+    if (written < 0 && errno == EINTR) {
+      continue;
+    } else if (written < 0) {
+      return false;
+    }
+    data += written;
+    size -= static_cast<std::size_t>(written);
+  }
+  return true;
+}
+
+void WriteFileDurably(const std::filesystem::path& path, const uint8_t* data, const std::size_t size) {
+  const std::filesystem::path tmp_path = TemporaryPath(path);
+  const int fd = open(tmp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  ASSERT(fd >= 0, "Failed to open output file: {}. Error = {}", tmp_path.u8string(), std::strerror(errno));
+  const bool written = WriteAll(fd, data, size) && fsync(fd) == 0;
+  const int error = errno;
+  close(fd);
+  ASSERT(written, "Failed to write output file: {}. Error = {}", tmp_path.u8string(), std::strerror(error));
+  ASSERT(rename(tmp_path.c_str(), path.c_str()) == 0, "Failed to rename {} to {}. Error = {}", tmp_path.u8string(),
+         path.u8string(), std::strerror(errno));
+
+  // The rename is only durable once the directory is flushed as well:
+  const std::filesystem::path directory = path.has_parent_path() ? path.parent_path() : ".";
+  const int dir_fd = open(directory.c_str(), O_RDONLY);
+  ASSERT(dir_fd >= 0, "Failed to open directory: {}. Error = {}", directory.u8string(), std::strerror(errno));
+  const bool synced = fsync(dir_fd) == 0;
+  close(dir_fd);
+  ASSERT(synced, "Failed to flush directory: {}", directory.u8string());
+}
+
+AppendOnlyFile::AppendOnlyFile(const std::filesystem::path& path) : path_(path) {
+  // O_APPEND moves to the end of the file atomically w/ each write, so appends from other processes are not lost:
+  fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  ASSERT(fd_ >= 0, "Failed to open file for appending: {}. Error = {}", path.u8string(), std::strerror(errno));
+}
+
+AppendOnlyFile::~AppendOnlyFile() { close(fd_); }
+
+void AppendOnlyFile::AppendDurably(const std::string& text) {
+  ASSERT(WriteAll(fd_, reinterpret_cast<const uint8_t*>(text.data()), text.size()) && fsync(fd_) == 0,
+         "Failed to append to file: {}. Error = {}", path_.u8string(), std::strerror(errno));
+}
+#endif
+
+}  // namespace file_utils
@@ -0,0 +1,72 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+
+namespace file_utils {
+
+// Read-only memory mapping of an entire file.
+// Pages are shared with the OS page cache, so several processes mapping the same file share one copy.
+struct MappedFile {
+  MappedFile() = default;
+
+  // Map the file at `path`. Asserts if the file cannot be opened or mapped.
+  explicit MappedFile(const std::filesystem::path& path);
+
+  // Non-copyable.
+  MappedFile(const MappedFile&) = delete;
+  MappedFile& operator=(const MappedFile&) = delete;
+
+  // Movable.
+  MappedFile(MappedFile&& other) noexcept;
+  MappedFile& operator=(MappedFile&& other) noexcept;
+
+  ~MappedFile() { Cleanup(); }
+
+  // Pointer to the start of the mapping (null if the file was empty).
+  [[nodiscard]] const uint8_t* Data() const { return data_; }
+
+  // Size of the mapping in bytes.
+  [[nodiscard]] std::size_t Size() const { return size_; }
+
+ private:
+  void Cleanup() noexcept;
+
+  const uint8_t* data_{nullptr};
+  std::size_t size_{0};
+#ifdef _WIN32
+  void* mapping_handle_{nullptr};
+#endif
+};
+
+// Write `size` bytes to `path`, such that after returning the file survives a crash or power loss, and a crash
+// while writing never leaves a partial file at `path`: The bytes are written to `<path>.tmp`, flushed to disk, and
+// then renamed over `path`. Asserts on failure.
+void WriteFileDurably(const std::filesystem::path& path, const uint8_t* data, std::size_t size);
+
+// A file that is only ever appended to, eg. a log of finished work. Several processes may append to the same file.
+class AppendOnlyFile {
+ public:
+  // Open (or create) the file at `path`. Asserts on failure.
+  explicit AppendOnlyFile(const std::filesystem::path& path);
+
+  ~AppendOnlyFile();
+
+  // Non-copyable and non-movable.
+  AppendOnlyFile(const AppendOnlyFile&) = delete;
+  AppendOnlyFile& operator=(const AppendOnlyFile&) = delete;
+
+  // Append `text` in a single write, and flush it to disk before returning. Asserts on failure.
+  void AppendDurably(const std::string& text);
+
+ private:
+  std::filesystem::path path_;
+#ifdef _WIN32
+  void* handle_{nullptr};
+#else
+  int fd_{-1};
+#endif
+};
+
+}  // namespace file_utils
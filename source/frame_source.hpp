@@ -0,0 +1,79 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <utility>
+#include <vector>
+
+// Supplies the indices of the frames to convert, either from a fixed list or from a coordinator process.
+class FrameSource {
+ public:
+  virtual ~FrameSource() = default;
+
+  // Index of the next frame to convert, or nullopt if there is none right now. Called from the main thread.
+  virtual std::optional<std::size_t> Next() = 0;
+
+  // True once `Next` will not return any more frames.
+  [[nodiscard]] virtual bool Done() const = 0;
+
+  // Called once frame `index` has been written (or rendered, if there is no output). May be called from any thread.
+  virtual void Finished(std::size_t) {}
+};
+
+// Indices `start`, `start + stride`, ... up to (not including) `end`. Of those, every `num_shards`-th one is selected,
+// starting w/ the `shard_index`-th.
+inline std::vector<std::size_t> SelectFrames(const std::size_t start, const std::size_t end, const std::size_t stride,
+                                             const std::size_t shard_index = 0, const std::size_t num_shards = 1) {
+  std::vector<std::size_t> frames{};
+  for (std::size_t index = start + shard_index * stride; index < end; index += stride * num_shards) {
+    frames.push_back(index);
+  }
+  return frames;
+}
+
+// Returns the frames of a list, in order.
+class FrameListSource final : public FrameSource {
+ public:
+  explicit FrameListSource(std::vector<std::size_t> frames) : frames_(std::move(frames)) {}
+
+  std::optional<std::size_t> Next() override {
+    if (position_ == frames_.size()) {
+      return std::nullopt;
+    }
+    return frames_[position_++];
+  }
+
+  [[nodiscard]] bool Done() const override { return position_ == frames_.size(); }
+
+ private:
+  std::vector<std::size_t> frames_;
+  std::size_t position_{0};
+};
+
+// Passes on the frames of another source, except those `skip` returns true for. Skipped frames are reported finished
+// to the other source right away.
+class SkippingFrameSource final : public FrameSource {
+ public:
+  SkippingFrameSource(std::unique_ptr<FrameSource> source, std::function<bool(std::size_t)> skip)
+      : source_(std::move(source)), skip_(std::move(skip)) {}
+
+  std::optional<std::size_t> Next() override {
+    for (;;) {
+      const std::optional<std::size_t> index = source_->Next();
+      if (!index || !skip_(*index)) {
+        return index;
+      }
+      source_->Finished(*index);
+    }
+  }
+
+  [[nodiscard]] bool Done() const override { return source_->Done(); }
+
+  void Finished(const std::size_t index) override { source_->Finished(index); }
+
+ private:
+  std::unique_ptr<FrameSource> source_;
+  std::function<bool(std::size_t)> skip_;
+};
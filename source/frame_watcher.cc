@@ -0,0 +1,183 @@
+// Copyright 2023 Gareth Cross
+#include "frame_watcher.hpp"
+
+#include <algorithm>
+#include <cctype>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#endif
+
+#include <fmt/format.h>
+
+// How often the directories are scanned for new faces, when inotify is not available.
+constexpr auto kScanInterval = std::chrono::seconds(1);
+
+static bool IsNumber(const std::string& str) {
+  return !str.empty() &&
+         std::all_of(str.begin(), str.end(), [](char c) { return std::isdigit(static_cast<unsigned char>(c)) != 0; });
+}
+
+FrameWatcher::FrameWatcher(const std::filesystem::path& dataset_root, const std::size_t camera_index,
+                           const std::vector<std::size_t>& frames, const std::chrono::milliseconds settle_time,
+                           const std::chrono::seconds timeout)
+    : directories_{dataset_root / "image" / fmt::format("camera{:02}", camera_index),
+                   dataset_root / "depth" / fmt::format("camera{:02}", camera_index)},
+      settle_time_(settle_time),
+      timeout_(timeout),
+      remaining_(frames.begin(), frames.end()),
+      last_activity_(Clock::now()) {
+#ifdef __linux__
+  inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (inotify_fd_ < 0) {
+    fmt::print("inotify is not available ({}), scanning for new frames every {} s instead.\n", std::strerror(errno),
+               std::chrono::duration_cast<std::chrono::seconds>(kScanInterval).count());
+  }
+#endif
+  fmt::print("Watching for {} frames in: {}, {}\n", remaining_.size(), directories_[0].u8string(),
+             directories_[1].u8string());
+}
+
+FrameWatcher::~FrameWatcher() {
+#ifdef __linux__
+  if (inotify_fd_ >= 0) {
+    close(inotify_fd_);
+  }
+#endif
+}
+
+std::optional<std::size_t> FrameWatcher::Next() {
+  const Clock::time_point now = Clock::now();
+  Update(now);
+  for (auto& [index, faces] : partial_) {
+    if (IsComplete(index, faces, now)) {
+      const std::size_t complete_index = index;
+      partial_.erase(complete_index);
+      remaining_.erase(complete_index);
+      return complete_index;
+    }
+  }
+  if (timeout_.count() > 0 && !remaining_.empty() && !timed_out_ && now - last_activity_ > timeout_) {
+    timed_out_ = true;
+    fmt::print("Stopped watching: no faces were added for {} s. {} frames were not converted.\n", timeout_.count(),
+               remaining_.size());
+  }
+  return std::nullopt;
+}
+
+void FrameWatcher::Update(const Clock::time_point now) {
+#ifdef __linux__
+  if (inotify_fd_ >= 0) {
+    // Watch the directories once they exist, then pick up the faces written before we started watching:
+    for (std::size_t i = 0; i < directories_.size(); ++i) {
+      if (watches_[i] < 0) {
+        watches_[i] = inotify_add_watch(inotify_fd_, directories_[i].c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        if (watches_[i] >= 0) {
+          Scan(i, now);
+        }
+      }
+    }
+    alignas(inotify_event) char buffer[64 * 1024];
+    for (;;) {
+      const ssize_t length = read(inotify_fd_, buffer, sizeof(buffer));
+      if (length <= 0) {
+        // No more events (EAGAIN).
+        break;
+      }
+      for (const char* ptr = buffer; ptr < buffer + length;) {
+        const inotify_event* const event = reinterpret_cast<const inotify_event*>(ptr);
+        if (event->mask & IN_Q_OVERFLOW) {
+          // Events were dropped, so look at everything again:
+          Scan(0, now);
+          Scan(1, now);
+        } else if (event->len > 0 && (event->wd == watches_[0] || event->wd == watches_[1])) {
+          Touch(event->wd == watches_[0] ? 0 : 1, event->name, (event->mask & IN_MOVED_TO) != 0, now);
+        }
+        ptr += sizeof(inotify_event) + event->len;
+      }
+    }
+    return;
+  }
+#endif
+  if (now - last_scan_ >= kScanInterval) {
+    Scan(0, now);
+    Scan(1, now);
+    last_scan_ = now;
+  }
+}
+
+void FrameWatcher::Scan(const std::size_t directory_index, const Clock::time_point now) {
+  std::error_code err{};
+  for (const std::filesystem::directory_entry& entry :
+       std::filesystem::directory_iterator(directories_[directory_index], err)) {
+    Touch(directory_index, entry.path().filename().u8string(), false, now);
+  }
+}
+
+void FrameWatcher::Touch(const std::size_t directory_index, const std::string& file_name, const bool renamed,
+                         const Clock::time_point now) {
+  // Faces are named `<frame index>_<face index>.png`:
+  const std::size_t underscore = file_name.find('_');
+  if (underscore == std::string::npos || file_name.size() != underscore + 7 ||
+      file_name.compare(underscore + 3, 4, ".png") != 0 || !IsNumber(file_name.substr(0, underscore)) ||
+      !IsNumber(file_name.substr(underscore + 1, 2))) {
+    return;
+  }
+  const std::size_t index = std::stoul(file_name.substr(0, underscore));
+  const std::size_t face_index = std::stoul(file_name.substr(underscore + 1, 2));
+  if (face_index >= 6 || remaining_.count(index) == 0) {
+    return;
+  }
+  const std::size_t slot = directory_index * 6 + face_index;
+  std::error_code err{};
+  const std::uintmax_t size = std::filesystem::file_size(FacePath(index, slot), err);
+  if (err) {
+    // Already renamed or removed again.
+    return;
+  }
+  Face& face = partial_[index][slot];
+  if (face.present && face.size == size && (face.renamed || !renamed)) {
+    return;
+  }
+  face.present = true;
+  face.renamed = face.renamed || renamed;
+  face.size = size;
+  face.changed = now;
+  last_activity_ = now;
+}
+
+bool FrameWatcher::IsComplete(const std::size_t index, Faces& faces, const Clock::time_point now) {
+  for (const Face& face : faces) {
+    if (!face.present || (!face.renamed && now - face.changed < settle_time_)) {
+      return false;
+    }
+  }
+  // The sizes were stable when last seen, check that they still are:
+  bool complete = true;
+  for (std::size_t slot = 0; slot < faces.size(); ++slot) {
+    Face& face = faces[slot];
+    if (face.renamed) {
+      continue;
+    }
+    std::error_code err{};
+    const std::uintmax_t size = std::filesystem::file_size(FacePath(index, slot), err);
+    if (err || size != face.size) {
+      face.present = !err;
+      face.size = err ? 0 : size;
+      face.changed = now;
+      last_activity_ = now;
+      complete = false;
+    } else if (size == 0) {
+      // Created, but nothing written yet.
+      complete = false;
+    }
+  }
+  return complete;
+}
+
+std::filesystem::path FrameWatcher::FacePath(const std::size_t index, const std::size_t face) const {
+  return directories_[face / 6] / fmt::format("{:08}_{:02}.png", index, face % 6);
+}
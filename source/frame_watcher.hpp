@@ -0,0 +1,81 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <array>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "frame_source.hpp"
+
+// Hands out the frames of a dataset that is still being written, as soon as all 12 faces of a frame are complete.
+//
+// New files in the `image/cameraXX` and `depth/cameraXX` directories are detected w/ inotify on Linux, and by
+// re-scanning the directories elsewhere. A face is complete once it was renamed into place (the atomic way to write a
+// file), or once its size has not changed for `settle_time` (for writers that write in place). Frames are handed out
+// in the order they complete.
+class FrameWatcher final : public FrameSource {
+ public:
+  // Watch for the faces of `frames`, of camera `camera_index`. Gives up on the remaining frames once no face was
+  // added or changed for `timeout` (zero waits forever).
+  FrameWatcher(const std::filesystem::path& dataset_root, std::size_t camera_index,
+               const std::vector<std::size_t>& frames, std::chrono::milliseconds settle_time,
+               std::chrono::seconds timeout);
+  ~FrameWatcher() override;
+
+  // Non-copyable.
+  FrameWatcher(const FrameWatcher&) = delete;
+  FrameWatcher& operator=(const FrameWatcher&) = delete;
+
+  std::optional<std::size_t> Next() override;
+
+  [[nodiscard]] bool Done() const override { return remaining_.empty() || timed_out_; }
+
+ private:
+  using Clock = std::chrono::steady_clock;
+
+  struct Face {
+    bool present{false};
+    // Renamed into place, so complete w/o waiting for the size to settle.
+    bool renamed{false};
+    std::uintmax_t size{0};
+    Clock::time_point changed{};
+  };
+  using Faces = std::array<Face, 12>;
+
+  // Process new files: inotify events if available, otherwise a periodic scan.
+  void Update(Clock::time_point now);
+
+  // Record every face currently in directory `directory_index` (0 = image, 1 = depth).
+  void Scan(std::size_t directory_index, Clock::time_point now);
+
+  // Record a file named `file_name` in directory `directory_index`, if it is a face of a frame we are waiting for.
+  void Touch(std::size_t directory_index, const std::string& file_name, bool renamed, Clock::time_point now);
+
+  // True if all faces of frame `index` are present and complete.
+  bool IsComplete(std::size_t index, Faces& faces, Clock::time_point now);
+
+  [[nodiscard]] std::filesystem::path FacePath(std::size_t index, std::size_t face) const;
+
+  // Directories of the RGB and inverse depth faces.
+  std::array<std::filesystem::path, 2> directories_;
+  std::chrono::milliseconds settle_time_;
+  std::chrono::seconds timeout_;
+
+  // Frames that have not been handed out yet.
+  std::unordered_set<std::size_t> remaining_;
+  // The faces seen so far, of frames that have not been handed out yet.
+  std::map<std::size_t, Faces> partial_{};
+
+  // Last time a face was added or changed.
+  Clock::time_point last_activity_;
+  // Last time the directories were scanned (w/o inotify).
+  Clock::time_point last_scan_{};
+  bool timed_out_{false};
+
+  // inotify descriptor, and the watch of each directory (-1 until the directory exists).
+  int inotify_fd_{-1};
+  std::array<int, 2> watches_{-1, -1};
+};
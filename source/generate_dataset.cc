@@ -0,0 +1,76 @@
+// Copyright 2023 Gareth Cross
+#include <chrono>
+#include <thread>
+
+#include <fmt/format.h>
+#include <CLI/CLI.hpp>
+
+#include "shm_ring.hpp"
+#include "synthetic_dataset.hpp"
+
+// Publish the frames of one camera to a shared memory ring, in place of a simulator. Returns false if the consumer
+// did not read every frame.
+static bool PublishToRing(const std::string& ring_name, const synthetic_dataset::DatasetOptions& options,
+                          const std::size_t camera, const std::size_t num_slots, const double timeout_seconds) {
+  shm_ring::RingWriter writer{ring_name, options.face_size, num_slots,
+                              std::chrono::milliseconds(static_cast<int64_t>(timeout_seconds * 1000.0))};
+  for (std::size_t frame = 0; frame < options.num_frames; ++frame) {
+    writer.Write(frame, synthetic_dataset::MakeFaces(options, frame, camera));
+  }
+  return writer.Close();
+}
+
+// Write a synthetic dataset w/ the layout of an Unreal Engine export, for benchmarks and tests.
+int main(int argc, char** argv) {
+  CLI::App app{"Synthetic cubemap dataset generator"};
+  std::string output_path{};
+  synthetic_dataset::DatasetOptions options{};
+  std::size_t num_threads{std::thread::hardware_concurrency()};
+  std::string ring_name{};
+  std::size_t ring_camera{0};
+  std::size_t ring_slots{4};
+  double ring_timeout{60.0};
+  try {
+    app.add_option("-o,--output-path", output_path, "Directory to write the dataset into.");
+    app.add_option("--face-size", options.face_size, "Width and height of the cubemap faces.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--num-frames", options.num_frames, "Number of frames.")->check(CLI::PositiveNumber);
+    app.add_option("--num-cameras", options.num_cameras, "Number of cameras.")->check(CLI::PositiveNumber);
+    app.add_option("--compression-level", options.compression_level, "zlib level of the PNG files (0 - 9).")
+        ->check(CLI::Range(0, 9));
+    app.add_option("--seed", options.seed, "Seed of the procedural scene.");
+    app.add_option("--threads", num_threads, "Number of threads to generate and write faces with.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--shm-ring", ring_name,
+                   "Publish the frames of one camera to this shared memory ring (for `cubemap_converter --shm-ring`), "
+                   "instead of writing PNG files.");
+    app.add_option("--ring-camera", ring_camera, "Camera whose frames are published w/ --shm-ring.");
+    app.add_option("--ring-slots", ring_slots, "Number of frames the ring holds.")->check(CLI::PositiveNumber);
+    app.add_option("--ring-timeout", ring_timeout,
+                   "Seconds to wait for the consumer to read a frame before giving up (w/ --shm-ring).")
+        ->check(CLI::PositiveNumber);
+    app.parse(argc, argv);
+    if (output_path.empty() == ring_name.empty()) {
+      throw CLI::ValidationError("Specify exactly one of --output-path or --shm-ring.");
+    }
+  } catch (const CLI::ParseError& e) {
+    return app.exit(e);
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  if (!ring_name.empty()) {
+    fmt::print("Publishing {} frames of camera {}, w/ {}x{} faces to: {}\n", options.num_frames, ring_camera,
+               options.face_size, options.face_size, ring_name);
+    if (!PublishToRing(ring_name, options, ring_camera, ring_slots, ring_timeout)) {
+      fmt::print(stderr, "The consumer exited, or stopped reading before every frame was read.\n");
+      return 1;
+    }
+  } else {
+    fmt::print("Writing {} frames of {} camera(s), w/ {}x{} faces to: {}\n", options.num_frames, options.num_cameras,
+               options.face_size, options.face_size, output_path);
+    synthetic_dataset::WriteDataset(output_path, options, num_threads);
+  }
+  const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+  fmt::print("Done in {:.2f} s.\n", elapsed.count());
+  return 0;
+}
@@ -38,6 +38,19 @@ void ShaderProgram::SetUniformVec2(const std::string_view name, const glm::vec2
   WithUniform(Handle(), name, [&](GLint uniform) { glUniform2f(uniform, value.x, value.y); });
 }
 
+void ShaderProgram::SetUniformIVec2(const std::string_view name, const glm::ivec2 value) const {
+  WithUniform(Handle(), name, [&](GLint uniform) { glUniform2i(uniform, value.x, value.y); });
+}
+
+void ShaderProgram::SetUniformVec4(const std::string_view name, const glm::vec4 value) const {
+  WithUniform(Handle(), name, [&](GLint uniform) { glUniform4f(uniform, value.x, value.y, value.z, value.w); });
+}
+
+void ShaderProgram::SetUniformFloatArray(const std::string_view name, const float* const values,
+                                         const GLsizei count) const {
+  WithUniform(Handle(), name, [&](GLint uniform) { glUniform1fv(uniform, count, values); });
+}
+
 void ShaderProgram::SetUniformFloat(const std::string_view name, const float value) const {
   WithUniform(Handle(), name, [&](GLint uniform) { glUniform1f(uniform, value); });
 }
@@ -111,6 +124,8 @@ Texture2D::Texture2D() : OpenGLHandle(CreateTexture(), [](GLuint x) noexcept { g
 
 Texture2D::Texture2D(const images::SimpleImage& image) : Texture2D() { Fill(image); }
 
+Texture2D::Texture2D(const images::ImageView& image) : Texture2D() { Fill(image); }
+
 struct TextureFormatEntry {
   constexpr TextureFormatEntry(int channels, images::ImageDepth depth, GLenum value)
       : channels(channels), depth(depth), value(value) {}
@@ -124,8 +139,9 @@ struct TextureFormatEntry {
 static GLenum GetTextureRepresentation(const int channels, const images::ImageDepth depth) {
   using images::ImageDepth;
   constexpr std::array table = {
-      TextureFormatEntry(1, ImageDepth::Bits8, GL_R8), TextureFormatEntry(3, ImageDepth::Bits8, GL_RGB8),
-      TextureFormatEntry(1, ImageDepth::Bits16, GL_R16), TextureFormatEntry(3, ImageDepth::Bits32, GL_RGB32F)};
+      TextureFormatEntry(1, ImageDepth::Bits8, GL_R8),    TextureFormatEntry(3, ImageDepth::Bits8, GL_RGB8),
+      TextureFormatEntry(1, ImageDepth::Bits16, GL_R16),  TextureFormatEntry(2, ImageDepth::Bits16, GL_RG16),
+      TextureFormatEntry(3, ImageDepth::Bits32, GL_RGB32F)};
 
   const auto it = std::find_if(table.begin(), table.end(), [&](const TextureFormatEntry& entry) {
     return entry.channels == channels && entry.depth == depth;
@@ -138,12 +154,14 @@ static GLenum GetTextureInputFormat(const int channels) {
   switch (channels) {
     case 1:
       return GL_RED;
+    case 2:
+      return GL_RG;
     case 3:
       return GL_RGB;
     default:
       break;
   }
-  ASSERT(channels == 4, "Channels must be [1, 3, 4]. channels = {}", channels);
+  ASSERT(channels == 4, "Channels must be [1, 2, 3, 4]. channels = {}", channels);
   return GL_RGBA;
 }
 
@@ -160,8 +178,9 @@ static constexpr GLenum GetTextureDataType(const images::ImageDepth depth) {
   return GL_FLOAT;
 }
 
-void Texture2D::Fill(const struct images::SimpleImage& image) {
+void Texture2D::Fill(const images::ImageView& image) {
   ASSERT(Handle());
+  ASSERT(image.data != nullptr, "Cannot fill texture from empty image");
   const GLenum internal_format = GetTextureRepresentation(image.components, image.depth);
 
   glBindTexture(GL_TEXTURE_2D, Handle());
@@ -170,7 +189,7 @@ void Texture2D::Fill(const struct images::SimpleImage& image) {
   // Copy data to GPU:
   glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
   glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, image.width, image.height, GetTextureInputFormat(image.components),
-                  GetTextureDataType(image.depth), &image.data[0]);
+                  GetTextureDataType(image.depth), image.data);
 
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
   glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
@@ -421,6 +440,47 @@ images::SimpleImage PixelbufferQueue::PopOldestRead() {
   return output_image;
 }
 
+GpuTimerQueries::GpuTimerQueries(timing::SimpleTimer& timer, const std::size_t lag) : timer_(timer), lag_(lag) {}
+
+void GpuTimerQueries::EndFrame() {
+  ++frame_;
+  while (!pending_.empty() && pending_.front().frame + lag_ <= frame_) {
+    GLint available = 0;
+    glGetQueryObjectiv(pending_.front().query, GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available) {
+      break;  //  Results complete in order, so later queries won't be ready either.
+    }
+    CollectOldest();
+  }
+}
+
+void GpuTimerQueries::Flush() {
+  while (!pending_.empty()) {
+    CollectOldest();
+  }
+}
+
+GLuint GpuTimerQueries::AcquireQuery() {
+  if (free_queries_.empty()) {
+    GLuint query = 0;
+    glGenQueries(1, &query);
+    queries_.emplace_back(query, [](GLuint x) noexcept { glDeleteQueries(1, &x); });
+    return query;
+  }
+  const GLuint query = free_queries_.back();
+  free_queries_.pop_back();
+  return query;
+}
+
+void GpuTimerQueries::CollectOldest() {
+  const PendingQuery oldest = pending_.front();
+  pending_.pop();
+  GLuint64 elapsed_nanos = 0;
+  glGetQueryObjectui64v(oldest.query, GL_QUERY_RESULT, &elapsed_nanos);
+  timer_.Add(oldest.stage, std::chrono::nanoseconds{static_cast<std::chrono::nanoseconds::rep>(elapsed_nanos)});
+  free_queries_.push_back(oldest.query);
+}
+
 void GLAPIENTRY MessageCallback(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei, const GLchar* message,
                                 const void*) {
   fmt::print("GL error callback: source = {:X}, type = {:X}, id = {}, severity = {:X}, message = \'{}\'\n", source,
@@ -437,4 +497,9 @@ void EnableDebugOutput(int glad_version) {
   }
 }
 
+std::string RendererName() {
+  const GLubyte* const renderer = glGetString(GL_RENDERER);
+  return renderer != nullptr ? std::string{reinterpret_cast<const char*>(renderer)} : std::string{"unknown"};
+}
+
 }  // namespace gl_utils
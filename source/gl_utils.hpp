@@ -2,6 +2,7 @@
 #pragma once
 #include <array>
 #include <queue>
+#include <string>
 
 #include <glad/gl.h>
 
@@ -18,6 +19,7 @@
 
 #include "assertions.hpp"
 #include "images.hpp"
+#include "timing.hpp"
 
 // A few simple utilities to manage OpenGL resources.
 namespace gl_utils {
@@ -85,6 +87,11 @@ struct ShaderProgram : public OpenGLHandle {
 
   // Set a vector uniform:
   void SetUniformVec2(std::string_view name, glm::vec2 value) const;
+  void SetUniformIVec2(std::string_view name, glm::ivec2 value) const;
+  void SetUniformVec4(std::string_view name, glm::vec4 value) const;
+
+  // Set an array of floats:
+  void SetUniformFloatArray(std::string_view name, const float* values, GLsizei count) const;
 
   // Set a scalar uniform
   void SetUniformFloat(std::string_view name, float value) const;
@@ -100,9 +107,11 @@ ShaderProgram CompileShaderProgram(std::string_view vertex_source, std::string_v
 struct Texture2D : public OpenGLHandle {
   Texture2D();
   explicit Texture2D(const images::SimpleImage& image);
+  explicit Texture2D(const images::ImageView& image);
 
   // Fill the texture from an image.
-  void Fill(const images::SimpleImage& image);
+  void Fill(const images::SimpleImage& image) { Fill(image.View()); }
+  void Fill(const images::ImageView& image);
 };
 
 // Wrapper for cubemap texture.
@@ -206,6 +215,50 @@ struct PixelbufferQueue {
   images::ImageDepth depth_;
 };
 
+// Times sections of the GL command stream on the GPU w/ `GL_TIME_ELAPSED` queries, and adds the results to a stage of
+// a `timing::SimpleTimer`. Queries are pooled, and results are only collected once they are `lag` frames old so we
+// never stall waiting on the GPU.
+class GpuTimerQueries {
+ public:
+  explicit GpuTimerQueries(timing::SimpleTimer& timer, std::size_t lag = 3);
+
+  // Time the GL commands issued by `func` as `stage`. Queries cannot be nested.
+  template <typename Func>
+  void Record(timing::SimpleTimer::Stages stage, Func&& func) {
+    const GLuint query = AcquireQuery();
+    glBeginQuery(GL_TIME_ELAPSED, query);
+    std::invoke(std::forward<Func>(func));
+    glEndQuery(GL_TIME_ELAPSED);
+    pending_.push(PendingQuery{query, stage, frame_});
+  }
+
+  // Mark the end of a frame, and collect results that are at least `lag` frames old (if they are available).
+  void EndFrame();
+
+  // Wait for all outstanding results and collect them.
+  void Flush();
+
+ private:
+  struct PendingQuery {
+    GLuint query;
+    timing::SimpleTimer::Stages stage;
+    std::size_t frame;
+  };
+
+  // Take a query from the pool, creating one if it is empty.
+  GLuint AcquireQuery();
+
+  // Read the result of the oldest pending query into the timer (blocking if needed), and return it to the pool.
+  void CollectOldest();
+
+  timing::SimpleTimer& timer_;
+  std::size_t lag_;
+  std::size_t frame_{0};
+  std::vector<OpenGLHandle> queries_{};
+  std::vector<GLuint> free_queries_{};
+  std::queue<PendingQuery> pending_{};
+};
+
 // Get the rotation of a given cubemap face (DX convention). Returns the rotation matrix cube_R_face.
 [[maybe_unused]] inline constexpr glm::fquat GetFaceRotation(const int face) {
   const auto make_quat_xyzw = [](float x, float y, float z, float w) constexpr { return glm::fquat{w, x, y, z}; };
@@ -232,4 +285,7 @@ struct PixelbufferQueue {
 // Enable printing of opengl errors.
 void EnableDebugOutput(int glad_version);
 
+// Name of the renderer (GPU) of the current context.
+std::string RendererName();
+
 }  // namespace gl_utils
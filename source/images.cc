@@ -77,32 +77,39 @@ void FlushFunc(png_structp const ctx) {
   output_stream->flush();
 }
 
+void AppendFunc(png_structp const ctx, png_bytep const data, const png_size_t length) {
+  ASSERT(ctx);
+  std::vector<uint8_t>* const output = static_cast<std::vector<uint8_t>*>(png_get_io_ptr(ctx));
+  output->insert(output->end(), data, data + length);
+}
+
+void NoFlushFunc(png_structp) {}
+
+// Encode `image`, passing the output to `write_func` w/ `io_ptr`. `name` identifies the output in error messages.
 // We have to use libpng for this, since STB cannot write 16-bit pngs.
-void WritePng(const std::filesystem::path& path, const SimpleImage& image, const bool flip_vertical) {
+static void EncodePng(const SimpleImage& image, const bool flip_vertical, const int compression_level,
+                      const std::string& name, void* const io_ptr, const png_rw_ptr write_func,
+                      const png_flush_ptr flush_func) {
   ASSERT(!image.data.empty());
   ASSERT(image.components == 1 || image.components == 3, "Invalid # of components: {}", image.components);
   ASSERT(image.data.size() == image.Stride() * image.height, "Invalid image dims. size = {}, stride = {}, height = {}",
          image.data.size(), image.Stride(), image.height);
   ASSERT(image.depth == ImageDepth::Bits8 || image.depth == ImageDepth::Bits16, "Invalid bit depth for WritePng: {}",
          static_cast<int>(image.depth));
+  ASSERT(compression_level >= 0 && compression_level <= 9, "Invalid compression level: {}", compression_level);
 
-  const std::string path_str = path.u8string();
   png_struct* png_writer = png_create_write_struct(
-      PNG_LIBPNG_VER_STRING, const_cast<void*>(static_cast<const void*>(&path_str)), &ErrorFunc, &WarnFunc);
-  ASSERT(png_writer, "Failed to create PNG writer while writing [{}]", path_str);
+      PNG_LIBPNG_VER_STRING, const_cast<void*>(static_cast<const void*>(&name)), &ErrorFunc, &WarnFunc);
+  ASSERT(png_writer, "Failed to create PNG writer while writing [{}]", name);
 
-  png_set_compression_level(png_writer, 6);
+  png_set_compression_level(png_writer, compression_level);
 
   png_info* info = png_create_info_struct(png_writer);
   const auto cleanup = sg::make_scope_guard([&]() { png_destroy_write_struct(&png_writer, &info); });
-  ASSERT(info, "Failed to create info struct while writing [{}]", path_str);
+  ASSERT(info, "Failed to create info struct while writing [{}]", name);
 
-  // Open file handle:
-  std::ofstream output_file{path, std::ios::out | std::ios::binary};
-  ASSERT(output_file.good(), "Failed to open output file: {}", path_str);
-
-  // Configure to write to the file stream:
-  png_set_write_fn(png_writer, static_cast<void*>(&output_file), &WriteFunc, &FlushFunc);
+  // Configure to write to the output:
+  png_set_write_fn(png_writer, io_ptr, write_func, flush_func);
 
   // Setup + write header
   png_set_IHDR(png_writer, info, static_cast<png_uint_32>(image.width), static_cast<png_uint_32>(image.height),
@@ -131,9 +138,25 @@ void WritePng(const std::filesystem::path& path, const SimpleImage& image, const
   }
   png_write_image(png_writer, &row_pointers[0]);
   png_write_end(png_writer, info);
+}
+
+void WritePng(const std::filesystem::path& path, const SimpleImage& image, const bool flip_vertical,
+              const int compression_level) {
+  const std::string path_str = path.u8string();
+  std::ofstream output_file{path, std::ios::out | std::ios::binary};
+  ASSERT(output_file.good(), "Failed to open output file: {}", path_str);
+  EncodePng(image, flip_vertical, compression_level, path_str, static_cast<void*>(&output_file), &WriteFunc,
+            &FlushFunc);
   output_file.flush();
 }
 
+std::vector<uint8_t> EncodePng(const SimpleImage& image, const bool flip_vertical, const int compression_level) {
+  std::vector<uint8_t> output{};
+  EncodePng(image, flip_vertical, compression_level, "<memory>", static_cast<void*>(&output), &AppendFunc,
+            &NoFlushFunc);
+  return output;
+}
+
 SimpleImage LoadRawFloatImage(const std::filesystem::path& path, const int width, const int height,
                               const int channels) {
   std::ifstream stream(path, std::ios::in | std::ios::binary);
@@ -158,8 +181,20 @@ SimpleImage LoadRawFloatImage(const std::filesystem::path& path, const int width
   return image;
 }
 
+MappedImage MapRawImage(const std::filesystem::path& path, const int width, const int height, const int channels,
+                        const ImageDepth depth) {
+  MappedImage image{};
+  image.file = file_utils::MappedFile{path};
+  image.view = ImageView{image.file.Data(), width, height, channels, depth};
+  ASSERT(image.file.Size() == image.view.SizeBytes(),
+         "File is the wrong size. Expected = width ({}) * height ({}) * channels ({}) * {} = {}, actual = {}", width,
+         height, channels, static_cast<int>(depth), image.view.SizeBytes(), image.file.Size());
+  return image;
+}
+
 std::vector<SimpleImage> LoadCubemapImages(const std::filesystem::path& dataset_root, const std::size_t image_index,
-                                           const std::size_t camera_index, const bool parallelize) {
+                                           const std::size_t camera_index, const bool parallelize,
+                                           timing::SimpleTimer* const timer) {
   // 6 for RGB, 6 for depth
   // Having a thread pool of producers feeding the GPU would be smarter, but this is a first
   // order thing we can do to get some improvement.
@@ -175,7 +210,16 @@ std::vector<SimpleImage> LoadCubemapImages(const std::filesystem::path& dataset_
     const std::filesystem::path path = dataset_root / sub_folder / fmt::format("camera{:02}", camera_index) /
                                        fmt::format("{:08}_{:02}.png", image_index, face_index % 6);
     // 8-bit for color, 16-bit for inverse depth:
-    return images::LoadPng(path, is_depth ? ImageDepth::Bits16 : ImageDepth::Bits8);
+    const ImageDepth depth = is_depth ? ImageDepth::Bits16 : ImageDepth::Bits8;
+    if (timer == nullptr) {
+      return images::LoadPng(path, depth);
+    }
+    SimpleImage image{};
+    timer->Record(timing::SimpleTimer::Stages::Decode, image_index, [&] { image = images::LoadPng(path, depth); });
+    std::error_code err{};
+    const std::uintmax_t file_size = std::filesystem::file_size(path, err);
+    timer->AddBytes(timing::SimpleTimer::Stages::Decode, err ? 0 : file_size);
+    return image;
   };
 
   if (parallelize) {
@@ -3,6 +3,9 @@
 #include <filesystem>
 #include <optional>
 
+#include "file_utils.hpp"
+#include "timing.hpp"
+
 namespace images {
 
 // Supported bit depths.
@@ -12,6 +15,23 @@ enum class ImageDepth {
   Bits32 = 4,  //  Assumed to mean float.
 };
 
+// Non-owning view of packed image data.
+struct ImageView {
+  const uint8_t* data{nullptr};
+  int width{0};
+  int height{0};
+  int components{0};
+  ImageDepth depth{ImageDepth::Bits8};
+
+  // Length of a row in bytes.
+  [[nodiscard]] std::size_t Stride() const {
+    return static_cast<std::size_t>(width) * static_cast<std::size_t>(depth) * static_cast<std::size_t>(components);
+  }
+
+  // Total size in bytes.
+  [[nodiscard]] std::size_t SizeBytes() const { return Stride() * static_cast<std::size_t>(height); }
+};
+
 // Very simple image type.
 struct SimpleImage {
   std::vector<uint8_t> data{};
@@ -38,18 +58,40 @@ struct SimpleImage {
 
   /// Allocate data to fit.
   void Allocate() { data.resize(Stride() * static_cast<std::size_t>(height)); }
+
+  // Get a view of this image.
+  [[nodiscard]] ImageView View() const { return ImageView{data.data(), width, height, components, depth}; }
+};
+
+// An image that points directly into a read-only memory mapped file.
+struct MappedImage {
+  file_utils::MappedFile file{};
+  ImageView view{};
 };
 
 // Load a PNG image.
 SimpleImage LoadPng(const std::filesystem::path& path, ImageDepth expected_depth);
 
-// Write a PNG image.
-void WritePng(const std::filesystem::path& path, const SimpleImage& image, bool flip_vertical);
+// Write a PNG image. `compression_level` is the zlib level, from 0 (none) to 9 (smallest).
+void WritePng(const std::filesystem::path& path, const SimpleImage& image, bool flip_vertical,
+              int compression_level = 6);
+
+// Encode a PNG image in memory, exactly as `WritePng` would write it to disk.
+std::vector<uint8_t> EncodePng(const SimpleImage& image, bool flip_vertical, int compression_level = 6);
 
 // Load a float image from a raw file (no header, just packed bytes).
 // Data is expected to be in row-major order.
 SimpleImage LoadRawFloatImage(const std::filesystem::path& path, int width, int height, int channels);
 
+// Memory map a raw image (no header, just packed bytes in row-major order). No copy of the data is made, and the pages
+// are shared with any other process that maps the same file.
+MappedImage MapRawImage(const std::filesystem::path& path, int width, int height, int channels, ImageDepth depth);
+
+// Memory map a raw float image, same format as `LoadRawFloatImage`.
+inline MappedImage MapRawFloatImage(const std::filesystem::path& path, int width, int height, int channels) {
+  return MapRawImage(path, width, height, channels, ImageDepth::Bits32);
+}
+
 // Types of cubemaps:
 enum class CubemapType {
   Rgb,
@@ -57,7 +99,9 @@ enum class CubemapType {
 };
 
 // Load all the cubemap images of a given type for the specified index.
+// If `timer` is specified, the decode time of each face is recorded in it.
 std::vector<SimpleImage> LoadCubemapImages(const std::filesystem::path& dataset_root, std::size_t image_index,
-                                           std::size_t camera_index, bool parallelize = false);
+                                           std::size_t camera_index, bool parallelize = false,
+                                           timing::SimpleTimer* timer = nullptr);
 
 }  // namespace images
@@ -0,0 +1,47 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <list>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "assertions.hpp"
+
+// Keeps the `capacity` most recently used values, keyed by string. Not thread safe.
+template <typename T>
+class LruCache {
+ public:
+  explicit LruCache(const std::size_t capacity) : capacity_(capacity) {
+    ASSERT(capacity_ > 0, "Cache capacity must be positive");
+  }
+
+  // Get the value for `key`, or create it w/ `create()` (evicting the least recently used value if the cache is full).
+  // The reference is valid until the value is evicted.
+  template <typename F>
+  T& GetOrCreate(const std::string& key, F&& create) {
+    for (auto it = entries_.begin(); it != entries_.end(); ++it) {
+      if (it->first == key) {
+        entries_.splice(entries_.begin(), entries_, it);
+        ++num_hits_;
+        return *entries_.front().second;
+      }
+    }
+    ++num_misses_;
+    if (entries_.size() == capacity_) {
+      entries_.pop_back();
+    }
+    entries_.emplace_front(key, std::make_unique<T>(create()));
+    return *entries_.front().second;
+  }
+
+  [[nodiscard]] std::size_t Size() const { return entries_.size(); }
+  [[nodiscard]] std::size_t NumHits() const { return num_hits_; }
+  [[nodiscard]] std::size_t NumMisses() const { return num_misses_; }
+
+ private:
+  std::size_t capacity_;
+  // Most recently used first. Values are heap allocated, so references survive re-ordering.
+  std::list<std::pair<std::string, std::unique_ptr<T>>> entries_{};
+  std::size_t num_hits_{0};
+  std::size_t num_misses_{0};
+};
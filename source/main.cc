@@ -1,10 +1,23 @@
 // Copyright 2023 Gareth Cross
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cstdlib>
+#include <deque>
+#include <exception>
 #include <filesystem>
+#include <functional>
 #include <future>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <mutex>
 #include <optional>
 #include <queue>
+#include <sstream>
+#include <thread>
+#include <utility>
 #include <variant>
 
 #include <glad/gl.h>
@@ -12,11 +25,27 @@
 #include <GLFW/glfw3.h>
 #include <fmt/format.h>
 #include <CLI/CLI.hpp>
+#include <scope_guard.hpp>
 
 #include "assertions.hpp"
+#include "bottleneck.hpp"
+#include "camera_models.hpp"
+#include "converter.hpp"
+#include "coordinator.hpp"
+#include "cpu_engine.hpp"
+#include "file_utils.hpp"
 #include "gl_utils.hpp"
+#include "frame_source.hpp"
+#include "frame_watcher.hpp"
 #include "images.hpp"
+#include "lru_cache.hpp"
+#include "manifest.hpp"
+#include "memory_tracking.hpp"
+#include "remap_table.hpp"
+#include "run_report.hpp"
+#include "shm_ring.hpp"
 #include "timing.hpp"
+#include "unix_socket.hpp"
 
 // Include all the shaders, which we generate from the files in `shaders/*.glsl`
 #include "shaders/fragment_display.hpp"
@@ -31,61 +60,258 @@ static void glfw_error_callback(int error, const char* description) {
 struct ProgramArgs {
   std::string input_path;
   std::string output_path;
-  std::size_t num_images;
+  std::size_t num_images{0};
+  // Frames to convert: start_index, start_index + stride, ... up to (not including) end_index. Of those, this process
+  // converts every `num_shards`-th one, starting w/ the `shard_index`-th.
+  std::size_t start_index{0};
+  std::size_t end_index{std::numeric_limits<std::size_t>::max()};
+  std::size_t stride{1};
+  std::size_t shard_index{0};
+  std::size_t num_shards{1};
+  // If set, frames are handed out by the coordinator listening on this socket instead.
+  std::string coordinator_socket;
+  // Convert the selected frames as they are written to the input dataset.
+  bool watch{false};
+  std::size_t watch_settle_ms{500};
+  std::size_t watch_timeout_s{600};
+  // If set, frames are read from this shared memory ring instead of the input dataset.
+  std::string shm_ring;
+  // Skip frames the output manifest records as finished.
+  bool resume{false};
+  // Write outputs durably, and record them in the output manifest (implied by `resume`).
+  bool manifest{false};
   std::size_t camera_index;
   std::string table_path;
-  int table_width;
-  int table_height;
+  int table_width{0};
+  int table_height{0};
+  int table_stride{1};
+  std::string table_interpolation{"bicubic"};
+  std::string table_encoding{"float32"};
+  bool verify_table{false};
+  std::string camera_model;
+  std::vector<float> intrinsics;
+  std::vector<float> distortion;
   bool enable_gl_debug;
+  std::string trace_path;
+  std::string report_path;
+  bool perf_counters{false};
+  std::size_t memory_budget_mb{0};
   std::string valid_mask_path;
+  std::string engine{"gl"};
+  std::size_t num_cpu_threads{std::thread::hardware_concurrency()};
+  std::size_t num_writer_threads{8};
+  std::size_t prefetch_depth{0};
+  bool null_output{false};
+  // If set, run as a daemon that converts the jobs it receives on this socket.
+  std::string daemon_socket;
+  // Number of remap tables (w/ their masks, and the CPU engines built from them) the daemon keeps loaded.
+  std::size_t daemon_cache_size{4};
 };
 
-// Parse program arts, or fail and return exit code.
-std::variant<ProgramArgs, int> ParseProgramArgs(int argc, char** argv) {
+// Parse program args (w/o the program name), or fail and return exit code. Help and errors are printed to `out` and
+// `err`.
+std::variant<ProgramArgs, int> ParseProgramArgs(std::vector<std::string> arguments, std::ostream& out,
+                                                std::ostream& err) {
   CLI::App app{"Cubemap converter"};
   ProgramArgs args{};
   try {
-    app.add_option("-i,--input-path", args.input_path, "Path to the input dataset.")->required();
+    // These are required, unless running as a daemon:
+    CLI::Option* const input_option = app.add_option("-i,--input-path", args.input_path, "Path to the input dataset.");
     app.add_option("-o,--output-path", args.output_path, "Path to the output directory.");
-    app.add_option("--num-images", args.num_images, "Num images in the dataset.")->required();
-    app.add_option("-c,--camera-index", args.camera_index, "Index of the camera to render.")->required();
-    app.add_option("-t,--remap-table", args.table_path, "Path to the remap table.")->required();
-    app.add_option("--width", args.table_width, "Width of the native image.")->required();
-    app.add_option("--height", args.table_height, "Height of the native image.")->required();
+    CLI::Option* const num_images_option =
+        app.add_option("--num-images", args.num_images, "Num images in the dataset.");
+    CLI::Option* const camera_option =
+        app.add_option("-c,--camera-index", args.camera_index, "Index of the camera to render.");
+    app.add_option("--start-index", args.start_index, "Index of the first frame to convert.");
+    app.add_option("--end-index", args.end_index, "Convert frames before this index. Defaults to --num-images.");
+    app.add_option("--stride", args.stride, "Convert every N-th frame, starting from --start-index.")
+        ->check(CLI::PositiveNumber);
+    std::string shard{};
+    app.add_option("--shard", shard,
+                   "Convert shard k/n (zero based) of the selected frames: every n-th frame, starting w/ the k-th. "
+                   "Processes w/ different shards can write to the same output directory.");
+    app.add_option("--coordinator", args.coordinator_socket,
+                   "Convert the frames handed out by a `cubemap_coordinator` listening on this socket, instead of "
+                   "the frames selected w/ --start-index, --end-index, --stride and --shard.");
+    app.add_flag("--watch", args.watch,
+                 "Convert the selected frames as they appear in the input dataset, eg. while it is being rendered.");
+    app.add_option("--watch-settle-ms", args.watch_settle_ms,
+                   "W/ --watch, a face that was not renamed into place is complete once its size did not change for "
+                   "this long.");
+    app.add_option("--watch-timeout", args.watch_timeout_s,
+                   "W/ --watch, stop once no new faces appeared for this many seconds. Zero waits forever.");
+    app.add_option("--shm-ring", args.shm_ring,
+                   "Convert the frames a producer publishes to this POSIX shared memory ring (eg. /cubemap_ring), "
+                   "instead of reading PNG files. --input-path and --num-images are not required.");
+    app.add_flag("--resume", args.resume,
+                 "Skip frames that the output manifest records as finished, eg. to continue an interrupted run. "
+                 "Implies --manifest.");
+    app.add_flag("--manifest", args.manifest,
+                 "Flush each output to disk, and then record it in the output manifest, so that a later run can "
+                 "--resume. Slower than writing w/o it.");
+    app.add_option("-t,--remap-table", args.table_path, "Path to the remap table.");
+    app.add_option("--width", args.table_width,
+                   "Width of the native image. Optional for remap tables w/ a header, which store it.");
+    app.add_option("--height", args.table_height,
+                   "Height of the native image. Optional for remap tables w/ a header, which store it.");
+    app.add_option("--table-stride", args.table_stride,
+                   "Spacing in pixels of raw remap table samples. Tables w/ stride > 1 are interpolated.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--table-interpolation", args.table_interpolation,
+                   "Interpolation of coarse remap tables: bilinear or bicubic.")
+        ->check(CLI::IsMember({"bilinear", "bicubic"}));
+    app.add_option("--table-encoding", args.table_encoding,
+                   "How rays are stored in a raw remap table: float32 (xyz) or oct16 (octahedral, 2x uint16).")
+        ->check(CLI::IsMember({"float32", "oct16"}));
+    app.add_flag("--verify-table", args.verify_table,
+                 "Check the checksums of every section of the remap table when it is opened, not just the header. "
+                 "Reads the whole table.");
+    app.add_option("--camera-model", args.camera_model,
+                   "Compute rays from a camera model instead of a remap table: fisheye or brown-conrady.")
+        ->check(CLI::IsMember({"fisheye", "brown-conrady"}));
+    app.add_option("--intrinsics", args.intrinsics, "Camera matrix of the camera model: fx,fy,cx,cy.")
+        ->expected(4)
+        ->delimiter(',');
+    app.add_option("--distortion", args.distortion,
+                   "Distortion of the camera model: k1,k2,k3,k4 (fisheye) or k1,k2,p1,p2,k3 (brown-conrady).")
+        ->delimiter(',');
     app.add_flag("--debug", args.enable_gl_debug, "Enable OpenGL debug log (v4.3 or higher).");
+    app.add_option("--trace", args.trace_path,
+                   "Write a timeline of the pipeline stages to this file (Chrome trace format, open in Perfetto).");
+    app.add_option("--report", args.report_path,
+                   "Write a JSON summary of the run (config, hardware, throughput, stage percentiles, memory).");
+    app.add_flag("--perf-counters", args.perf_counters,
+                 "Measure hardware counters (cycles, instructions, cache and branch misses) per stage. Linux only.");
+    app.add_option("--memory-budget-mb", args.memory_budget_mb,
+                   "Warn when the image memory held by the pipeline exceeds this many megabytes.");
     app.add_option("--mask", args.valid_mask_path, "Optional valid mask image (png).");
-    app.parse(argc, argv);
+    app.add_option("--engine", args.engine,
+                   "Engine to convert with: gl, cpu, or hybrid (both at once, each taking the next frame when free).")
+        ->check(CLI::IsMember({"gl", "cpu", "hybrid"}));
+    app.add_option("--cpu-threads", args.num_cpu_threads, "Number of threads used by the cpu engine.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--writer-threads", args.num_writer_threads, "Max number of frames being encoded at once.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--prefetch-depth", args.prefetch_depth,
+                   "Number of frames to load ahead of the one being rendered. Zero loads each frame when needed.");
+    app.add_flag("--null-output", args.null_output,
+                 "Encode the outputs, but discard them instead of writing files. Isolates compute from disk.");
+    app.add_option("--daemon", args.daemon_socket,
+                   "Run as a daemon: keep the OpenGL context, shaders and recently used remap tables loaded, and "
+                   "convert the jobs received on this Unix socket. No other arguments are required.");
+    app.add_option("--daemon-cache-size", args.daemon_cache_size,
+                   "Number of remap tables (and masks) the daemon keeps loaded.")
+        ->check(CLI::PositiveNumber);
+    // CLI11 expects the arguments in reverse order:
+    std::reverse(arguments.begin(), arguments.end());
+    app.parse(arguments);
+    if (!args.daemon_socket.empty()) {
+      return args;
+    }
+    for (const CLI::Option* option : {input_option, num_images_option, camera_option}) {
+      // The producer of a ring decides which frames we get:
+      if (option->count() == 0 && (args.shm_ring.empty() || option == camera_option)) {
+        throw CLI::RequiredError(option->get_name());
+      }
+    }
+    args.end_index = std::min(args.end_index, args.num_images);
+    if (args.shm_ring.empty() && args.start_index >= args.end_index) {
+      throw CLI::ValidationError(fmt::format("No frames to convert: --start-index = {}, end = {}", args.start_index,
+                                             args.end_index));
+    }
+    if (!shard.empty()) {
+      const std::size_t slash = shard.find('/');
+      try {
+        if (slash == std::string::npos) {
+          throw std::invalid_argument("missing /");
+        }
+        args.shard_index = std::stoul(shard.substr(0, slash));
+        args.num_shards = std::stoul(shard.substr(slash + 1));
+      } catch (const std::logic_error&) {
+        throw CLI::ValidationError(fmt::format("--shard must be of the form k/n, got: {}", shard));
+      }
+      if (args.num_shards == 0 || args.shard_index >= args.num_shards) {
+        throw CLI::ValidationError(fmt::format("Invalid shard: {} (expected 0 <= k < n).", shard));
+      }
+    }
+    if (args.watch && !args.coordinator_socket.empty()) {
+      throw CLI::ValidationError("--watch cannot be combined w/ --coordinator.");
+    }
+    if (!args.shm_ring.empty() && (args.watch || !args.coordinator_socket.empty() || args.resume)) {
+      throw CLI::ValidationError("--shm-ring cannot be combined w/ --watch, --coordinator or --resume.");
+    }
+    args.manifest = args.manifest || args.resume;
+    if (args.manifest && (args.output_path.empty() || args.null_output)) {
+      throw CLI::ValidationError(
+          "--resume and --manifest require an --output-path, and cannot be combined w/ --null-output.");
+    }
+    if (args.table_path.empty() == args.camera_model.empty()) {
+      throw CLI::ValidationError("Specify exactly one of --remap-table or --camera-model.");
+    }
+    if (!args.camera_model.empty()) {
+      const std::size_t num_coeffs = args.camera_model == "fisheye" ? 4 : 5;
+      if (args.intrinsics.size() != 4 || args.distortion.size() != num_coeffs) {
+        throw CLI::ValidationError(
+            fmt::format("Camera model `{}` requires 4 intrinsics and {} distortion coefficients.", args.camera_model,
+                        num_coeffs));
+      }
+    }
+    if (!args.table_path.empty() && remap_table::IsRemapTableFile(args.table_path)) {
+      // The table describes itself, so we only check the dimensions if they were specified:
+      const remap_table::FileHeader header = remap_table::ReadHeader(args.table_path);
+      if ((args.table_width != 0 && args.table_width != static_cast<int>(header.width)) ||
+          (args.table_height != 0 && args.table_height != static_cast<int>(header.height))) {
+        throw CLI::ValidationError(fmt::format("Dimensions [{}, {}] do not match the remap table: [{}, {}]",
+                                               args.table_width, args.table_height, header.width, header.height));
+      }
+      args.table_width = static_cast<int>(header.width);
+      args.table_height = static_cast<int>(header.height);
+      args.table_stride = static_cast<int>(header.stride);
+      args.table_encoding =
+          header.encoding == static_cast<uint32_t>(cpu_engine::TableEncoding::Oct16) ? "oct16" : "float32";
+    } else if (args.table_width <= 0 || args.table_height <= 0) {
+      throw CLI::ValidationError("--width and --height are required, unless the remap table has a header.");
+    }
   } catch (const CLI::ParseError& e) {
-    return app.exit(e);
+    return app.exit(e, out, err);
   } catch (const CLI::Error& e) {
-    fmt::print("Some other exception: {}", e.what());
+    err << "Some other exception: " << e.what() << "\n";
     return 1;
   }
   return args;
 }
 
-gl_utils::Texture2D LoadValidMask(const std::string& mask_path, const int table_width, const int table_height) {
-  gl_utils::Texture2D texture{};
-  if (mask_path.empty()) {
-    // No mask, just put a white image in (valid everywhere).
-    images::SimpleImage white_image{table_width, table_height, 1, images::ImageDepth::Bits8};
-    std::fill(white_image.data.begin(), white_image.data.end(), 255);
-    texture.Fill(white_image);
-  } else {
-    std::optional<images::SimpleImage> mask_image = images::LoadPng(mask_path, images::ImageDepth::Bits8);
-    ASSERT(mask_image.has_value(), "Could not load valid mask from: {}", mask_path);
-    ASSERT(mask_image->width == table_width && mask_image->height == table_height,
-           "Remap table and valid mask do not share the same dimensions. mask = [{}, {}], table = [{}, {}]",
-           mask_image->width, mask_image->height, table_width, table_height);
-    texture.Fill(*mask_image);
-  }
-  return texture;
+// The camera tables specified on the command line.
+converter::CameraTables GetCameraTables(const ProgramArgs& args) {
+  converter::CameraTables tables{};
+  tables.table_path = args.table_path;
+  tables.width = args.table_width;
+  tables.height = args.table_height;
+  tables.table_stride = args.table_stride;
+  tables.table_encoding =
+      args.table_encoding == "oct16" ? cpu_engine::TableEncoding::Oct16 : cpu_engine::TableEncoding::Float32;
+  tables.table_interpolation = args.table_interpolation == "bicubic" ? cpu_engine::TableInterpolation::Bicubic
+                                                                     : cpu_engine::TableInterpolation::Bilinear;
+  if (!args.camera_model.empty()) {
+    camera_models::CameraIntrinsics& intrinsics = tables.camera_model;
+    intrinsics.model = camera_models::ParseCameraModel(args.camera_model);
+    intrinsics.fx = args.intrinsics[0];
+    intrinsics.fy = args.intrinsics[1];
+    intrinsics.cx = args.intrinsics[2];
+    intrinsics.cy = args.intrinsics[3];
+    std::copy(args.distortion.begin(), args.distortion.end(), intrinsics.coeffs.begin());
+  }
+  tables.valid_mask_path = args.valid_mask_path;
+  tables.verify_table = args.verify_table;
+  return tables;
 }
 
 // A poor man's thread pool.
+// If a timer is provided, time spent blocked waiting for a task to finish is recorded as `WaitWriters`. Each task runs
+// on a new thread, so in the trace of the timer it borrows a "writer" lane instead of getting a lane of its own.
 template <typename T>
 struct TaskQueue {
-  explicit TaskQueue(std::size_t max) : max_items(max){};
+  explicit TaskQueue(std::size_t max, timing::SimpleTimer* timer = nullptr) : max_items(max), timer(timer){};
 
   // Push new task into the queue.
   template <typename Function>
@@ -93,9 +319,13 @@ struct TaskQueue {
     if (pending.size() == max_items) {
       std::future<T> front = std::move(pending.front());
       pending.pop();
-      front.wait();
+      Wait(front);
     }
-    pending.push(std::async(std::launch::async, std::forward<Function>(func)));
+    timing::TraceRecorder* const trace = timer != nullptr ? timer->Trace() : nullptr;
+    pending.push(std::async(std::launch::async, [trace, func = std::forward<Function>(func)]() mutable {
+      const timing::ScopedLane lane{trace, "writer"};
+      return func();
+    }));
   }
 
   // Clear the queue of tasks.
@@ -103,14 +333,31 @@ struct TaskQueue {
     while (!pending.empty()) {
       std::future<T> front = std::move(pending.front());
       pending.pop();
-      front.wait();
+      Wait(front);
+    }
+  }
+
+  // Wait for a task, and rethrow its exception if it failed.
+  void Wait(std::future<T>& future) const {
+    if (timer != nullptr) {
+      timer->Record(timing::SimpleTimer::Stages::WaitWriters, [&] { future.wait(); });
+    } else {
+      future.wait();
     }
+    future.get();
   }
 
   std::queue<std::future<T>> pending{};
   std::size_t max_items;
+  timing::SimpleTimer* timer;
 };
 
+// Number of threads decoding the cubemap faces of a frame in parallel (see `LoadCubemapImages`).
+std::size_t NumDecodeThreads() {
+  constexpr std::size_t num_faces = 12;
+  return std::clamp<std::size_t>(std::thread::hardware_concurrency(), 1, num_faces);
+}
+
 void CreateOrAssert(const std::filesystem::path& path) {
   std::error_code err{};
   // Recursively create directories:
@@ -118,62 +365,407 @@ void CreateOrAssert(const std::filesystem::path& path) {
   ASSERT(created || !err, "Failed to create directory: `{}`. Error = {}", path.u8string(), err.message());
 }
 
-void ExecuteMainLoop(const ProgramArgs& args, GLFWwindow* const window) {
+// Directories we write outputs into.
+struct OutputDirectories {
+  // Create directories for the outputs (if the user specified a path, and is not discarding the outputs), and open
+  // the manifest of finished frames (w/ `--manifest` or `--resume`).
+  explicit OutputDirectories(const ProgramArgs& args) : null_output(args.null_output) {
+    const std::filesystem::path output_root{args.output_path};
+    rgb = output_root / "image" / fmt::format("camera{:02}", args.camera_index);
+    inv_range = output_root / "range" / fmt::format("camera{:02}", args.camera_index);
+    enabled = null_output || !args.output_path.empty();
+    if (enabled && !null_output) {
+      CreateOrAssert(rgb);
+      CreateOrAssert(inv_range);
+    }
+    if (enabled && args.manifest) {
+      CreateOrAssert(output_root / "manifest");
+      manifest = std::make_unique<manifest::OutputManifest>(output_root / "manifest" /
+                                                            fmt::format("camera{:02}.txt", args.camera_index));
+    }
+  }
+
+  // Write the outputs for frame `index`. Images are in framebuffer (bottom-up) row order.
+  // The time taken and the bytes written are recorded as the `Encode` stage of `timer`. W/ `--null-output` the images
+  // are encoded in memory and discarded. W/ a manifest, both files are flushed to disk and then the frame is added to
+  // the manifest. Otherwise the files are written w/o waiting for the disk.
+  void Write(const std::size_t index, const images::SimpleImage& rgb_image, const images::SimpleImage& inv_range_image,
+             timing::SimpleTimer& timer) const {
+    const std::filesystem::path rgb_path = rgb / fmt::format("{:08}.png", index);
+    const std::filesystem::path inv_range_path = inv_range / fmt::format("{:08}.png", index);
+    std::size_t num_bytes = 0;
+    timer.Record(timing::SimpleTimer::Stages::Encode, index, [&] {
+      if (null_output || manifest) {
+        const std::vector<uint8_t> rgb_png = images::EncodePng(rgb_image, true);
+        const std::vector<uint8_t> inv_range_png = images::EncodePng(inv_range_image, true);
+        num_bytes = rgb_png.size() + inv_range_png.size();
+        if (manifest) {
+          file_utils::WriteFileDurably(rgb_path, rgb_png.data(), rgb_png.size());
+          file_utils::WriteFileDurably(inv_range_path, inv_range_png.data(), inv_range_png.size());
+          manifest->Append(index);
+        }
+      } else {
+        images::WritePng(rgb_path, rgb_image, true);
+        images::WritePng(inv_range_path, inv_range_image, true);
+        std::error_code err{};
+        for (const std::filesystem::path& path : {rgb_path, inv_range_path}) {
+          const std::uintmax_t file_size = std::filesystem::file_size(path, err);
+          num_bytes += err ? 0 : static_cast<std::size_t>(file_size);
+        }
+      }
+    });
+    timer.AddBytes(timing::SimpleTimer::Stages::Encode, num_bytes);
+  }
+
+  std::filesystem::path rgb;
+  std::filesystem::path inv_range;
+  // True if outputs should be written (or encoded and discarded).
+  bool enabled{false};
+  bool null_output{false};
+  // Frames whose outputs were written completely. Null unless writing files w/ `--manifest` (or `--resume`).
+  std::unique_ptr<manifest::OutputManifest> manifest{};
+};
+
+// Where the frames this process converts come from: a coordinator, a shared memory ring, or the selection on the
+// command line (in order, or as the frames are written w/ `--watch`). W/ `--resume`, frames the manifest records as
+// finished are skipped.
+std::unique_ptr<FrameSource> MakeFrameSource(const ProgramArgs& args, const OutputDirectories& output_dirs) {
+  std::unique_ptr<FrameSource> source{};
+  if (!args.shm_ring.empty()) {
+    source = std::make_unique<shm_ring::RingFrameSource>(args.shm_ring);
+  } else if (!args.coordinator_socket.empty()) {
+    source = std::make_unique<coordinator::CoordinatorClient>(args.coordinator_socket);
+  } else if (args.watch) {
+    source = std::make_unique<FrameWatcher>(
+        args.input_path, args.camera_index,
+        SelectFrames(args.start_index, args.end_index, args.stride, args.shard_index, args.num_shards),
+        std::chrono::milliseconds(args.watch_settle_ms), std::chrono::seconds(args.watch_timeout_s));
+  } else {
+    source = std::make_unique<FrameListSource>(
+        SelectFrames(args.start_index, args.end_index, args.stride, args.shard_index, args.num_shards));
+  }
+  if (!args.resume) {
+    return source;
+  }
+  const manifest::OutputManifest& finished = *output_dirs.manifest;
+  fmt::print("Resuming: the manifest records {} finished frames, which are skipped.\n", finished.Size());
+  return std::make_unique<SkippingFrameSource>(
+      std::move(source), [&finished](const std::size_t index) { return finished.Contains(index); });
+}
+
+// The cubemap faces of a frame, and the memory they are tracked under.
+struct LoadedFrame {
+  std::size_t index;
+  std::vector<images::SimpleImage> faces;
+  memory_tracking::TrackedBytes memory;
+};
+
+// Loads frames ahead of the one being rendered, so that decoding overlaps w/ rendering and encoding.
+// W/ a depth of zero, each frame is loaded on the calling thread when requested. Time spent waiting for a frame is
+// recorded as the `Load` stage. Frames of a shared memory ring were already copied out of the ring by the source, so
+// they are taken from it instead of being decoded. `Next` may be called from several threads at once (eg. by both
+// engines of the hybrid engine), and each frame is handed to one of them.
+class FramePrefetcher {
+ public:
+  FramePrefetcher(const ProgramArgs& args, FrameSource& source, timing::SimpleTimer& timer,
+                  memory_tracking::MemoryTracker& memory)
+      : dataset_(args.input_path),
+        camera_index_(args.camera_index),
+        source_(source),
+        ring_(dynamic_cast<shm_ring::RingFrameSource*>(&source)),
+        depth_(args.prefetch_depth),
+        timer_(timer),
+        memory_(memory) {}
+
+  // Get the faces of the next frame, and start loading the frames after it. Returns nullopt once the source is done.
+  // If the source has nothing for us right now (eg. the coordinator is waiting for frames to finish), `on_wait` is
+  // called before waiting, so the caller can finish any frames it is holding on to.
+  template <typename F>
+  std::optional<LoadedFrame> Next(F&& on_wait) {
+    for (;;) {
+      std::unique_lock<std::mutex> lock{mutex_};
+      if (stopped_) {
+        return std::nullopt;
+      }
+      Fill();
+      if (!pending_.empty()) {
+        auto [index, future] = std::move(pending_.front());
+        pending_.pop_front();
+        // Other callers can take the frames behind this one while we wait for it:
+        lock.unlock();
+        std::optional<LoadedFrame> frame{};
+        timer_.Record(timing::SimpleTimer::Stages::Load, index, [&] { frame.emplace(future.get()); });
+        return frame;
+      }
+      if (source_.Done()) {
+        return std::nullopt;
+      }
+      lock.unlock();
+      on_wait();
+      std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+  }
+
+  // Stop handing out frames, eg. once the window was closed.
+  void Stop() {
+    const std::lock_guard<std::mutex> lock{mutex_};
+    stopped_ = true;
+  }
+
+ private:
+  // Request frames from the source until `depth` frames are queued behind the next one.
+  void Fill() {
+    while (pending_.size() <= depth_) {
+      const std::optional<std::size_t> index = source_.Next();
+      if (!index) {
+        return;
+      }
+      if (depth_ == 0) {
+        pending_.emplace_back(*index, std::async(std::launch::deferred, [this, i = *index] { return Load(i); }));
+        continue;
+      }
+      // Each frame is loaded on a new thread, which borrows a "prefetch" lane of the trace:
+      pending_.emplace_back(*index, std::async(std::launch::async, [this, i = *index] {
+        const timing::ScopedLane lane{timer_.Trace(), "prefetch"};
+        return Load(i);
+      }));
+    }
+  }
+
+  LoadedFrame Load(const std::size_t index) const {
+    std::vector<images::SimpleImage> faces =
+        ring_ ? ring_->TakeFaces(index) : images::LoadCubemapImages(dataset_, index, camera_index_, true, &timer_);
+    memory_tracking::TrackedBytes memory =
+        memory_.Track(memory_tracking::Owner::Faces, memory_tracking::ImageBytes(faces));
+    return LoadedFrame{index, std::move(faces), std::move(memory)};
+  }
+
+  std::filesystem::path dataset_;
+  std::size_t camera_index_;
+  FrameSource& source_;
+  shm_ring::RingFrameSource* ring_;
+  std::size_t depth_;
+  timing::SimpleTimer& timer_;
+  memory_tracking::MemoryTracker& memory_;
+  // Guards the source and the frames being loaded.
+  std::mutex mutex_{};
+  std::deque<std::pair<std::size_t, std::future<LoadedFrame>>> pending_{};
+  bool stopped_{false};
+};
+
+// Options of a run that affect its performance, for the report.
+std::vector<std::pair<std::string, std::string>> DescribeConfig(const ProgramArgs& args) {
+  return {{"engine", args.engine},
+          {"input_path", args.input_path},
+          {"output_path", args.output_path},
+          {"num_images", std::to_string(args.num_images)},
+          {"start_index", std::to_string(args.start_index)},
+          {"end_index", std::to_string(args.end_index)},
+          {"stride", std::to_string(args.stride)},
+          {"shard", fmt::format("{}/{}", args.shard_index, args.num_shards)},
+          {"coordinator", args.coordinator_socket},
+          {"watch", args.watch ? "true" : "false"},
+          {"shm_ring", args.shm_ring},
+          {"resume", args.resume ? "true" : "false"},
+          {"manifest", args.manifest ? "true" : "false"},
+          {"camera_index", std::to_string(args.camera_index)},
+          {"remap_table", args.table_path},
+          {"camera_model", args.camera_model},
+          {"width", std::to_string(args.table_width)},
+          {"height", std::to_string(args.table_height)},
+          {"table_stride", std::to_string(args.table_stride)},
+          {"table_interpolation", args.table_interpolation},
+          {"table_encoding", args.table_encoding},
+          {"verify_table", args.verify_table ? "true" : "false"},
+          {"cpu_threads", std::to_string(args.num_cpu_threads)},
+          {"writer_threads", std::to_string(args.num_writer_threads)},
+          {"prefetch_depth", std::to_string(args.prefetch_depth)},
+          {"null_output", args.null_output ? "true" : "false"}};
+}
+
+// Print the summaries of a finished run, then write the report and the trace (if requested).
+void FinishRun(const ProgramArgs& args, const timing::RunInfo& info, const timing::PipelineShape& shape,
+               const timing::SimpleTimer& timer, const memory_tracking::MemoryTracker& memory,
+               const timing::TraceRecorder& trace) {
+  timer.Summarize();
+  timer.SummarizeCounters(info.num_output_pixels);
+  memory.Summarize();
+  const timing::BottleneckReport bottlenecks = timing::AnalyzeBottlenecks(timer, shape, info.wall_seconds);
+  timing::PrintBottleneckReport(bottlenecks);
+  if (!args.report_path.empty()) {
+    timing::WriteRunReport(args.report_path, info, timer, memory, bottlenecks);
+    fmt::print("Wrote report to: {}\n", args.report_path);
+  }
+  if (!args.trace_path.empty()) {
+    trace.Write(args.trace_path);
+    fmt::print("Wrote trace to: {}\n", args.trace_path);
+  }
+}
+
+// Called after each frame is rendered, w/ the number of frames rendered so far.
+using ProgressCallback = std::function<void(std::size_t)>;
+
+// Run the conversion on the CPU w/ `engine`. No OpenGL context is required. Returns the number of frames rendered.
+std::size_t ExecuteCpuLoop(const ProgramArgs& args, const cpu_engine::CpuEngine& engine,
+                           const ProgressCallback& progress) {
+  const OutputDirectories output_dirs{args};
+
+  // Declared before the writers, which record into them.
+  memory_tracking::MemoryTracker memory{};
+  memory.SetBudget(args.memory_budget_mb * 1024 * 1024);
+  timing::TraceRecorder trace{};
+  timing::SimpleTimer timer{};
+  if (!args.trace_path.empty()) {
+    trace.NameCurrentThread("main");
+    timer.SetTrace(&trace);
+  }
+  if (args.perf_counters && !timer.EnableHardwareCounters()) {
+    fmt::print("Hardware counters are not available (check /proc/sys/kernel/perf_event_paranoid).\n");
+  }
+
+  // Declared before the writers, which report finished frames to it.
+  const std::unique_ptr<FrameSource> source = MakeFrameSource(args, output_dirs);
+  FramePrefetcher prefetcher{args, *source, timer, memory};
+
+  // Queue of tasks for writing images (poor man's thread pool).
+  TaskQueue<void> write_queue(args.num_writer_threads, &timer);
+
+  const auto start = std::chrono::steady_clock::now();
+  std::size_t num_rendered = 0;
+  while (std::optional<LoadedFrame> frame = prefetcher.Next([] {})) {
+    const std::size_t index = frame->index;
+
+    images::SimpleImage rgb{};
+    images::SimpleImage inv_range{};
+    timer.Record(timing::SimpleTimer::Stages::Render, index, [&] { engine.Render(frame->faces, rgb, inv_range); });
+    frame.reset();
+
+    if (output_dirs.enabled) {
+      timer.Record(timing::SimpleTimer::Stages::Write, index, [&] {
+        memory_tracking::TrackedBytes backlog =
+            memory.Track(memory_tracking::Owner::EncoderBacklog, rgb.data.size() + inv_range.data.size());
+        write_queue.Push([index, rgb = std::move(rgb), inv_range = std::move(inv_range), backlog = std::move(backlog),
+                          &output_dirs, &timer, &source] {
+          output_dirs.Write(index, rgb, inv_range, timer);
+          source->Finished(index);
+        });
+      });
+    } else {
+      source->Finished(index);
+    }
+    memory.EndFrame();
+    ++num_rendered;
+    if (progress) {
+      progress(num_rendered);
+    }
+  }
+
+  write_queue.Flush();  // Wait for writing to complete.
+  const std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start;
+  fmt::print("Processed {} images.\n", num_rendered);
+  FinishRun(args,
+            timing::RunInfo{DescribeConfig(args), "", num_rendered, num_rendered * engine.Width() * engine.Height(),
+                            wall_time.count()},
+            timing::PipelineShape{NumDecodeThreads(), args.num_writer_threads, false}, timer, memory, trace);
+  return num_rendered;
+}
+
+// Shaders and geometry, which do not depend on the conversion. Requires a current OpenGL context.
+struct GlPrograms {
+  // Create shader for building native image:
+  gl_utils::ShaderProgram cubemap_shader_program =
+      gl_utils::CompileShaderProgram(shaders::vertex, shaders::fragment_oversampled_cubemap);
+
+  // Create shader for displaying the native image in the UI:
+  gl_utils::ShaderProgram display_program = gl_utils::CompileShaderProgram(shaders::vertex, shaders::fragment_display);
+
+  // A VBO w/ a quad we can draw to fill the screen:
+  gl_utils::FullScreenQuad quad{};
+};
+
+// The camera rays (if they come from a table) and the valid mask, uploaded to the GPU.
+struct GlCameraTables {
+  std::optional<gl_utils::Texture2D> remap_table;
+  // How to sample `remap_table`. The `table` view is not valid after the upload.
+  cpu_engine::RemapTableRays remap_table_rays;
+  gl_utils::Texture2D valid_mask;
+};
+
+GlCameraTables UploadCameraTables(const ProgramArgs& args) {
   ASSERT(args.table_width > 0 && args.table_height > 0, "Dimensions must be positive: w={}, h={}", args.table_width,
          args.table_height);
 
-  // Path to the input directory:
-  const std::filesystem::path dataset{args.input_path};
+  // Map the remap table. The file is shared read-only w/ any other converters running on this machine, and we
+  // upload straight out of the mapping rather than reading it into memory first.
+  // When using a camera model there is no table at all - the shader computes the rays.
+  std::optional<remap_table::RemapTableFile> remap_table_file{};
+  std::optional<gl_utils::Texture2D> remap_table{};
+  cpu_engine::RemapTableRays remap_table_rays{};
+  const converter::CameraTables camera_tables = GetCameraTables(args);
+  if (args.camera_model.empty()) {
+    remap_table_file.emplace(converter::MapRemapTable(camera_tables));
+    remap_table_rays = converter::GetRemapTableRays(camera_tables, *remap_table_file);
+    remap_table.emplace(remap_table_rays.table);
+  }
+
+  // Load the valid mask (possibly embedded in the remap table):
+  images::SimpleImage valid_mask_storage{};
+  gl_utils::Texture2D valid_mask{converter::SelectValidMask(camera_tables, remap_table_file, valid_mask_storage)};
+  // Everything has been uploaded, so the mapping is released on return:
+  remap_table_rays.table = images::ImageView{};
+  return GlCameraTables{std::move(remap_table), remap_table_rays, std::move(valid_mask)};
+}
 
+// Run the conversion w/ OpenGL, until done or the window is closed. Returns the number of frames rendered.
+// If `hybrid_cpu_engine` is not null, it converts frames on another thread at the same time (see `--engine hybrid`).
+std::size_t ExecuteMainLoop(const ProgramArgs& args, GLFWwindow* const window, const GlPrograms& programs,
+                            const GlCameraTables& tables, const ProgressCallback& progress,
+                            const cpu_engine::CpuEngine* const hybrid_cpu_engine = nullptr) {
   // Create directories for the outputs:
-  const std::filesystem::path output_root{args.output_path};
-  const std::filesystem::path output_dir_rgb = output_root / "image" / fmt::format("camera{:02}", args.camera_index);
-  const std::filesystem::path output_dir_inv_range =
-      output_root / "range" / fmt::format("camera{:02}", args.camera_index);
-  CreateOrAssert(output_dir_rgb);
-  CreateOrAssert(output_dir_inv_range);
+  const OutputDirectories output_dirs{args};
 
-  // Load the remap table.
-  const images::SimpleImage remap_table_img =
-      images::LoadRawFloatImage(args.table_path, args.table_width, args.table_height, 3);
+  const std::optional<gl_utils::Texture2D>& remap_table = tables.remap_table;
+  const cpu_engine::RemapTableRays& remap_table_rays = tables.remap_table_rays;
+  const gl_utils::Texture2D& valid_mask = tables.valid_mask;
 
   // Match window to the size of the target:
-  glfwSetWindowSize(window, remap_table_img.width, remap_table_img.height);
-
-  // Copy remap table to GPU:
-  const gl_utils::Texture2D remap_table{remap_table_img};
-
-  // Load the valid mask
-  const gl_utils::Texture2D valid_mask = LoadValidMask(args.valid_mask_path, args.table_width, args.table_height);
+  glfwSetWindowSize(window, args.table_width, args.table_height);
 
   // Create a cube-map (initially empty)
   gl_utils::TextureArray rgb_cube{};
   gl_utils::TextureArray inv_depth_cube{};
 
-  // Create shader for building native image:
-  const gl_utils::ShaderProgram cubemap_shader_program =
-      gl_utils::CompileShaderProgram(shaders::vertex, shaders::fragment_oversampled_cubemap);
-
-  // Create shader for displaying the native image in the UI:
-  const gl_utils::ShaderProgram display_program =
-      gl_utils::CompileShaderProgram(shaders::vertex, shaders::fragment_display);
+  const gl_utils::ShaderProgram& cubemap_shader_program = programs.cubemap_shader_program;
+  const gl_utils::ShaderProgram& display_program = programs.display_program;
 
   // Create projection matrix:
   const glm::mat4x4 projection = glm::ortho(0.0f, 1.0f, 0.0f, 1.0f, -1.0f, 1.0f);
   cubemap_shader_program.SetMatrixUniform("projection", projection);
   display_program.SetMatrixUniform("projection", projection);
 
-  // The rotation from a DirectX camera to an unreal camera: (UE cam has +x forward, per their pawn convention).
-  constexpr glm::fquat unreal_cam_R_directx_cam = glm::fquat{0.5f, 0.5f, 0.5f, 0.5f};
-  cubemap_shader_program.SetMatrixUniform("cubemap_R_camera", glm::mat3_cast(unreal_cam_R_directx_cam));
+  const cpu_engine::RenderParams render_params = converter::GetRenderParams();
+  cubemap_shader_program.SetMatrixUniform("cubemap_R_camera", render_params.cubemap_R_camera);
+  cubemap_shader_program.SetUniformFloat("oversampled_fov", render_params.oversampled_fov);
+  cubemap_shader_program.SetUniformFloat("ue_clip_plane_meters", render_params.ue_clip_plane_meters);
+  cubemap_shader_program.SetUniformIVec2("output_dims", glm::ivec2(args.table_width, args.table_height));
 
-  // The size of the oversampled cubemaps, in radians:
-  // TODO: Would be nice if these were read it from the dataset, instead of being hardcoded.
-  cubemap_shader_program.SetUniformFloat("oversampled_fov", static_cast<float>(95.0 * M_PI / 180.0));
-  cubemap_shader_program.SetUniformFloat("ue_clip_plane_meters", 0.1f);
+  // Tell the shader where the camera rays come from:
+  if (remap_table) {
+    cubemap_shader_program.SetUniformInt("camera_model", 0);
+    cubemap_shader_program.SetUniformInt("remap_table_stride", remap_table_rays.stride);
+    cubemap_shader_program.SetUniformInt("remap_table_interpolation",
+                                         static_cast<int>(remap_table_rays.interpolation));
+    cubemap_shader_program.SetUniformInt("remap_table_encoding", static_cast<int>(remap_table_rays.encoding));
+  } else {
+    const camera_models::CameraIntrinsics intrinsics = GetCameraTables(args).camera_model;
+    cubemap_shader_program.SetUniformInt("camera_model", static_cast<int>(intrinsics.model));
+    cubemap_shader_program.SetUniformVec4("camera_matrix",
+                                          glm::vec4(intrinsics.fx, intrinsics.fy, intrinsics.cx, intrinsics.cy));
+    cubemap_shader_program.SetUniformFloatArray("distortion_coeffs", intrinsics.coeffs.data(),
+                                                static_cast<GLsizei>(intrinsics.coeffs.size()));
+  }
 
-  // A VBO w/ a quad we can draw to fill the screen:
-  const gl_utils::FullScreenQuad quad{};
+  const gl_utils::FullScreenQuad& quad = programs.quad;
 
   // Create a frame buffer to render into:
   const int texture_width = args.table_width;
@@ -192,7 +784,7 @@ void ExecuteMainLoop(const ProgramArgs& args, GLFWwindow* const window) {
     glDisable(GL_DEPTH_TEST);
 
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, remap_table.Handle());
+    glBindTexture(GL_TEXTURE_2D, remap_table ? remap_table->Handle() : 0);
 
     glActiveTexture(GL_TEXTURE1);
     glBindTexture(GL_TEXTURE_2D_ARRAY, is_depth ? inv_depth_cube.Handle() : rgb_cube.Handle());
@@ -216,75 +808,178 @@ void ExecuteMainLoop(const ProgramArgs& args, GLFWwindow* const window) {
                                                   gl_utils::FramebufferType::InverseRange};
 
   // We'll render to FBO then read the previous frame before queueing another read:
-  gl_utils::PixelbufferQueue color_pbos{2, texture_width, texture_height, 3, images::ImageDepth::Bits8};
-  gl_utils::PixelbufferQueue inv_range_pbos{2, texture_width, texture_height, 1, images::ImageDepth::Bits16};
+  constexpr std::size_t num_pbos = 2;
+  gl_utils::PixelbufferQueue color_pbos{num_pbos, texture_width, texture_height, 3, images::ImageDepth::Bits8};
+  gl_utils::PixelbufferQueue inv_range_pbos{num_pbos, texture_width, texture_height, 1, images::ImageDepth::Bits16};
 
   // Indices of images we haven't read back from the GPU yet.
   std::queue<std::size_t> queued_indices{};
 
+  // Declared before the writers, which record into them.
+  memory_tracking::MemoryTracker memory{};
+  memory.SetBudget(args.memory_budget_mb * 1024 * 1024);
+  timing::TraceRecorder trace{};
+  timing::SimpleTimer timer{};
+  if (!args.trace_path.empty()) {
+    trace.NameCurrentThread("main");
+    timer.SetTrace(&trace);
+  }
+  if (args.perf_counters && !timer.EnableHardwareCounters()) {
+    fmt::print("Hardware counters are not available (check /proc/sys/kernel/perf_event_paranoid).\n");
+  }
+
+  // Declared before the writers, which report finished frames to it.
+  const std::unique_ptr<FrameSource> source = MakeFrameSource(args, output_dirs);
+
   // Queue of tasks for writing images (poor man's thread pool).
-  constexpr std::size_t max_writers = 8;
-  TaskQueue<void> write_queue(max_writers);
+  TaskQueue<void> write_queue(args.num_writer_threads, &timer);
+
+  // GPU execution time of the render and readback:
+  gl_utils::GpuTimerQueries gpu_timer{timer};
+
+  // The pixel buffers for readback (8-bit RGB and 16-bit inverse range) are allocated up front:
+  const memory_tracking::TrackedBytes readback_memory = memory.Track(
+      memory_tracking::Owner::Readback, num_pbos * static_cast<std::size_t>(texture_width * texture_height) * (3 + 2));
+
+  // Hand a frame that was read back to the writers (or just report it finished, if there is no output). Called by
+  // both engines w/ --engine hybrid.
+  std::mutex write_mutex{};
+  const auto write_frame = [&](const std::size_t index, images::SimpleImage&& rgb, images::SimpleImage&& inv_range) {
+    const std::lock_guard<std::mutex> lock{write_mutex};
+    if (!output_dirs.enabled) {
+      source->Finished(index);
+      return;
+    }
+    timer.Record(timing::SimpleTimer::Stages::Write, index, [&] {
+      memory_tracking::TrackedBytes backlog =
+          memory.Track(memory_tracking::Owner::EncoderBacklog, rgb.data.size() + inv_range.data.size());
+      write_queue.Push([index, rgb = std::move(rgb), inv_range = std::move(inv_range), backlog = std::move(backlog),
+                        &output_dirs, &timer, &source] {
+        output_dirs.Write(index, rgb, inv_range, timer);
+        source->Finished(index);
+      });
+    });
+  };
+
+  // Complete any pending reads. Frames are only finished once read back, so we do this before waiting on the source.
+  const auto read_back_all = [&] {
+    while (!queued_indices.empty()) {
+      const std::size_t index = queued_indices.front();
+      queued_indices.pop();
+      images::SimpleImage rgb{};
+      images::SimpleImage inv_range{};
+      timer.Record(timing::SimpleTimer::Stages::WaitPbo, index, [&] {
+        rgb = color_pbos.PopOldestRead();
+        inv_range = inv_range_pbos.PopOldestRead();
+      });
+      write_frame(index, std::move(rgb), std::move(inv_range));
+    }
+  };
+
+  // Loads the cubemap faces, possibly ahead of the frame being rendered:
+  FramePrefetcher prefetcher{args, *source, timer, memory};
+
+  // W/ the hybrid engine, the CPU engine converts frames on its own thread. Both engines take the next frame from the
+  // prefetcher whenever they are free, so each converts frames in proportion to its throughput. Outputs are written
+  // under their frame index, in the order they finish.
+  const auto start = std::chrono::steady_clock::now();
+  std::atomic<std::size_t> num_rendered_cpu{0};
+  // A failure on the CPU engine's thread stops both engines, and is rethrown here (eg. to the daemon):
+  std::exception_ptr cpu_thread_error{};
+  std::thread cpu_thread{};
+  if (hybrid_cpu_engine != nullptr) {
+    cpu_thread = std::thread{[&] {
+      if (!args.trace_path.empty()) {
+        trace.NameCurrentThread("cpu_engine");
+      }
+      try {
+        while (std::optional<LoadedFrame> frame = prefetcher.Next([] {})) {
+          const std::size_t index = frame->index;
+          images::SimpleImage rgb{};
+          images::SimpleImage inv_range{};
+          timer.Record(timing::SimpleTimer::Stages::CpuRender, index,
+                       [&] { hybrid_cpu_engine->Render(frame->faces, rgb, inv_range); });
+          frame.reset();
+          write_frame(index, std::move(rgb), std::move(inv_range));
+          ++num_rendered_cpu;
+        }
+      } catch (...) {
+        cpu_thread_error = std::current_exception();
+        prefetcher.Stop();
+      }
+    }};
+  }
+  // Also join the thread if the loop below throws:
+  const auto join_cpu_thread = sg::make_scope_guard([&] {
+    if (cpu_thread.joinable()) {
+      prefetcher.Stop();
+      cpu_thread.join();
+    }
+  });
 
   // Main loop
-  timing::SimpleTimer timer{};
-  std::size_t next_index = 0;
+  std::size_t num_rendered = 0;
   while (!glfwWindowShouldClose(window)) {
     glfwPollEvents();
 
     // Load the cubemap faces:
-    // TODO: We'd get better GPU usage if this was a thread pool.
-    std::vector<images::SimpleImage> faces;
-    timer.Record(timing::SimpleTimer::Stages::Load,
-                 [&]() { faces = images::LoadCubemapImages(dataset, next_index, args.camera_index, true); });
+    // While waiting for frames (eg. w/ --watch), keep the window responsive:
+    const std::optional<LoadedFrame> frame = prefetcher.Next([&] {
+      read_back_all();
+      glfwPollEvents();
+    });
+    if (!frame) {
+      break;
+    }
+    const std::vector<images::SimpleImage>& faces = frame->faces;
+    const std::size_t index = frame->index;
 
     // Copy the RGB + depth data:
-    timer.Record(timing::SimpleTimer::Stages::Unpack, [&] {
+    timer.Record(timing::SimpleTimer::Stages::Unpack, index, [&] {
       for (int face = 0; face < 6; ++face) {
-        ASSERT(!faces[face].IsEmpty(), "Failed to load RGB cubemap face: {}, index = {}", face, next_index);
+        ASSERT(!faces[face].IsEmpty(), "Failed to load RGB cubemap face: {}, index = {}", face, index);
         rgb_cube.Fill(face, faces[face]);
       }
       for (int face = 0; face < 6; ++face) {
-        ASSERT(!faces[face].IsEmpty(), "Failed to load inverse depth cubemap face: {}, index = {}", face, next_index);
+        ASSERT(!faces[face + 6].IsEmpty(), "Failed to load inverse depth cubemap face: {}, index = {}", face, index);
         inv_depth_cube.Fill(face, faces[face + 6]);
       }
     });
 
     // Render to the FBO:
-    timer.Record(timing::SimpleTimer::Stages::Render, [&] {
-      rgb_fbo.RenderInto([&] { draw_to_fbo(false); });
-      inv_range_fbo.RenderInto([&] { draw_to_fbo(true); });
+    timer.Record(timing::SimpleTimer::Stages::Render, index, [&] {
+      gpu_timer.Record(timing::SimpleTimer::Stages::GpuRender, [&] {
+        rgb_fbo.RenderInto([&] { draw_to_fbo(false); });
+        inv_range_fbo.RenderInto([&] { draw_to_fbo(true); });
+      });
     });
 
     // Read it back:
     std::size_t read_index = std::numeric_limits<std::size_t>::max();
     images::SimpleImage previous_rgb_read{};
     images::SimpleImage previous_inv_range_read{};
-    timer.Record(timing::SimpleTimer::Stages::Pack, [&] {
+    timer.Record(timing::SimpleTimer::Stages::Pack, index, [&] {
       if (color_pbos.QueueIsFull()) {
         // We've filled the queue, we need to de-queue the oldest reads:
-        ASSERT(inv_range_pbos.QueueIsFull());
-        previous_rgb_read = color_pbos.PopOldestRead();
-        previous_inv_range_read = inv_range_pbos.PopOldestRead();
+        ASSERT(inv_range_pbos.QueueIsFull() && !queued_indices.empty());
+        timer.Record(timing::SimpleTimer::Stages::WaitPbo, index, [&] {
+          previous_rgb_read = color_pbos.PopOldestRead();
+          previous_inv_range_read = inv_range_pbos.PopOldestRead();
+        });
         read_index = queued_indices.front();
         queued_indices.pop();
       }
       // Queue a read for this frame:
-      color_pbos.QueueReadFromFbo(rgb_fbo);
-      inv_range_pbos.QueueReadFromFbo(inv_range_fbo);
-      queued_indices.push(next_index);
+      gpu_timer.Record(timing::SimpleTimer::Stages::GpuReadback, [&] {
+        color_pbos.QueueReadFromFbo(rgb_fbo);
+        inv_range_pbos.QueueReadFromFbo(inv_range_fbo);
+      });
+      queued_indices.push(index);
     });
 
     // Write the data out (if the user specified a path).
-    if (!previous_rgb_read.IsEmpty() && !args.output_path.empty()) {
-      ASSERT(read_index < next_index);  //  This should be an earlier frame.
-      timer.Record(timing::SimpleTimer::Stages::Write, [&] {
-        write_queue.Push([read_index, rgb = std::move(previous_rgb_read),
-                          inv_range = std::move(previous_inv_range_read), &output_dir_rgb, &output_dir_inv_range] {
-          images::WritePng(output_dir_rgb / fmt::format("{:08}.png", read_index), rgb, true);
-          images::WritePng(output_dir_inv_range / fmt::format("{:08}.png", read_index), inv_range, true);
-        });
-      });
+    if (!previous_rgb_read.IsEmpty()) {
+      write_frame(read_index, std::move(previous_rgb_read), std::move(previous_inv_range_read));
     }
 
     // Set up the main viewport so the user sees the result:
@@ -305,31 +1000,44 @@ void ExecuteMainLoop(const ProgramArgs& args, GLFWwindow* const window) {
     quad.Draw(display_program);
     glBindTexture(GL_TEXTURE_2D, 0);
     glfwSwapBuffers(window);
-
-    // Increment the index:
-    if (next_index + 1 == args.num_images) {
-      break;  //  We can stop.
-    } else {
-      ++next_index;
+    gpu_timer.EndFrame();
+    memory.EndFrame();
+    ++num_rendered;
+    if (progress) {
+      progress(num_rendered + num_rendered_cpu);
     }
   }
 
-  // Complete any pending reads:
-  while (!queued_indices.empty() && !args.output_path.empty()) {
-    const std::size_t index = queued_indices.front();
-    queued_indices.pop();
-    images::SimpleImage rgb = color_pbos.PopOldestRead();
-    images::SimpleImage inv_range = inv_range_pbos.PopOldestRead();
-    write_queue.Push(
-        [index, rgb = std::move(rgb), inv_range = std::move(inv_range), &output_dir_rgb, &output_dir_inv_range] {
-          images::WritePng(output_dir_rgb / fmt::format("{:08}.png", index), rgb, true);
-          images::WritePng(output_dir_inv_range / fmt::format("{:08}.png", index), inv_range, true);
-        });
+  read_back_all();
+  const std::size_t num_rendered_gl = num_rendered;
+  if (cpu_thread.joinable()) {
+    // The window may have been closed before every frame was handed out:
+    prefetcher.Stop();
+    cpu_thread.join();
+    if (cpu_thread_error) {
+      std::rethrow_exception(cpu_thread_error);
+    }
+    num_rendered += num_rendered_cpu;
   }
 
   write_queue.Flush();  // Wait for writing to complete.
-  fmt::print("Processed {} images.\n", next_index);
-  timer.Summarize();
+  gpu_timer.Flush();    // Collect the remaining GPU times.
+  const std::chrono::duration<double> wall_time = std::chrono::steady_clock::now() - start;
+  fmt::print("Processed {} images.\n", num_rendered);
+  timing::RunInfo info{DescribeConfig(args), gl_utils::RendererName(), num_rendered,
+                       num_rendered * texture_width * texture_height, wall_time.count()};
+  if (hybrid_cpu_engine != nullptr) {
+    info.gpu += " + cpu";
+    info.engine_frames = {{"gl", num_rendered_gl}, {"cpu", num_rendered_cpu.load()}};
+    for (const auto& [engine, frames] : info.engine_frames) {
+      fmt::print("Hybrid engine: {} frames w/ the {} engine ({:.2f} frames/s).\n", frames, engine,
+                 static_cast<double>(frames) / std::max(wall_time.count(), 1.0e-9));
+    }
+  }
+  FinishRun(args, info,
+            timing::PipelineShape{NumDecodeThreads(), args.num_writer_threads, true, hybrid_cpu_engine != nullptr},
+            timer, memory, trace);
+  return num_rendered;
 }
 
 // Callback to update viewport.
@@ -339,12 +1047,22 @@ void WindowSizeCallback(GLFWwindow* const window, int, int) {
   glViewport(0, 0, display_w, display_h);
 }
 
-int Run(const ProgramArgs& args) {
+// Destroys the window, and shuts down GLFW.
+struct WindowDeleter {
+  void operator()(GLFWwindow* const window) const {
+    glfwDestroyWindow(window);
+    glfwTerminate();
+  }
+};
+using WindowPtr = std::unique_ptr<GLFWwindow, WindowDeleter>;
+
+// Create a window w/ an OpenGL 4.3 context, and make it current. Returns null on failure.
+WindowPtr OpenWindow(const ProgramArgs& args) {
   // Setup window
   glfwSetErrorCallback(glfw_error_callback);
   if (!glfwInit()) {
     fmt::print("Failed to initialize GLFW.\n");
-    return 1;
+    return nullptr;
   }
 
   // GL 4.3
@@ -356,12 +1074,12 @@ int Run(const ProgramArgs& args) {
 #endif
 
   // Create window with graphics context
-  GLFWwindow* const window = glfwCreateWindow(1280, 720, "Cubemap converter", nullptr, nullptr);
+  WindowPtr window{glfwCreateWindow(1280, 720, "Cubemap converter", nullptr, nullptr)};
   if (window == nullptr) {
     fmt::print("Failed to create GLFW window\n");
-    return 1;
+    return nullptr;
   }
-  glfwMakeContextCurrent(window);
+  glfwMakeContextCurrent(window.get());
 
   // print the version of OpenGL:
   const int glad_version = gladLoadGL(glfwGetProcAddress);
@@ -371,26 +1089,179 @@ int Run(const ProgramArgs& args) {
   // vsync slows things down a fair bit
   constexpr bool vsync = false;
   glfwSwapInterval(static_cast<int>(vsync));
-  glfwSetWindowSizeCallback(window, WindowSizeCallback);
+  glfwSetWindowSizeCallback(window.get(), WindowSizeCallback);
 
   // print errors
   if (args.enable_gl_debug) {
     gl_utils::EnableDebugOutput(glad_version);
   }
+  return window;
+}
+
+int Run(const ProgramArgs& args) {
+  // The CPU engine does not need a window or context:
+  if (args.engine == "cpu") {
+    ExecuteCpuLoop(args, converter::CreateCpuEngine(GetCameraTables(args), args.num_cpu_threads), {});
+    return 0;
+  }
+
+  const WindowPtr window = OpenWindow(args);
+  if (!window) {
+    return 1;
+  }
 
-  // Render until the window closes:
-  ExecuteMainLoop(args, window);
+  std::optional<cpu_engine::CpuEngine> hybrid_cpu_engine{};
+  if (args.engine == "hybrid") {
+    hybrid_cpu_engine.emplace(converter::CreateCpuEngine(GetCameraTables(args), args.num_cpu_threads));
+  }
 
-  glfwDestroyWindow(window);
-  glfwTerminate();
+  // Render until the window closes. GL objects are released before the window:
+  const GlPrograms programs{};
+  ExecuteMainLoop(args, window.get(), programs, UploadCameraTables(args), {},
+                  hybrid_cpu_engine ? &*hybrid_cpu_engine : nullptr);
   return 0;
 }
 
+// Identifies the camera rays and valid mask of a conversion, for the caches of the daemon. Files are identified by
+// path, size and modification time, so that a table regenerated in place is loaded again. A job w/ `--verify-table`
+// does not re-use a table loaded w/o it, so that its sections are checked.
+std::string CameraTablesKey(const ProgramArgs& args) {
+  const auto describe_file = [](const std::string& path) {
+    std::error_code err{};
+    const std::uintmax_t size = std::filesystem::file_size(path, err);
+    const auto modified = std::filesystem::last_write_time(path, err);
+    return fmt::format("{}:{}:{}", path, size, err ? 0 : modified.time_since_epoch().count());
+  };
+  std::string key =
+      fmt::format("{}x{} table={} stride={} {} {} verify={} model={}", args.table_width, args.table_height,
+                  args.table_path.empty() ? "" : describe_file(args.table_path), args.table_stride,
+                  args.table_interpolation, args.table_encoding, args.verify_table, args.camera_model);
+  for (const float value : args.intrinsics) {
+    key += fmt::format(" {}", value);
+  }
+  for (const float value : args.distortion) {
+    key += fmt::format(" {}", value);
+  }
+  return key + fmt::format(" mask={}", args.valid_mask_path.empty() ? "" : describe_file(args.valid_mask_path));
+}
+
+#ifndef _WIN32
+// Split a job received by the daemon into arguments. Arguments are separated by tabs, so they may contain spaces.
+std::vector<std::string> SplitJob(const std::string& line) {
+  std::vector<std::string> arguments{};
+  std::size_t begin = 0;
+  for (std::size_t tab = line.find('\t'); tab != std::string::npos; begin = tab + 1, tab = line.find('\t', begin)) {
+    arguments.push_back(line.substr(begin, tab - begin));
+  }
+  arguments.push_back(line.substr(begin));
+  return arguments;
+}
+
+// Convert the jobs received on `args.daemon_socket`, one connection at a time. A job is one line: the arguments of a
+// conversion (as on the command line, w/o the program name) separated by tabs. The daemon replies w/ `PROGRESS <n>`
+// about twice a second while converting, and then `DONE <num frames>` or `ERROR <message>`.
+//
+// The OpenGL context and shaders are created for the first job that uses OpenGL, and kept. The camera tables of the
+// most recently used cameras are kept loaded: uploaded to the GPU, or as CPU engines.
+int RunDaemon(const ProgramArgs& args) {
+  // Declared first, so that the GL objects below are released before the context:
+  WindowPtr window{};
+  std::optional<GlPrograms> gl_programs{};
+  LruCache<GlCameraTables> gl_tables{args.daemon_cache_size};
+  LruCache<cpu_engine::CpuEngine> cpu_engines{args.daemon_cache_size};
+  // Failed assertions in a job throw, and are reported to its client:
+  SetAssertionsThrow(true);
+
+  // Run the job on one line from `client`, and reply w/ its progress and then `DONE`. Throws if the job fails.
+  const auto run_job = [&](const int client, const std::string& job_line) {
+    // Parse errors are sent back to the client:
+    std::ostringstream parse_errors{};
+    const std::variant<ProgramArgs, int> job_or_error =
+        ParseProgramArgs(SplitJob(job_line), parse_errors, parse_errors);
+    if (job_or_error.index() == 1 || !std::get<ProgramArgs>(job_or_error).daemon_socket.empty()) {
+      throw std::invalid_argument(job_or_error.index() == 1 ? parse_errors.str() : "Jobs cannot start a daemon.");
+    }
+    const ProgramArgs& job = std::get<ProgramArgs>(job_or_error);
+
+    auto last_progress = std::chrono::steady_clock::now();
+    const ProgressCallback progress = [&](const std::size_t num_rendered) {
+      const auto now = std::chrono::steady_clock::now();
+      if (now - last_progress >= std::chrono::milliseconds(500)) {
+        unix_socket::SendLine(client, fmt::format("PROGRESS {}", num_rendered));
+        last_progress = now;
+      }
+    };
+
+    const auto get_cpu_engine = [&]() -> const cpu_engine::CpuEngine& {
+      const std::string key = fmt::format("{} threads={}", CameraTablesKey(job), job.num_cpu_threads);
+      return cpu_engines.GetOrCreate(
+          key, [&] { return converter::CreateCpuEngine(GetCameraTables(job), job.num_cpu_threads); });
+    };
+
+    std::size_t num_rendered = 0;
+    if (job.engine == "cpu") {
+      num_rendered = ExecuteCpuLoop(job, get_cpu_engine(), progress);
+    } else {
+      if (!window) {
+        window = OpenWindow(job);
+        ASSERT(window != nullptr, "Failed to create an OpenGL context.");
+        gl_programs.emplace();
+      }
+      const GlCameraTables& tables =
+          gl_tables.GetOrCreate(CameraTablesKey(job), [&] { return UploadCameraTables(job); });
+      num_rendered = ExecuteMainLoop(job, window.get(), *gl_programs, tables, progress,
+                                     job.engine == "hybrid" ? &get_cpu_engine() : nullptr);
+    }
+    fmt::print("Cached tables: {} hits, {} misses.\n", gl_tables.NumHits() + cpu_engines.NumHits(),
+               gl_tables.NumMisses() + cpu_engines.NumMisses());
+    unix_socket::SendLine(client, fmt::format("DONE {}", num_rendered));
+  };
+
+  const int listener = unix_socket::Listen(args.daemon_socket);
+  fmt::print("Waiting for jobs on: {}\n", args.daemon_socket);
+  while (!window || !glfwWindowShouldClose(window.get())) {
+    const int client = unix_socket::Accept(listener);
+    if (client < 0) {
+      continue;
+    }
+    std::string received{};
+    while (const std::optional<std::string> line = unix_socket::ReceiveLine(client, received)) {
+      if (line->empty()) {
+        continue;
+      }
+      // A job that fails (eg. a missing frame, or an invalid remap table) is reported to the client, and the daemon
+      // keeps serving w/ its context and caches:
+      try {
+        run_job(client, *line);
+      } catch (const std::exception& e) {
+        std::string message = e.what();
+        std::replace(message.begin(), message.end(), '\n', ' ');
+        fmt::print("Job failed: {}\n", message);
+        unix_socket::SendLine(client, fmt::format("ERROR {}", message));
+      }
+    }
+    unix_socket::Close(client);
+  }
+  unix_socket::Close(listener);
+  return 0;
+}
+#else
+int RunDaemon(const ProgramArgs&) {
+  fmt::print("--daemon is not supported on Windows.\n");
+  return 1;
+}
+#endif
+
 int main(int argc, char** argv) {
   // Parse args or bail.
-  const std::variant<ProgramArgs, int> args_or_error = ParseProgramArgs(argc, argv);
+  const std::variant<ProgramArgs, int> args_or_error =
+      ParseProgramArgs(std::vector<std::string>(argv + 1, argv + argc), std::cout, std::cerr);
   if (args_or_error.index() == 1) {
     return std::get<int>(args_or_error);
   }
-  return Run(std::get<ProgramArgs>(args_or_error));
+  const ProgramArgs& args = std::get<ProgramArgs>(args_or_error);
+  if (!args.daemon_socket.empty()) {
+    return RunDaemon(args);
+  }
+  return Run(args);
 }
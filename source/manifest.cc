@@ -0,0 +1,54 @@
+// Copyright 2023 Gareth Cross
+#include "manifest.hpp"
+
+#include <fstream>
+#include <sstream>
+
+#include <fmt/format.h>
+
+namespace manifest {
+
+// Read the whole file, or return an empty string if it does not exist.
+static std::string ReadFileIfExists(const std::filesystem::path& path) {
+  std::ifstream stream{path, std::ios::in | std::ios::binary};
+  if (!stream.good()) {
+    return {};
+  }
+  std::stringstream contents{};
+  contents << stream.rdbuf();
+  return contents.str();
+}
+
+OutputManifest::OutputManifest(const std::filesystem::path& path) : file_(path) {
+  const std::string text = ReadFileIfExists(path);
+  finished_ = ParseManifest(text);
+  if (!text.empty() && text.back() != '\n') {
+    prefix_ = "\n";
+  }
+}
+
+void OutputManifest::Append(const std::size_t index) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  file_.AppendDurably(fmt::format("{}{} done\n", prefix_, index));
+  prefix_.clear();
+}
+
+std::unordered_set<std::size_t> ParseManifest(const std::string& text) {
+  std::unordered_set<std::size_t> finished{};
+  std::size_t line_start = 0;
+  for (std::size_t newline = text.find('\n'); newline != std::string::npos;
+       line_start = newline + 1, newline = text.find('\n', line_start)) {
+    const std::string line = text.substr(line_start, newline - line_start);
+    std::istringstream tokens{line};
+    std::size_t index = 0;
+    std::string state{};
+    std::string trailing{};
+    // A line that was cut short does not end in ` done`, so it is skipped:
+    if ((tokens >> index >> state) && state == "done" && !(tokens >> trailing)) {
+      finished.insert(index);
+    }
+  }
+  return finished;
+}
+
+}  // namespace manifest
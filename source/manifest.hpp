@@ -0,0 +1,42 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <filesystem>
+#include <mutex>
+#include <string>
+#include <unordered_set>
+
+#include "file_utils.hpp"
+
+namespace manifest {
+
+// Append-only record of the frames whose outputs were written completely, so an interrupted run can be resumed.
+//
+// The manifest is a text file w/ one line per finished frame: `<index> done`. A line is appended (and flushed to disk)
+// only after both output images of the frame are durable. Lines that are incomplete, eg. because the process died while
+// appending, are ignored when reading. Several converters (eg. shards) may append to the same manifest.
+class OutputManifest {
+ public:
+  // Open (or create) the manifest at `path`, and read the frames it records as finished.
+  explicit OutputManifest(const std::filesystem::path& path);
+
+  // True if the manifest records frame `index` as finished. Only reflects the file as it was when opened.
+  [[nodiscard]] bool Contains(std::size_t index) const { return finished_.count(index) > 0; }
+
+  // Number of distinct frames recorded as finished, when the manifest was opened.
+  [[nodiscard]] std::size_t Size() const { return finished_.size(); }
+
+  // Record frame `index` as finished. May be called from any thread.
+  void Append(std::size_t index);
+
+ private:
+  std::unordered_set<std::size_t> finished_{};
+  std::mutex mutex_{};
+  // Prepended to the first line we append, if the file ends in an incomplete line.
+  std::string prefix_{};
+  file_utils::AppendOnlyFile file_;
+};
+
+// Read the frames recorded as finished in `text`, the contents of a manifest.
+std::unordered_set<std::size_t> ParseManifest(const std::string& text);
+
+}  // namespace manifest
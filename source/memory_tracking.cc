@@ -0,0 +1,164 @@
+// Copyright 2023 Gareth Cross
+#include "memory_tracking.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <numeric>
+#include <string>
+
+#include <fmt/format.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <Windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace memory_tracking {
+
+// Set by `allocation_counter.cc` if the program links it.
+static const std::atomic<uint64_t>* g_allocation_counter{nullptr};
+
+std::string_view OwnerName(const Owner owner) {
+  constexpr std::array<std::string_view, static_cast<std::size_t>(Owner::MAX_VALUE)> names = {
+      "faces", "readback", "encoder backlog"};
+  return names[static_cast<std::size_t>(owner)];
+}
+
+TrackedBytes::TrackedBytes(MemoryTracker* const tracker, const Owner owner, const std::size_t bytes)
+    : tracker_(tracker), owner_(owner), bytes_(bytes) {
+  if (tracker_) {
+    tracker_->Add(owner_, bytes_);
+  }
+}
+
+TrackedBytes::TrackedBytes(TrackedBytes&& other) noexcept
+    : tracker_(other.tracker_), owner_(other.owner_), bytes_(other.bytes_) {
+  other.tracker_ = nullptr;
+}
+
+TrackedBytes& TrackedBytes::operator=(TrackedBytes&& other) noexcept {
+  if (this != &other) {
+    Release();
+    tracker_ = other.tracker_;
+    owner_ = other.owner_;
+    bytes_ = other.bytes_;
+    other.tracker_ = nullptr;
+  }
+  return *this;
+}
+
+void TrackedBytes::Release() {
+  if (tracker_) {
+    tracker_->Remove(owner_, bytes_);
+    tracker_ = nullptr;
+  }
+}
+
+// Add to `live` and update `peak`. Returns the new live value.
+static uint64_t Increment(std::atomic<uint64_t>& live, std::atomic<uint64_t>& peak, const uint64_t bytes) {
+  const uint64_t value = live.fetch_add(bytes, std::memory_order_relaxed) + bytes;
+  uint64_t previous_peak = peak.load(std::memory_order_relaxed);
+  while (value > previous_peak && !peak.compare_exchange_weak(previous_peak, value, std::memory_order_relaxed)) {
+  }
+  return value;
+}
+
+MemoryTracker::MemoryTracker() : allocations_at_last_frame_(NumAllocations()) {}
+
+void MemoryTracker::Add(const Owner owner, const std::size_t bytes) {
+  Counter& counter = owners_[static_cast<std::size_t>(owner)];
+  Increment(counter.live, counter.peak, bytes);
+  const uint64_t total = Increment(total_.live, total_.peak, bytes);
+
+  // Warn once per crossing of the budget:
+  if (budget_bytes_ > 0 && total > budget_bytes_ && !over_budget_.exchange(true, std::memory_order_relaxed)) {
+    std::string breakdown{};
+    for (std::size_t i = 0; i < owners_.size(); ++i) {
+      breakdown += fmt::format(" {} = {:.1f} MB,", OwnerName(static_cast<Owner>(i)),
+                               static_cast<double>(owners_[i].live.load(std::memory_order_relaxed)) / 1.0e6);
+    }
+    fmt::print("Warning: tracked memory ({:.1f} MB) exceeds the budget of {:.1f} MB:{}\n",
+               static_cast<double>(total) / 1.0e6, static_cast<double>(budget_bytes_) / 1.0e6, breakdown);
+  }
+}
+
+void MemoryTracker::Remove(const Owner owner, const std::size_t bytes) {
+  owners_[static_cast<std::size_t>(owner)].live.fetch_sub(bytes, std::memory_order_relaxed);
+  const uint64_t total = total_.live.fetch_sub(bytes, std::memory_order_relaxed) - bytes;
+  if (total <= budget_bytes_) {
+    over_budget_.store(false, std::memory_order_relaxed);
+  }
+}
+
+void MemoryTracker::EndFrame() {
+  const uint64_t allocations = NumAllocations();
+  const uint64_t frame_allocations = allocations - allocations_at_last_frame_;
+  allocations_at_last_frame_ = allocations;
+  ++num_frames_;
+  max_frame_allocations_ = std::max(max_frame_allocations_, frame_allocations);
+  total_frame_allocations_ += frame_allocations;
+}
+
+void MemoryTracker::Summarize() const {
+  fmt::print("{:<16} {:>12} {:>12}\n", "memory", "live [MB]", "peak [MB]");
+  const auto print_counter = [](const std::string_view name, const Counter& counter) {
+    fmt::print("{:<16} {:>12.1f} {:>12.1f}\n", name,
+               static_cast<double>(counter.live.load(std::memory_order_relaxed)) / 1.0e6,
+               static_cast<double>(counter.peak.load(std::memory_order_relaxed)) / 1.0e6);
+  };
+  for (std::size_t i = 0; i < owners_.size(); ++i) {
+    print_counter(OwnerName(static_cast<Owner>(i)), owners_[i]);
+  }
+  print_counter("total", total_);
+  if (!AllocationsCounted()) {
+    fmt::print("Heap allocations: not counted, peak RSS: {:.1f} MB\n",
+               static_cast<double>(PeakResidentBytes()) / 1.0e6);
+    return;
+  }
+  if (num_frames_ > 0) {
+    fmt::print("Heap allocations per frame: mean = {:.1f}, max = {}\n", MeanFrameAllocations(),
+               max_frame_allocations_);
+  }
+  fmt::print("Heap allocations: {}, peak RSS: {:.1f} MB\n", NumAllocations(),
+             static_cast<double>(PeakResidentBytes()) / 1.0e6);
+}
+
+uint64_t NumAllocations() {
+  return g_allocation_counter != nullptr ? g_allocation_counter->load(std::memory_order_relaxed) : 0;
+}
+
+bool AllocationsCounted() { return g_allocation_counter != nullptr; }
+
+void RegisterAllocationCounter(const std::atomic<uint64_t>* const counter) { g_allocation_counter = counter; }
+
+std::size_t PeakResidentBytes() {
+#ifdef _WIN32
+  PROCESS_MEMORY_COUNTERS counters{};
+  if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+    return 0;
+  }
+  return counters.PeakWorkingSetSize;
+#else
+  rusage usage{};
+  if (getrusage(RUSAGE_SELF, &usage) != 0) {
+    return 0;
+  }
+#ifdef __APPLE__
+  return static_cast<std::size_t>(usage.ru_maxrss);  //  Bytes on macOS.
+#else
+  return static_cast<std::size_t>(usage.ru_maxrss) * 1024;  //  Kilobytes on Linux.
+#endif
+#endif
+}
+
+std::size_t ImageBytes(const std::vector<images::SimpleImage>& images) {
+  return std::accumulate(
+      images.begin(), images.end(), std::size_t{0},
+      [](const std::size_t total, const images::SimpleImage& image) { return total + image.data.size(); });
+}
+
+}  // namespace memory_tracking
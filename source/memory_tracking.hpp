@@ -0,0 +1,123 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+#include "images.hpp"
+
+// Accounting of the large buffers held by each part of the pipeline, plus process-wide allocation counts and peak RSS.
+namespace memory_tracking {
+
+// Parts of the pipeline that hold image memory.
+enum class Owner : std::size_t {
+  // Decoded cubemap faces, from load until they have been uploaded (or rendered on the CPU).
+  Faces = 0,
+  // Pixel buffers that frames are read back into from the GPU.
+  Readback,
+  // Rendered images held by write tasks that have not finished encoding.
+  EncoderBacklog,
+  MAX_VALUE,
+};
+
+// Name of an owner, for printing.
+std::string_view OwnerName(Owner owner);
+
+class MemoryTracker;
+
+// Bytes attributed to an owner for as long as this object lives. Move-only.
+class TrackedBytes {
+ public:
+  TrackedBytes() = default;
+  TrackedBytes(MemoryTracker* tracker, Owner owner, std::size_t bytes);
+  ~TrackedBytes() { Release(); }
+
+  TrackedBytes(const TrackedBytes&) = delete;
+  TrackedBytes& operator=(const TrackedBytes&) = delete;
+  TrackedBytes(TrackedBytes&& other) noexcept;
+  TrackedBytes& operator=(TrackedBytes&& other) noexcept;
+
+  // Stop attributing the bytes.
+  void Release();
+
+ private:
+  MemoryTracker* tracker_{nullptr};
+  Owner owner_{Owner::Faces};
+  std::size_t bytes_{0};
+};
+
+// Tracks live and peak bytes per owner. Safe to use from any thread.
+class MemoryTracker {
+ public:
+  // Allocations per frame are counted from here, so that they exclude the setup of the run.
+  MemoryTracker();
+
+  // Attribute `bytes` to `owner` until the returned object is destroyed.
+  [[nodiscard]] TrackedBytes Track(const Owner owner, const std::size_t bytes) {
+    return TrackedBytes{this, owner, bytes};
+  }
+
+  // Print a warning whenever the total tracked bytes cross `bytes` (zero disables the budget).
+  void SetBudget(const std::size_t bytes) { budget_bytes_ = bytes; }
+
+  // Record the number of heap allocations since the previous call (or since construction). Call once per frame.
+  void EndFrame();
+
+  // Largest number of bytes attributed to `owner` at any one time.
+  [[nodiscard]] uint64_t PeakBytes(const Owner owner) const {
+    return owners_[static_cast<std::size_t>(owner)].peak.load(std::memory_order_relaxed);
+  }
+
+  // Largest total number of tracked bytes at any one time.
+  [[nodiscard]] uint64_t TotalPeakBytes() const { return total_.peak.load(std::memory_order_relaxed); }
+
+  // Mean number of heap allocations per frame, on any thread (zero before the first frame).
+  [[nodiscard]] double MeanFrameAllocations() const {
+    return num_frames_ > 0 ? static_cast<double>(total_frame_allocations_) / static_cast<double>(num_frames_) : 0.0;
+  }
+
+  // Print live/peak bytes per owner, allocations per frame, and the peak RSS of the process.
+  void Summarize() const;
+
+ private:
+  friend class TrackedBytes;
+
+  void Add(Owner owner, std::size_t bytes);
+  void Remove(Owner owner, std::size_t bytes);
+
+  struct Counter {
+    std::atomic<uint64_t> live{0};
+    std::atomic<uint64_t> peak{0};
+  };
+
+  std::array<Counter, static_cast<std::size_t>(Owner::MAX_VALUE)> owners_{};
+  Counter total_{};
+  std::size_t budget_bytes_{0};
+  std::atomic<bool> over_budget_{false};
+
+  // Allocations per frame, only touched by the thread calling `EndFrame`.
+  uint64_t allocations_at_last_frame_;
+  uint64_t num_frames_{0};
+  uint64_t max_frame_allocations_{0};
+  uint64_t total_frame_allocations_{0};
+};
+
+// Total number of calls to the global `operator new` so far. Only programs that link `allocation_counter.cc` (the
+// converter) replace `operator new` to count them, so this is zero in other programs.
+uint64_t NumAllocations();
+
+// True if the program links `allocation_counter.cc`.
+bool AllocationsCounted();
+
+// Called by `allocation_counter.cc` at startup w/ the counter its `operator new` increments.
+void RegisterAllocationCounter(const std::atomic<uint64_t>* counter);
+
+// Peak resident set size of the process in bytes (zero if unknown).
+std::size_t PeakResidentBytes();
+
+// Size of the pixel data of a list of images.
+std::size_t ImageBytes(const std::vector<images::SimpleImage>& images);
+
+}  // namespace memory_tracking
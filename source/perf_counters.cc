@@ -0,0 +1,125 @@
+// Copyright 2023 Gareth Cross
+#include "perf_counters.hpp"
+
+#ifdef __linux__
+#include <linux/perf_event.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace timing {
+
+const ThreadCounters& ThreadCounters::ForCurrentThread() {
+  thread_local const ThreadCounters counters{};
+  return counters;
+}
+
+#ifdef __linux__
+// Order must match `CounterValues`. PERF_COUNT_HW_CACHE_MISSES counts last level cache misses on most CPUs.
+static constexpr std::array<uint64_t, 4> kCounterConfigs = {PERF_COUNT_HW_CPU_CYCLES, PERF_COUNT_HW_INSTRUCTIONS,
+                                                            PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+
+// Open one counter on the calling thread. W/ `inherit`, threads started later are counted too: such counters cannot
+// be read as a group, so each is read on its own. Otherwise the counter joins the group of `group_fd` (or starts a new
+// group if -1).
+static int OpenCounter(const uint64_t config, const int group_fd, const bool inherit) {
+  perf_event_attr attr{};
+  attr.type = PERF_TYPE_HARDWARE;
+  attr.size = sizeof(attr);
+  attr.config = config;
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.inherit = inherit ? 1 : 0;
+  attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+  if (!inherit) {
+    attr.read_format |= PERF_FORMAT_GROUP;
+  }
+  return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, inherit ? -1 : group_fd, 0));
+}
+
+// Open all of `kCounterConfigs` into `fds`, or none of them if any is unsupported or not permitted.
+static void OpenCounters(std::array<int, 4>& fds, const bool inherit) {
+  for (std::size_t i = 0; i < kCounterConfigs.size(); ++i) {
+    fds[i] = OpenCounter(kCounterConfigs[i], fds[0], inherit);
+    if (fds[i] < 0) {
+      for (int& fd : fds) {
+        if (fd >= 0) {
+          close(fd);
+        }
+        fd = -1;
+      }
+      return;
+    }
+  }
+}
+
+static void CloseCounters(const std::array<int, 4>& fds) {
+  for (const int fd : fds) {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+}
+
+// Estimate the count over the whole time a counter was enabled, from the time it was actually running.
+static uint64_t Scale(const uint64_t value, const uint64_t time_enabled, const uint64_t time_running) {
+  if (time_running == 0) {
+    return 0;
+  }
+  if (time_running >= time_enabled) {
+    return value;
+  }
+  return static_cast<uint64_t>(static_cast<double>(value) * static_cast<double>(time_enabled) /
+                               static_cast<double>(time_running));
+}
+
+ThreadCounters::ThreadCounters() {
+  OpenCounters(fds_, false);
+  group_fd_ = fds_[0];
+}
+
+ThreadCounters::~ThreadCounters() { CloseCounters(fds_); }
+
+CounterValues ThreadCounters::Read() const {
+  if (!IsAvailable()) {
+    return {};
+  }
+  // The leader reads as: [number of counters, time enabled, time running, value 0, value 1, ...]. The group is
+  // scheduled as a whole, so the times are shared.
+  std::array<uint64_t, 7> buffer{};
+  if (read(group_fd_, buffer.data(), sizeof(buffer)) != static_cast<ssize_t>(sizeof(buffer))) {
+    return {};
+  }
+  return CounterValues{Scale(buffer[3], buffer[1], buffer[2]), Scale(buffer[4], buffer[1], buffer[2]),
+                       Scale(buffer[5], buffer[1], buffer[2]), Scale(buffer[6], buffer[1], buffer[2])};
+}
+
+ProcessCounters::ProcessCounters() { OpenCounters(fds_, true); }
+
+ProcessCounters::~ProcessCounters() { CloseCounters(fds_); }
+
+CounterValues ProcessCounters::Read() const {
+  if (!IsAvailable()) {
+    return {};
+  }
+  // Each counter reads as: [value, time enabled, time running], summed over the threads it was inherited by.
+  std::array<uint64_t, 4> values{};
+  for (std::size_t i = 0; i < fds_.size(); ++i) {
+    std::array<uint64_t, 3> buffer{};
+    if (read(fds_[i], buffer.data(), sizeof(buffer)) != static_cast<ssize_t>(sizeof(buffer))) {
+      return {};
+    }
+    values[i] = Scale(buffer[0], buffer[1], buffer[2]);
+  }
+  return CounterValues{values[0], values[1], values[2], values[3]};
+}
+#else
+ThreadCounters::ThreadCounters() = default;
+ThreadCounters::~ThreadCounters() = default;
+CounterValues ThreadCounters::Read() const { return {}; }
+ProcessCounters::ProcessCounters() = default;
+ProcessCounters::~ProcessCounters() = default;
+CounterValues ProcessCounters::Read() const { return {}; }
+#endif
+
+}  // namespace timing
@@ -0,0 +1,90 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace timing {
+
+// Values of the hardware counters we track.
+struct CounterValues {
+  uint64_t cycles{0};
+  uint64_t instructions{0};
+  uint64_t llc_misses{0};
+  uint64_t branch_misses{0};
+
+  CounterValues operator-(const CounterValues& other) const {
+    return CounterValues{cycles - other.cycles, instructions - other.instructions, llc_misses - other.llc_misses,
+                         branch_misses - other.branch_misses};
+  }
+};
+
+// Hardware counters (cycles, instructions, LLC misses, branch misses) of the calling thread, in user space.
+// Uses `perf_event_open` on Linux. Elsewhere, or if the kernel refuses (see /proc/sys/kernel/perf_event_paranoid),
+// the counters are unavailable and read as zero. If the kernel multiplexes the counters (more events than hardware
+// counters), values are scaled up by the fraction of the time they were running.
+class ThreadCounters {
+ public:
+  // The counters of the calling thread. They are opened on first use, and closed when the thread exits.
+  static const ThreadCounters& ForCurrentThread();
+
+  // True if the counters could be opened.
+  [[nodiscard]] bool IsAvailable() const { return group_fd_ >= 0; }
+
+  // Read the current values.
+  [[nodiscard]] CounterValues Read() const;
+
+  ThreadCounters(const ThreadCounters&) = delete;
+  ThreadCounters& operator=(const ThreadCounters&) = delete;
+  ~ThreadCounters();
+
+ private:
+  ThreadCounters();
+
+  // File descriptor of the group leader (cycles), or -1.
+  int group_fd_{-1};
+  std::array<int, 4> fds_{-1, -1, -1, -1};
+};
+
+// Hardware counters of the whole process: the thread that opened them, and every thread started afterwards (by any
+// thread of the process), eg. the decoders, the writers, and the row threads of the CPU engine. Open them before
+// starting worker threads. Scaled like `ThreadCounters`, and unavailable in the same cases.
+class ProcessCounters {
+ public:
+  ProcessCounters();
+  ~ProcessCounters();
+
+  ProcessCounters(const ProcessCounters&) = delete;
+  ProcessCounters& operator=(const ProcessCounters&) = delete;
+
+  // True if the counters could be opened.
+  [[nodiscard]] bool IsAvailable() const { return fds_[0] >= 0; }
+
+  // Read the current totals.
+  [[nodiscard]] CounterValues Read() const;
+
+ private:
+  std::array<int, 4> fds_{-1, -1, -1, -1};
+};
+
+// Totals of the counters over many measurements. Safe to add to from any thread.
+struct AccumulatedCounters {
+  void Add(const CounterValues& values) {
+    cycles.fetch_add(values.cycles, std::memory_order_relaxed);
+    instructions.fetch_add(values.instructions, std::memory_order_relaxed);
+    llc_misses.fetch_add(values.llc_misses, std::memory_order_relaxed);
+    branch_misses.fetch_add(values.branch_misses, std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] CounterValues Load() const {
+    return CounterValues{cycles.load(std::memory_order_relaxed), instructions.load(std::memory_order_relaxed),
+                         llc_misses.load(std::memory_order_relaxed), branch_misses.load(std::memory_order_relaxed)};
+  }
+
+  std::atomic<uint64_t> cycles{0};
+  std::atomic<uint64_t> instructions{0};
+  std::atomic<uint64_t> llc_misses{0};
+  std::atomic<uint64_t> branch_misses{0};
+};
+
+}  // namespace timing
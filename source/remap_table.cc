@@ -0,0 +1,150 @@
+// Copyright 2023 Gareth Cross
+#include "remap_table.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <utility>
+
+#include <zlib.h>
+
+#include "assertions.hpp"
+
+namespace remap_table {
+
+// zlib crc32 of a block of memory (same as python `zlib.crc32`).
+static uint32_t Crc32(const uint8_t* data, std::size_t size, uLong crc = 0) {
+  // zlib takes the length as a 32-bit integer, so feed large sections in chunks.
+  constexpr std::size_t max_chunk = 1 << 30;
+  while (size > 0) {
+    const std::size_t chunk = std::min(size, max_chunk);
+    crc = crc32(crc, data, static_cast<uInt>(chunk));
+    data += chunk;
+    size -= chunk;
+  }
+  return static_cast<uint32_t>(crc);
+}
+
+// Check the magic and version of the header.
+static void ValidateHeader(const FileHeader& header, const std::filesystem::path& path) {
+  ASSERT(header.magic == kMagic, "Not a remap table file: {}", path.u8string());
+  ASSERT(header.version == kFormatVersion, "Unsupported remap table version {} (expected {}): {}", header.version,
+         kFormatVersion, path.u8string());
+  ASSERT(header.width > 0 && header.height > 0 && header.stride > 0,
+         "Invalid remap table dimensions: width = {}, height = {}, stride = {}", header.width, header.height,
+         header.stride);
+  ASSERT(header.encoding == static_cast<uint32_t>(cpu_engine::TableEncoding::Float32) ||
+             header.encoding == static_cast<uint32_t>(cpu_engine::TableEncoding::Oct16),
+         "Invalid remap table encoding: {}", header.encoding);
+}
+
+// Format of the rays in a given encoding: (components, depth).
+static std::pair<int, images::ImageDepth> RayFormat(const cpu_engine::TableEncoding encoding) {
+  if (encoding == cpu_engine::TableEncoding::Oct16) {
+    return {2, images::ImageDepth::Bits16};
+  }
+  return {3, images::ImageDepth::Bits32};
+}
+
+bool IsRemapTableFile(const std::filesystem::path& path) {
+  std::ifstream stream{path, std::ios::binary};
+  std::array<char, 8> magic{};
+  return stream.read(magic.data(), magic.size()) && magic == kMagic;
+}
+
+FileHeader ReadHeader(const std::filesystem::path& path) {
+  std::ifstream stream{path, std::ios::binary};
+  ASSERT(stream.good(), "Failed to open remap table: {}", path.u8string());
+  FileHeader header{};
+  stream.read(reinterpret_cast<char*>(&header), sizeof(header));
+  ASSERT(stream.gcount() == sizeof(header), "Remap table is truncated: {}", path.u8string());
+  ValidateHeader(header, path);
+  return header;
+}
+
+RemapTableFile OpenRemapTableFile(const std::filesystem::path& path, const bool verify_sections) {
+  RemapTableFile table{};
+  table.file = file_utils::MappedFile{path};
+  const uint8_t* const data = table.file.Data();
+  const std::size_t file_size = table.file.Size();
+
+  ASSERT(file_size >= sizeof(FileHeader), "Remap table is truncated: {}", path.u8string());
+  std::memcpy(&table.header, data, sizeof(FileHeader));
+  ValidateHeader(table.header, path);
+
+  const std::size_t headers_size =
+      sizeof(FileHeader) + static_cast<std::size_t>(table.header.num_sections) * sizeof(SectionHeader);
+  ASSERT(file_size >= headers_size, "Remap table is truncated: {}", path.u8string());
+
+  // The checksum is computed w/ the checksum field zeroed:
+  FileHeader header_for_crc = table.header;
+  header_for_crc.header_crc32 = 0;
+  const uint32_t header_crc =
+      Crc32(data + sizeof(FileHeader), headers_size - sizeof(FileHeader),
+            Crc32(reinterpret_cast<const uint8_t*>(&header_for_crc), sizeof(FileHeader)));
+  ASSERT(header_crc == table.header.header_crc32, "Remap table header checksum mismatch: {}", path.u8string());
+
+  for (uint32_t i = 0; i < table.header.num_sections; ++i) {
+    SectionHeader section{};
+    std::memcpy(&section, data + sizeof(FileHeader) + i * sizeof(SectionHeader), sizeof(SectionHeader));
+    ASSERT(section.offset % kSectionAlignment == 0, "Section {} is not aligned (offset = {})", i, section.offset);
+    ASSERT(section.offset <= file_size && section.size <= file_size - section.offset,
+           "Section {} exceeds the file size. offset = {}, size = {}, file size = {}", i, section.offset, section.size,
+           file_size);
+    ASSERT(!verify_sections || Crc32(data + section.offset, section.size) == section.crc32,
+           "Section {} checksum mismatch: {}", i, path.u8string());
+
+    const images::ImageView view{data + section.offset, static_cast<int>(section.width),
+                                 static_cast<int>(section.height), static_cast<int>(section.components),
+                                 static_cast<images::ImageDepth>(section.depth)};
+    ASSERT(view.SizeBytes() == section.size,
+           "Section {} has the wrong size. Expected = {}x{}x{}x{} = {}, actual = {}", i, section.width,
+           section.height, section.components, section.depth, view.SizeBytes(), section.size);
+
+    switch (static_cast<SectionType>(section.type)) {
+      case SectionType::Rays: {
+        const auto [components, depth] = RayFormat(table.Encoding());
+        ASSERT(view.width == GridDimension(table.Width(), table.Stride()) &&
+                   view.height == GridDimension(table.Height(), table.Stride()) && view.components == components &&
+                   view.depth == depth,
+               "Ray section does not match the header. Shape = [{}, {}, {}]", view.width, view.height,
+               view.components);
+        table.rays = view;
+        break;
+      }
+      case SectionType::ValidMask:
+        ASSERT(view.width == table.Width() && view.height == table.Height() && view.components == 1 &&
+                   view.depth == images::ImageDepth::Bits8,
+               "Valid mask section must be {}x{} 8-bit grayscale.", table.Width(), table.Height());
+        table.valid_mask = view;
+        break;
+      case SectionType::SamplingPlan:
+        table.sampling_plan = view;
+        break;
+      default:
+        // Newer writers may add sections we do not know about - skip them.
+        break;
+    }
+  }
+  ASSERT(table.rays.data != nullptr, "Remap table has no ray section: {}", path.u8string());
+  return table;
+}
+
+RemapTableFile MapRawRemapTable(const std::filesystem::path& path, const int width, const int height,
+                                const int stride, const cpu_engine::TableEncoding encoding) {
+  const auto [components, depth] = RayFormat(encoding);
+  images::MappedImage image = images::MapRawImage(path, GridDimension(width, stride), GridDimension(height, stride),
+                                                  components, depth);
+  RemapTableFile table{};
+  table.file = std::move(image.file);
+  table.rays = image.view;
+  table.header.magic = kMagic;
+  table.header.version = kFormatVersion;
+  table.header.width = static_cast<uint32_t>(width);
+  table.header.height = static_cast<uint32_t>(height);
+  table.header.stride = static_cast<uint32_t>(stride);
+  table.header.encoding = static_cast<uint32_t>(encoding);
+  return table;
+}
+
+}  // namespace remap_table
@@ -0,0 +1,116 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <array>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+
+#include "cpu_engine.hpp"
+#include "file_utils.hpp"
+#include "images.hpp"
+
+// Self-describing remap table files, written by `scripts/remap_table_file.py`.
+//
+// Layout (all fields little-endian):
+//   FileHeader
+//   SectionHeader x num_sections
+//   Sections, each starting on a multiple of `kSectionAlignment`.
+//
+// The sections are stored exactly as they are consumed (the same layout as a raw table or an 8-bit mask image), so a
+// file is loaded by mapping it and pointing views at the sections - nothing is parsed or copied.
+namespace remap_table {
+
+constexpr std::array<char, 8> kMagic = {'C', 'M', 'R', 'T', 'A', 'B', 'L', 'E'};
+constexpr uint32_t kFormatVersion = 1;
+constexpr uint64_t kSectionAlignment = 4096;
+
+// Kinds of section in the file.
+enum class SectionType : uint32_t {
+  // Camera rays, in the format given by `FileHeader::encoding`. Required.
+  Rays = 1,
+  // 8-bit valid mask at the output resolution, same row order as the `--mask` PNG. Optional.
+  ValidMask = 2,
+  // Reserved for a baked per-pixel sampling plan (face index + face coordinates). Optional, not consumed yet.
+  SamplingPlan = 3,
+};
+
+// Start of the file.
+struct FileHeader {
+  std::array<char, 8> magic{};
+  uint32_t version{0};
+  // zlib crc32 of the header (w/ this field set to zero) and the section headers.
+  uint32_t header_crc32{0};
+  // Dimensions of the output image.
+  uint32_t width{0};
+  uint32_t height{0};
+  // Spacing of the ray samples in pixels.
+  uint32_t stride{1};
+  // A `cpu_engine::TableEncoding`.
+  uint32_t encoding{0};
+  // A `camera_models::CameraModel` the table was generated from, or zero if unknown.
+  uint32_t camera_model{0};
+  uint32_t num_sections{0};
+  // fx, fy, cx, cy and up to 5 distortion coefficients of `camera_model`. Informational.
+  std::array<float, 9> intrinsics{};
+  std::array<uint32_t, 5> reserved{};
+};
+static_assert(sizeof(FileHeader) == 96, "FileHeader must match the on-disk layout");
+
+// Describes one section.
+struct SectionHeader {
+  uint32_t type{0};
+  // zlib crc32 of the section contents.
+  uint32_t crc32{0};
+  // Location of the section, relative to the start of the file.
+  uint64_t offset{0};
+  uint64_t size{0};
+  // Shape of the section contents. `depth` is bytes per component.
+  uint32_t width{0};
+  uint32_t height{0};
+  uint32_t components{0};
+  uint32_t depth{0};
+};
+static_assert(sizeof(SectionHeader) == 40, "SectionHeader must match the on-disk layout");
+
+// A remap table mapped into memory. The views point into `file`.
+struct RemapTableFile {
+  file_utils::MappedFile file{};
+  FileHeader header{};
+  images::ImageView rays{};
+  std::optional<images::ImageView> valid_mask{};
+  std::optional<images::ImageView> sampling_plan{};
+
+  // Dimensions of the output image.
+  [[nodiscard]] int Width() const { return static_cast<int>(header.width); }
+  [[nodiscard]] int Height() const { return static_cast<int>(header.height); }
+
+  // Spacing of the ray samples.
+  [[nodiscard]] int Stride() const { return static_cast<int>(header.stride); }
+
+  // How the rays are stored.
+  [[nodiscard]] cpu_engine::TableEncoding Encoding() const {
+    return static_cast<cpu_engine::TableEncoding>(header.encoding);
+  }
+};
+
+// True if the file starts w/ `kMagic`. Raw tables (no header) return false.
+bool IsRemapTableFile(const std::filesystem::path& path);
+
+// Read and validate just the header of a remap table file. Asserts if the file is invalid.
+FileHeader ReadHeader(const std::filesystem::path& path);
+
+// Map a remap table file. Asserts if the file is malformed, or the header checksum does not match. Checking the
+// section checksums reads every page of the table, so it is only done w/ `verify_sections`.
+RemapTableFile OpenRemapTableFile(const std::filesystem::path& path, bool verify_sections = false);
+
+// Map a raw table (rays only, no header) of a `width` x `height` image sampled every `stride` pixels.
+RemapTableFile MapRawRemapTable(const std::filesystem::path& path, int width, int height, int stride,
+                                cpu_engine::TableEncoding encoding);
+
+// Number of samples needed along an image dimension to cover the last row or column, when sampling every `stride`-th
+// pixel.
+inline int GridDimension(const int image_dimension, const int stride) {
+  return (image_dimension - 1 + stride - 1) / stride + 1;
+}
+
+}  // namespace remap_table
@@ -0,0 +1,47 @@
+// Copyright 2023 Gareth Cross
+#include <algorithm>
+#include <chrono>
+#include <limits>
+
+#include <CLI/CLI.hpp>
+
+#include "coordinator.hpp"
+#include "frame_source.hpp"
+
+// Hand out the frames of a dataset to `cubemap_converter --coordinator <socket>` workers on this machine.
+int main(int argc, char** argv) {
+  CLI::App app{"Cubemap converter frame coordinator"};
+  std::string socket_path{};
+  std::size_t num_images{0};
+  std::size_t start_index{0};
+  std::size_t end_index{std::numeric_limits<std::size_t>::max()};
+  std::size_t stride{1};
+  std::size_t chunk_size{16};
+  std::size_t max_attempts{3};
+  double lease_timeout{300.0};
+  try {
+    app.add_option("-s,--socket", socket_path, "Path of the Unix socket to listen on.")->required();
+    app.add_option("--num-images", num_images, "Num images in the dataset.")->required();
+    app.add_option("--start-index", start_index, "Index of the first frame to convert.");
+    app.add_option("--end-index", end_index, "Convert frames before this index. Defaults to --num-images.");
+    app.add_option("--stride", stride, "Convert every N-th frame, starting from --start-index.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--chunk-size", chunk_size, "Number of consecutive frames handed to a worker at once.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--max-attempts", max_attempts, "Give up on a frame after this many workers failed it.")
+        ->check(CLI::PositiveNumber);
+    app.add_option("--lease-timeout", lease_timeout,
+                   "Seconds a worker may hold frames w/o finishing one, before it is disconnected and its frames are "
+                   "handed to other workers.")
+        ->check(CLI::PositiveNumber);
+    app.parse(argc, argv);
+  } catch (const CLI::ParseError& e) {
+    return app.exit(e);
+  }
+
+  const std::vector<std::size_t> frames = SelectFrames(start_index, std::min(end_index, num_images), stride);
+  const std::size_t num_failed =
+      coordinator::RunCoordinator(socket_path, frames, chunk_size, max_attempts,
+                                  std::chrono::milliseconds(static_cast<int64_t>(lease_timeout * 1000.0)));
+  return num_failed > 0 ? 1 : 0;
+}
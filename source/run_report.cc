@@ -0,0 +1,149 @@
+// Copyright 2023 Gareth Cross
+#include "run_report.hpp"
+
+#include <algorithm>
+#include <array>
+#include <fstream>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include "assertions.hpp"
+
+#ifdef __APPLE__
+#include <sys/sysctl.h>
+#endif
+
+namespace timing {
+
+std::string CpuName() {
+#if defined(__linux__)
+  std::ifstream cpuinfo{"/proc/cpuinfo"};
+  std::string line{};
+  while (std::getline(cpuinfo, line)) {
+    if (line.rfind("model name", 0) == 0) {
+      const std::size_t colon = line.find(':');
+      if (colon != std::string::npos && colon + 2 <= line.size()) {
+        return line.substr(colon + 2);
+      }
+    }
+  }
+#elif defined(__APPLE__)
+  std::array<char, 256> buffer{};
+  std::size_t size = buffer.size();
+  if (sysctlbyname("machdep.cpu.brand_string", buffer.data(), &size, nullptr, 0) == 0) {
+    return std::string{buffer.data()};
+  }
+#endif
+  return "unknown";
+}
+
+static std::string_view OperatingSystem() {
+#if defined(_WIN32)
+  return "windows";
+#elif defined(__APPLE__)
+  return "macos";
+#elif defined(__linux__)
+  return "linux";
+#else
+  return "unknown";
+#endif
+}
+
+// Quote and escape a string for JSON (paths on Windows contain backslashes).
+static std::string JsonString(const std::string_view value) {
+  std::string quoted = "\"";
+  for (const char c : value) {
+    if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if (static_cast<unsigned char>(c) < 0x20) {
+      quoted += fmt::format("\\u{:04x}", static_cast<int>(c));
+    } else {
+      quoted += c;
+    }
+  }
+  quoted += '"';
+  return quoted;
+}
+
+void WriteRunReport(const std::filesystem::path& path, const RunInfo& info, const SimpleTimer& timer,
+                    const memory_tracking::MemoryTracker& memory, const BottleneckReport& bottlenecks) {
+  std::ofstream stream{path, std::ios::out | std::ios::trunc};
+  ASSERT(stream.good(), "Failed to open report file for writing: {}", path.u8string());
+
+  const double wall = std::max(info.wall_seconds, 1.0e-9);
+  const auto megabytes = [](const uint64_t bytes) { return static_cast<double>(bytes) / 1.0e6; };
+
+  stream << "{\n";
+  stream << fmt::format("  \"format_version\": {},\n", kRunReportVersion);
+
+  stream << "  \"config\": {";
+  for (std::size_t i = 0; i < info.config.size(); ++i) {
+    stream << fmt::format("{}\n    {}: {}", i > 0 ? "," : "", JsonString(info.config[i].first),
+                          JsonString(info.config[i].second));
+  }
+  stream << "\n  },\n";
+
+  stream << fmt::format("  \"hardware\": {{\"cpu\": {}, \"num_threads\": {}, \"os\": {}, \"gpu\": {}}},\n",
+                        JsonString(CpuName()), std::thread::hardware_concurrency(),
+                        JsonString(OperatingSystem()), JsonString(info.gpu));
+
+  stream << fmt::format("  \"frames\": {},\n", info.num_frames);
+  stream << fmt::format("  \"wall_seconds\": {:.6f},\n", info.wall_seconds);
+  stream << fmt::format(
+      "  \"throughput\": {{\"frames_per_second\": {:.4f}, \"megapixels_per_second\": {:.4f}, "
+      "\"read_mb_per_second\": {:.4f}, \"written_mb_per_second\": {:.4f}}},\n",
+      static_cast<double>(info.num_frames) / wall, static_cast<double>(info.num_output_pixels) / 1.0e6 / wall,
+      megabytes(timer.Bytes(SimpleTimer::Stages::Decode)) / wall,
+      megabytes(timer.Bytes(SimpleTimer::Stages::Encode)) / wall);
+
+  if (!info.engine_frames.empty()) {
+    stream << "  \"engines\": {";
+    for (std::size_t i = 0; i < info.engine_frames.size(); ++i) {
+      const auto& [engine, frames] = info.engine_frames[i];
+      stream << fmt::format("{}{}: {{\"frames\": {}, \"frames_per_second\": {:.4f}}}", i > 0 ? ", " : "",
+                            JsonString(engine), frames, static_cast<double>(frames) / wall);
+    }
+    stream << "},\n";
+  }
+
+  // Stages that were never recorded are omitted:
+  stream << "  \"stages\": {";
+  bool first = true;
+  for (std::size_t i = 0; i < static_cast<std::size_t>(SimpleTimer::Stages::MAX_VALUE); ++i) {
+    const auto stage = static_cast<SimpleTimer::Stages>(i);
+    const Histogram& histogram = timer.GetHistogram(stage);
+    if (histogram.Count() == 0) {
+      continue;
+    }
+    stream << fmt::format(
+        "{}\n    \"{}\": {{\"count\": {}, \"total_s\": {:.6f}, \"mean_ms\": {:.4f}, \"p50_ms\": {:.4f}, "
+        "\"p90_ms\": {:.4f}, \"p99_ms\": {:.4f}, \"max_ms\": {:.4f}}}",
+        first ? "" : ",", SimpleTimer::StageName(stage), histogram.Count(), histogram.TotalSeconds(),
+        histogram.MeanMillis(), histogram.PercentileMillis(0.5), histogram.PercentileMillis(0.9),
+        histogram.PercentileMillis(0.99), histogram.MaxMillis());
+    first = false;
+  }
+  stream << "\n  },\n";
+
+  stream << "  \"memory\": {\"peak_mb\": {";
+  for (std::size_t i = 0; i < static_cast<std::size_t>(memory_tracking::Owner::MAX_VALUE); ++i) {
+    const auto owner = static_cast<memory_tracking::Owner>(i);
+    stream << fmt::format("{}{}: {:.3f}", i > 0 ? ", " : "", JsonString(memory_tracking::OwnerName(owner)),
+                          megabytes(memory.PeakBytes(owner)));
+  }
+  stream << fmt::format(
+      "}}, \"total_peak_mb\": {:.3f}, \"peak_rss_mb\": {:.3f}, \"allocations_per_frame\": {:.1f}}},\n",
+      megabytes(memory.TotalPeakBytes()), megabytes(memory_tracking::PeakResidentBytes()),
+      memory.MeanFrameAllocations());
+
+  stream << fmt::format("  \"bottleneck\": {{\"limiting_stage\": {}, \"speedup_if_free\": {:.4f}, \"verdict\": {}}}\n",
+                        JsonString(bottlenecks.stages.empty() ? "" : bottlenecks.stages.front().name),
+                        bottlenecks.stages.empty() ? 1.0 : bottlenecks.stages.front().speedup,
+                        JsonString(bottlenecks.verdict));
+  stream << "}\n";
+  ASSERT(stream.good(), "Failed to write report file: {}", path.u8string());
+}
+
+}  // namespace timing
@@ -0,0 +1,40 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "bottleneck.hpp"
+#include "memory_tracking.hpp"
+#include "timing.hpp"
+
+namespace timing {
+
+// Version of the JSON written by `WriteRunReport`. Bump when fields are renamed or change meaning.
+constexpr int kRunReportVersion = 1;
+
+// Description of a run, for the report.
+struct RunInfo {
+  // Options the run was configured with, as (name, value) pairs.
+  std::vector<std::pair<std::string, std::string>> config{};
+  // Name of the GPU that rendered the frames (empty for the CPU engine).
+  std::string gpu{};
+  std::size_t num_frames{0};
+  uint64_t num_output_pixels{0};
+  double wall_seconds{0.0};
+  // Frames converted by each engine, as (engine, frames) pairs. Only set for the hybrid engine.
+  std::vector<std::pair<std::string, std::size_t>> engine_frames{};
+};
+
+// Name of the CPU model, or "unknown".
+std::string CpuName();
+
+// Write a machine-readable summary of a run: configuration, hardware, throughput, the percentiles of every stage,
+// memory peaks, and the limiting stage. Asserts if the file cannot be written.
+// Compare two reports w/ scripts/cubemap_report_diff.py.
+void WriteRunReport(const std::filesystem::path& path, const RunInfo& info, const SimpleTimer& timer,
+                    const memory_tracking::MemoryTracker& memory, const BottleneckReport& bottlenecks);
+
+}  // namespace timing
@@ -0,0 +1,272 @@
+// Copyright 2023 Gareth Cross
+#include "shm_ring.hpp"
+
+#include <chrono>
+#include <cstring>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+#include <fmt/format.h>
+
+#include "assertions.hpp"
+
+namespace shm_ring {
+
+// The ring header and each slot header are padded to a cache line.
+constexpr std::size_t kHeaderBytes = 64;
+constexpr std::size_t kSlotHeaderBytes = 64;
+static_assert(sizeof(RingHeader) <= kHeaderBytes && sizeof(SlotHeader) <= kSlotHeaderBytes);
+
+static std::size_t RgbFaceBytes(const int face_size) { return static_cast<std::size_t>(face_size) * face_size * 3; }
+static std::size_t DepthFaceBytes(const int face_size) { return static_cast<std::size_t>(face_size) * face_size * 2; }
+
+std::size_t SlotBytes(const int face_size) {
+  const std::size_t size = kSlotHeaderBytes + 6 * (RgbFaceBytes(face_size) + DepthFaceBytes(face_size));
+  return (size + 63) / 64 * 64;
+}
+
+uint8_t* SharedMemory::Slot(const std::size_t slot) const {
+  return data_ + kHeaderBytes + slot * static_cast<std::size_t>(Header().slot_bytes);
+}
+
+#ifndef _WIN32
+SharedMemory::~SharedMemory() {
+  munmap(data_, size_);
+  if (owner_) {
+    shm_unlink(name_.c_str());
+  }
+}
+
+// Map `size` bytes of the shared memory object `fd` for reading and writing.
+static uint8_t* Map(const int fd, const std::size_t size, const std::string& name) {
+  void* const mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  ASSERT(mapped != MAP_FAILED, "Failed to map shared memory {}: {}", name, std::strerror(errno));
+  return static_cast<uint8_t*>(mapped);
+}
+
+// True if process `pid` is running (it may belong to another user).
+static bool ProcessAlive(const int32_t pid) { return kill(static_cast<pid_t>(pid), 0) == 0 || errno == EPERM; }
+
+RingWriter::RingWriter(const std::string& name, const int face_size, const std::size_t num_slots,
+                       const std::chrono::milliseconds timeout)
+    : timeout_(timeout) {
+  ASSERT(face_size > 0 && num_slots > 0, "Invalid ring: face size = {}, slots = {}", face_size, num_slots);
+  // Replace the ring of a previous run, if there is one:
+  shm_unlink(name.c_str());
+  const int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+  ASSERT(fd >= 0, "Failed to create shared memory {}: {}", name, std::strerror(errno));
+  const std::size_t slot_bytes = SlotBytes(face_size);
+  const std::size_t size = kHeaderBytes + num_slots * slot_bytes;
+  const int truncated = ftruncate(fd, static_cast<off_t>(size));
+  const int error = errno;
+  if (truncated != 0) {
+    close(fd);
+    shm_unlink(name.c_str());
+  }
+  ASSERT(truncated == 0, "Failed to allocate {} bytes of shared memory {}: {}", size, name, std::strerror(error));
+  memory_ = std::make_unique<SharedMemory>(name, Map(fd, size, name), size, true);
+  close(fd);
+
+  // The object is zero filled, so the counters start at zero:
+  RingHeader& header = memory_->Header();
+  header.version = kVersion;
+  header.face_size = static_cast<uint32_t>(face_size);
+  header.num_slots = static_cast<uint32_t>(num_slots);
+  header.slot_bytes = slot_bytes;
+  header.producer_pid = static_cast<int32_t>(getpid());
+  header.magic.store(kMagic, std::memory_order_release);
+}
+
+RingWriter::~RingWriter() {
+  // Don't wait: a consumer that already mapped the ring reads the remaining frames after it is removed.
+  memory_->Header().closed.store(1, std::memory_order_release);
+}
+
+template <typename F>
+bool RingWriter::WaitForConsumer(F&& done) const {
+  const RingHeader& header = memory_->Header();
+  uint64_t num_read = header.num_read.load(std::memory_order_acquire);
+  auto deadline = std::chrono::steady_clock::now() + timeout_;
+  while (!done()) {
+    const int32_t consumer_pid = header.consumer_pid.load(std::memory_order_acquire);
+    if (consumer_pid != 0 && !ProcessAlive(consumer_pid)) {
+      return false;
+    }
+    // The deadline restarts whenever the consumer reads a frame:
+    const uint64_t latest_read = header.num_read.load(std::memory_order_acquire);
+    if (latest_read != num_read) {
+      num_read = latest_read;
+      deadline = std::chrono::steady_clock::now() + timeout_;
+    } else if (std::chrono::steady_clock::now() > deadline) {
+      return false;
+    }
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+  }
+  return true;
+}
+
+void RingWriter::Write(const std::size_t index, const std::vector<images::SimpleImage>& faces) {
+  RingHeader& header = memory_->Header();
+  const int face_size = static_cast<int>(header.face_size);
+  ASSERT(faces.size() == 12, "Expected 12 cubemap faces, got: {}", faces.size());
+  for (std::size_t face = 0; face < faces.size(); ++face) {
+    const bool is_depth = face >= 6;
+    ASSERT(faces[face].width == face_size && faces[face].height == face_size &&
+               faces[face].components == (is_depth ? 1 : 3) &&
+               faces[face].depth == (is_depth ? images::ImageDepth::Bits16 : images::ImageDepth::Bits8),
+           "Face {} does not match the ring: [{}, {}] w/ {} channels, ring faces are {}x{}", face, faces[face].width,
+           faces[face].height, faces[face].components, face_size, face_size);
+  }
+
+  // Only we write `num_written`, so a relaxed load is enough:
+  const uint64_t sequence = header.num_written.load(std::memory_order_relaxed);
+  const bool slot_free = WaitForConsumer(
+      [&] { return sequence - header.num_read.load(std::memory_order_acquire) < header.num_slots; });
+  ASSERT(slot_free, "The consumer of the ring exited, or read no frames for {} ms.", timeout_.count());
+  uint8_t* const slot = memory_->Slot(sequence % header.num_slots);
+  const SlotHeader slot_header{sequence, index};
+  std::memcpy(slot, &slot_header, sizeof(slot_header));
+  uint8_t* destination = slot + kSlotHeaderBytes;
+  for (const images::SimpleImage& face : faces) {
+    std::memcpy(destination, face.data.data(), face.data.size());
+    destination += face.data.size();
+  }
+  header.num_written.store(sequence + 1, std::memory_order_release);
+}
+
+bool RingWriter::Close() {
+  RingHeader& header = memory_->Header();
+  header.closed.store(1, std::memory_order_release);
+  const uint64_t num_written = header.num_written.load(std::memory_order_relaxed);
+  return WaitForConsumer([&] { return header.num_read.load(std::memory_order_acquire) == num_written; });
+}
+
+std::optional<RingReader> RingReader::Open(const std::string& name) {
+  const int fd = shm_open(name.c_str(), O_RDWR, 0);
+  if (fd < 0) {
+    ASSERT(errno == ENOENT, "Failed to open shared memory {}: {}", name, std::strerror(errno));
+    return std::nullopt;
+  }
+  struct stat file_stat {};
+  const bool sized = fstat(fd, &file_stat) == 0 && static_cast<std::size_t>(file_stat.st_size) >= kHeaderBytes;
+  if (!sized) {
+    // The producer has not allocated it yet.
+    close(fd);
+    return std::nullopt;
+  }
+  const std::size_t size = static_cast<std::size_t>(file_stat.st_size);
+  auto memory = std::make_unique<SharedMemory>(name, Map(fd, size, name), size, false);
+  close(fd);
+
+  const RingHeader& header = memory->Header();
+  const uint32_t magic = header.magic.load(std::memory_order_acquire);
+  if (magic == 0) {
+    // The producer has not written the header yet.
+    return std::nullopt;
+  }
+  ASSERT(magic == kMagic && header.version == kVersion, "{} is not a cubemap ring of version {}", name, kVersion);
+  ASSERT(header.slot_bytes == SlotBytes(static_cast<int>(header.face_size)) &&
+             size >= kHeaderBytes + header.num_slots * header.slot_bytes,
+         "Shared memory {} is too small for {} slots of {}x{} faces", name, header.num_slots, header.face_size,
+         header.face_size);
+  memory->Header().consumer_pid.store(static_cast<int32_t>(getpid()), std::memory_order_release);
+  return RingReader{std::move(memory)};
+}
+
+std::optional<Frame> RingReader::TryRead() {
+  RingHeader& header = memory_->Header();
+  // Only we write `num_read`:
+  const uint64_t sequence = header.num_read.load(std::memory_order_relaxed);
+  if (sequence >= header.num_written.load(std::memory_order_acquire)) {
+    // A producer that exited w/o closing the ring will not publish anything (a restarted one replaces the ring):
+    ASSERT(header.closed.load(std::memory_order_acquire) != 0 || ProcessAlive(header.producer_pid),
+           "The producer of the ring (pid {}) exited w/o closing it.", header.producer_pid);
+    return std::nullopt;
+  }
+  const uint8_t* const slot = memory_->Slot(sequence % header.num_slots);
+  SlotHeader slot_header{};
+  std::memcpy(&slot_header, slot, sizeof(slot_header));
+  ASSERT(slot_header.sequence == sequence, "Ring slot has sequence number {}, expected {}", slot_header.sequence,
+         sequence);
+
+  const int face_size = FaceSize();
+  Frame frame{static_cast<std::size_t>(slot_header.frame_index), {}};
+  frame.faces.reserve(12);
+  const uint8_t* source = slot + kSlotHeaderBytes;
+  for (std::size_t face = 0; face < 12; ++face) {
+    const bool is_depth = face >= 6;
+    images::SimpleImage& image = frame.faces.emplace_back(
+        face_size, face_size, is_depth ? 1 : 3, is_depth ? images::ImageDepth::Bits16 : images::ImageDepth::Bits8);
+    std::memcpy(image.data.data(), source, image.data.size());
+    source += image.data.size();
+  }
+  // The faces are copied out, so the producer can re-use the slot:
+  header.num_read.store(sequence + 1, std::memory_order_release);
+  return frame;
+}
+
+bool RingReader::Finished() const {
+  const RingHeader& header = memory_->Header();
+  return header.closed.load(std::memory_order_acquire) != 0 &&
+         header.num_read.load(std::memory_order_relaxed) == header.num_written.load(std::memory_order_acquire);
+}
+#else
+SharedMemory::~SharedMemory() = default;
+
+RingWriter::RingWriter(const std::string&, int, std::size_t, const std::chrono::milliseconds timeout)
+    : timeout_(timeout) {
+  ASSERT(false, "Shared memory rings are not supported on Windows.");
+}
+
+RingWriter::~RingWriter() = default;
+
+void RingWriter::Write(std::size_t, const std::vector<images::SimpleImage>&) {}
+
+bool RingWriter::Close() { return true; }
+
+std::optional<RingReader> RingReader::Open(const std::string&) {
+  ASSERT(false, "Shared memory rings are not supported on Windows.");
+  return std::nullopt;
+}
+
+std::optional<Frame> RingReader::TryRead() { return std::nullopt; }
+
+bool RingReader::Finished() const { return true; }
+#endif
+
+std::optional<std::size_t> RingFrameSource::Next() {
+  if (!reader_) {
+    reader_ = RingReader::Open(name_);
+    if (!reader_) {
+      return std::nullopt;
+    }
+    fmt::print("Reading frames w/ {}x{} faces from shared memory: {}\n", reader_->FaceSize(), reader_->FaceSize(),
+               name_);
+  }
+  std::optional<Frame> frame = reader_->TryRead();
+  if (!frame) {
+    return std::nullopt;
+  }
+  const std::lock_guard<std::mutex> lock{mutex_};
+  ASSERT(frames_.emplace(frame->index, std::move(frame->faces)).second, "Frame {} was published twice.", frame->index);
+  return frame->index;
+}
+
+std::vector<images::SimpleImage> RingFrameSource::TakeFaces(const std::size_t index) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  const auto it = frames_.find(index);
+  ASSERT(it != frames_.end(), "Frame {} was not read from the ring.", index);
+  std::vector<images::SimpleImage> faces = std::move(it->second);
+  frames_.erase(it);
+  return faces;
+}
+
+}  // namespace shm_ring
@@ -0,0 +1,164 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "frame_source.hpp"
+#include "images.hpp"
+
+// A ring buffer of cubemap frames in POSIX shared memory, so that a producer (eg. a simulator) can hand raw faces to
+// the converter w/o encoding and decoding PNG files.
+//
+// The shared memory object starts w/ a `RingHeader`, followed by `num_slots` slots of `slot_bytes` each. A slot is a
+// `SlotHeader` (padded to 64 bytes), followed by the 6 RGB faces (8-bit, 3 channels) and then the 6 inverse depth faces
+// (16-bit, 1 channel), each `face_size` x `face_size` w/ rows top to bottom. This is the layout of the faces returned
+// by `images::LoadCubemapImages`.
+//
+// There is one producer and one consumer. Frame `n` (counting from zero) goes into slot `n % num_slots`. The producer
+// waits until `num_written - num_read < num_slots`, fills the slot, and then increments `num_written`. The consumer
+// waits until `num_read < num_written`, copies the slot, and then increments `num_read`. Once done, the producer sets
+// `closed`.
+//
+// Each side records its process id in the header, so neither waits forever on a process that died: the producer gives
+// up on a consumer that exited (or never attached within a timeout), and the consumer fails if the producer exited w/o
+// closing the ring (eg. it crashed, or was restarted and replaced the ring).
+namespace shm_ring {
+
+constexpr uint32_t kMagic = 0x47524d43;  // "CMRG"
+constexpr uint32_t kVersion = 2;
+
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "Shared counters must be lock free");
+static_assert(std::atomic<int32_t>::is_always_lock_free, "Shared process ids must be lock free");
+
+struct RingHeader {
+  // Written last by the producer, once the rest of the header is valid.
+  std::atomic<uint32_t> magic;
+  uint32_t version;
+  uint32_t face_size;
+  uint32_t num_slots;
+  uint64_t slot_bytes;
+  std::atomic<uint64_t> num_written;
+  std::atomic<uint64_t> num_read;
+  std::atomic<uint32_t> closed;
+  // Process ids of the producer, and of the consumer (zero until one attaches).
+  int32_t producer_pid;
+  std::atomic<int32_t> consumer_pid;
+};
+
+struct SlotHeader {
+  // Sequence number of the frame in the slot: the value of `num_written` when it was written.
+  uint64_t sequence;
+  // Index of the frame in the dataset, which names the outputs.
+  uint64_t frame_index;
+};
+
+// Size of one slot in bytes, for faces of `face_size` x `face_size`.
+std::size_t SlotBytes(int face_size);
+
+// A frame read from the ring.
+struct Frame {
+  std::size_t index;
+  std::vector<images::SimpleImage> faces;
+};
+
+// Mapping of a shared memory object.
+class SharedMemory {
+ public:
+  SharedMemory(std::string name, uint8_t* data, std::size_t size, bool owner) noexcept
+      : name_(std::move(name)), data_(data), size_(size), owner_(owner) {}
+  ~SharedMemory();
+
+  SharedMemory(const SharedMemory&) = delete;
+  SharedMemory& operator=(const SharedMemory&) = delete;
+
+  [[nodiscard]] RingHeader& Header() const { return *reinterpret_cast<RingHeader*>(data_); }
+  [[nodiscard]] uint8_t* Slot(std::size_t slot) const;
+
+ private:
+  std::string name_;
+  uint8_t* data_;
+  std::size_t size_;
+  // The creator removes the object when done.
+  bool owner_;
+};
+
+// Producer side: creates the ring (replacing a previous one of the same name), and removes it when destroyed. Closes
+// the ring w/o waiting for the consumer when destroyed, if `Close` was not called.
+class RingWriter {
+ public:
+  // `name` is a POSIX shared memory name, eg. `/cubemap_ring`. Waiting on the consumer fails after `timeout` w/o
+  // progress. Asserts on failure.
+  RingWriter(const std::string& name, int face_size, std::size_t num_slots,
+             std::chrono::milliseconds timeout = std::chrono::seconds(60));
+  ~RingWriter();
+
+  RingWriter(const RingWriter&) = delete;
+  RingWriter& operator=(const RingWriter&) = delete;
+
+  // Wait for a free slot, and publish frame `index` w/ `faces` (in the layout described above). Asserts if the
+  // consumer exited, or did not free a slot within the timeout.
+  void Write(std::size_t index, const std::vector<images::SimpleImage>& faces);
+
+  // Tell the consumer there are no more frames, and wait until it read the frames already written (the ring is removed
+  // once we are destroyed). Returns false if the consumer exited, or stopped reading for longer than the timeout.
+  bool Close();
+
+ private:
+  // Wait until `done` returns true. Returns false if the consumer exited or made no progress within the timeout.
+  template <typename F>
+  bool WaitForConsumer(F&& done) const;
+
+  std::unique_ptr<SharedMemory> memory_;
+  std::chrono::milliseconds timeout_;
+};
+
+// Consumer side: maps a ring created by a producer.
+class RingReader {
+ public:
+  // Returns nullopt if there is no ring called `name` (yet). Asserts if it exists but is not a valid ring.
+  static std::optional<RingReader> Open(const std::string& name);
+
+  // Copy the next frame out of the ring and release its slot, or return nullopt if none was published yet. Asserts if
+  // the producer exited w/o closing the ring.
+  std::optional<Frame> TryRead();
+
+  // True once the producer closed the ring, and every frame was read.
+  [[nodiscard]] bool Finished() const;
+
+  [[nodiscard]] int FaceSize() const { return static_cast<int>(memory_->Header().face_size); }
+
+ private:
+  explicit RingReader(std::unique_ptr<SharedMemory> memory) : memory_(std::move(memory)) {}
+
+  std::unique_ptr<SharedMemory> memory_;
+};
+
+// Frames published to a ring. `Next` reads the next frame out of the ring, and its faces are held until `TakeFaces`
+// is called w/ its index. Waits for the producer to create the ring.
+class RingFrameSource final : public FrameSource {
+ public:
+  explicit RingFrameSource(std::string name) : name_(std::move(name)) {}
+
+  std::optional<std::size_t> Next() override;
+
+  [[nodiscard]] bool Done() const override { return reader_.has_value() && reader_->Finished(); }
+
+  // The faces of a frame returned by `Next`. May be called from any thread.
+  std::vector<images::SimpleImage> TakeFaces(std::size_t index);
+
+ private:
+  std::string name_;
+  std::optional<RingReader> reader_{};
+  std::mutex mutex_{};
+  std::map<std::size_t, std::vector<images::SimpleImage>> frames_{};
+};
+
+}  // namespace shm_ring
@@ -0,0 +1,241 @@
+// Copyright 2023 Gareth Cross
+#include "synthetic_dataset.hpp"
+
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <limits>
+#include <string>
+#include <thread>
+
+#include <fmt/format.h>
+
+#ifdef _MSC_VER
+#pragma warning(push)
+#pragma warning(disable : 4201)  //  nameless struct/union
+#endif
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+#ifdef _MSC_VER
+#pragma warning(pop)
+#endif
+
+#include "assertions.hpp"
+#include "file_utils.hpp"
+
+namespace synthetic_dataset {
+
+// Faces cover 95 degrees, like the oversampled cubemaps exported from Unreal (see `RenderParams::oversampled_fov`).
+static const float kHalfFovTangent = static_cast<float>(std::tan(0.5 * 95.0 * M_PI / 180.0));
+
+// Forward, right and down axes of each face (in camera coordinates, GL cubemap convention).
+struct FaceBasis {
+  glm::vec3 forward;
+  glm::vec3 right;
+  glm::vec3 down;
+};
+static const std::array<FaceBasis, 6> kFaceBases = {{
+    {{1, 0, 0}, {0, 0, -1}, {0, -1, 0}},
+    {{-1, 0, 0}, {0, 0, 1}, {0, -1, 0}},
+    {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}},
+    {{0, -1, 0}, {1, 0, 0}, {0, 0, -1}},
+    {{0, 0, 1}, {1, 0, 0}, {0, -1, 0}},
+    {{0, 0, -1}, {-1, 0, 0}, {0, -1, 0}},
+}};
+
+// Integer hash w/ good avalanche ("lowbias32").
+static uint32_t Hash(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352dU;
+  x ^= x >> 15;
+  x *= 0x846ca68bU;
+  x ^= x >> 16;
+  return x;
+}
+
+// Uniform value in [0, 1] from a hash.
+static float HashToUnit(const uint32_t hash) { return static_cast<float>(hash & 0xffffffU) / 16777215.0f; }
+
+static float LatticeValue(const glm::ivec3& p, const uint32_t seed) {
+  return HashToUnit(Hash(static_cast<uint32_t>(p.x) * 73856093U ^ static_cast<uint32_t>(p.y) * 19349663U ^
+                         static_cast<uint32_t>(p.z) * 83492791U ^ seed));
+}
+
+// Smoothly interpolated lattice noise in [0, 1].
+static float ValueNoise(const glm::vec3& p, const uint32_t seed) {
+  const glm::vec3 cell = glm::floor(p);
+  const glm::vec3 f = p - cell;
+  const glm::vec3 w = f * f * (3.0f - 2.0f * f);
+  const glm::ivec3 i{cell};
+  const auto lerp_x = [&](const int dy, const int dz) {
+    return glm::mix(LatticeValue(i + glm::ivec3{0, dy, dz}, seed), LatticeValue(i + glm::ivec3{1, dy, dz}, seed),
+                    w.x);
+  };
+  return glm::mix(glm::mix(lerp_x(0, 0), lerp_x(1, 0), w.y), glm::mix(lerp_x(0, 1), lerp_x(1, 1), w.y), w.z);
+}
+
+// Sum of `octaves` octaves of value noise, normalized to [0, 1].
+static float FractalNoise(glm::vec3 p, const uint32_t seed, const int octaves) {
+  float sum = 0.0f;
+  float amplitude = 1.0f;
+  float total_amplitude = 0.0f;
+  for (int octave = 0; octave < octaves; ++octave) {
+    sum += amplitude * ValueNoise(p, seed + static_cast<uint32_t>(octave));
+    total_amplitude += amplitude;
+    amplitude *= 0.5f;
+    p *= 2.03f;
+  }
+  return sum / total_amplitude;
+}
+
+// The room all cameras are in: an axis aligned box w/ these half extents (z is up), centered on the origin.
+static glm::vec3 RoomHalfExtents(const uint32_t seed) {
+  return glm::vec3{6.0f + 4.0f * HashToUnit(Hash(seed ^ 0x1U)), 5.0f + 4.0f * HashToUnit(Hash(seed ^ 0x2U)),
+                   2.5f + 1.0f * HashToUnit(Hash(seed ^ 0x3U))};
+}
+
+// Pose of the rig at `frame`: a slow loop around the room, yawing as it goes.
+struct Pose {
+  glm::vec3 position;
+  glm::fquat world_R_rig;
+};
+static Pose RigPose(const std::size_t frame) {
+  const float t = static_cast<float>(frame);
+  const float yaw = 0.03f * t;
+  return Pose{glm::vec3{2.0f * std::sin(0.02f * t), 1.5f * std::cos(0.02f * t), 0.2f * std::sin(0.05f * t)},
+              glm::angleAxis(yaw, glm::vec3{0.0f, 0.0f, 1.0f})};
+}
+
+// Cameras are spread out along the y axis of the rig, and rotated about z.
+static Pose CameraPose(const std::size_t frame, const std::size_t camera) {
+  const Pose rig = RigPose(frame);
+  const glm::vec3 offset{0.0f, 0.15f * static_cast<float>(camera), 0.0f};
+  const glm::fquat rig_R_camera = glm::angleAxis(0.4f * static_cast<float>(camera), glm::vec3{0.0f, 0.0f, 1.0f});
+  return Pose{rig.position + rig.world_R_rig * offset, rig.world_R_rig * rig_R_camera};
+}
+
+std::vector<images::SimpleImage> MakeFaces(const DatasetOptions& options, const std::size_t frame,
+                                           const std::size_t camera) {
+  ASSERT(options.face_size > 0, "Invalid face size: {}", options.face_size);
+  const int size = options.face_size;
+  const glm::vec3 half_extents = RoomHalfExtents(options.seed);
+  const Pose pose = CameraPose(frame, camera);
+  const glm::mat3 world_R_camera = glm::mat3_cast(pose.world_R_rig);
+
+  std::vector<images::SimpleImage> faces{};
+  for (int face = 0; face < 6; ++face) {
+    faces.emplace_back(size, size, 3, images::ImageDepth::Bits8);
+  }
+  for (int face = 0; face < 6; ++face) {
+    faces.emplace_back(size, size, 1, images::ImageDepth::Bits16);
+  }
+
+  for (int face = 0; face < 6; ++face) {
+    const FaceBasis& basis = kFaceBases[face];
+    uint8_t* const rgb = faces[face].data.data();
+    uint16_t* const inv_depth = reinterpret_cast<uint16_t*>(faces[face + 6].data.data());
+    for (int y = 0; y < size; ++y) {
+      for (int x = 0; x < size; ++x) {
+        const float u = (2.0f * (static_cast<float>(x) + 0.5f) / static_cast<float>(size) - 1.0f) * kHalfFovTangent;
+        const float v = (2.0f * (static_cast<float>(y) + 0.5f) / static_cast<float>(size) - 1.0f) * kHalfFovTangent;
+        // The forward component is one, so the distance along the ray is the (planar) depth of the face:
+        const glm::vec3 direction = world_R_camera * (basis.forward + u * basis.right + v * basis.down);
+
+        // Intersect the walls of the room:
+        float depth = std::numeric_limits<float>::infinity();
+        int wall = 0;
+        for (int axis = 0; axis < 3; ++axis) {
+          if (direction[axis] == 0.0f) {
+            continue;
+          }
+          const float bound = direction[axis] > 0.0f ? half_extents[axis] : -half_extents[axis];
+          const float t = (bound - pose.position[axis]) / direction[axis];
+          if (t > 0.0f && t < depth) {
+            depth = t;
+            wall = axis * 2 + (direction[axis] > 0.0f ? 0 : 1);
+          }
+        }
+        const glm::vec3 hit = pose.position + depth * direction;
+
+        // Large features, plus fine texture and a little sensor noise, so PNGs compress about as well as renders:
+        const uint32_t wall_seed = Hash(options.seed + static_cast<uint32_t>(wall) * 977U);
+        const float pattern = FractalNoise(hit * 1.5f, wall_seed, 4);
+        const float detail = ValueNoise(hit * 40.0f, wall_seed ^ 0x55U);
+        const float shading = 1.0f / (1.0f + 0.04f * depth);
+        const std::size_t pixel = static_cast<std::size_t>(y) * size + x;
+        const uint32_t pixel_hash =
+            Hash(static_cast<uint32_t>(pixel) ^ Hash(static_cast<uint32_t>(frame * 6 + face) ^ options.seed));
+        for (int c = 0; c < 3; ++c) {
+          const float base = 0.35f + 0.5f * HashToUnit(Hash(wall_seed + static_cast<uint32_t>(c)));
+          const float sensor_noise = (HashToUnit(pixel_hash >> (c * 3)) - 0.5f) * (4.0f / 255.0f);
+          const float value = base * shading * (0.55f + 0.45f * pattern + 0.1f * detail) + sensor_noise;
+          rgb[pixel * 3 + c] = static_cast<uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+        }
+
+        // Walls have some relief, so depth is not perfectly planar:
+        const float relief = 0.03f * (FractalNoise(hit * 4.0f, wall_seed ^ 0xaaU, 2) - 0.5f);
+        const float inv_depth_normalized = std::min(options.clip_plane_meters / (depth * (1.0f + relief)), 1.0f);
+        inv_depth[pixel] = static_cast<uint16_t>(inv_depth_normalized * 65535.0f + 0.5f);
+      }
+    }
+  }
+  return faces;
+}
+
+// Write the pose of the rig for every frame, at 30 Hz. The file is written atomically, since it marks the dataset as
+// complete.
+static void WriteGroundTruth(const std::filesystem::path& path, const DatasetOptions& options) {
+  std::string contents = "# timestamp_ns,x,y,z,qw,qx,qy,qz\n";
+  for (std::size_t frame = 0; frame < options.num_frames; ++frame) {
+    const Pose pose = RigPose(frame);
+    const glm::fquat& q = pose.world_R_rig;
+    contents += fmt::format("{},{:.6f},{:.6f},{:.6f},{:.8f},{:.8f},{:.8f},{:.8f}\n", frame * 33333333,
+                            pose.position.x, pose.position.y, pose.position.z, q.w, q.x, q.y, q.z);
+  }
+  file_utils::WriteFileDurably(path, reinterpret_cast<const uint8_t*>(contents.data()), contents.size());
+}
+
+void WriteDataset(const std::filesystem::path& root, const DatasetOptions& options, const std::size_t num_threads) {
+  // The ground truth is written last, so a dataset that was only partially (re)written is not mistaken for a complete
+  // one:
+  const std::filesystem::path ground_truth_path = root / "ground_truth_imu_pose_00.csv";
+  std::error_code remove_err{};
+  std::filesystem::remove(ground_truth_path, remove_err);
+  ASSERT(!remove_err, "Failed to remove: `{}`. Error = {}", ground_truth_path.u8string(), remove_err.message());
+
+  for (std::size_t camera = 0; camera < options.num_cameras; ++camera) {
+    for (const std::string_view sub_folder : {"image", "depth"}) {
+      const std::filesystem::path directory = root / sub_folder / fmt::format("camera{:02}", camera);
+      std::error_code err{};
+      std::filesystem::create_directories(directory, err);
+      ASSERT(!err, "Failed to create directory: `{}`. Error = {}", directory.u8string(), err.message());
+    }
+  }
+
+  // Each thread takes the next (frame, camera) pair until there are none left:
+  std::atomic<std::size_t> next_task{0};
+  const std::size_t num_tasks = options.num_frames * options.num_cameras;
+  const auto worker = [&] {
+    for (std::size_t task = next_task++; task < num_tasks; task = next_task++) {
+      const std::size_t frame = task / options.num_cameras;
+      const std::size_t camera = task % options.num_cameras;
+      const std::vector<images::SimpleImage> faces = MakeFaces(options, frame, camera);
+      for (std::size_t face = 0; face < faces.size(); ++face) {
+        const std::filesystem::path path = root / (face < 6 ? "image" : "depth") /
+                                           fmt::format("camera{:02}", camera) /
+                                           fmt::format("{:08}_{:02}.png", frame, face % 6);
+        images::WritePng(path, faces[face], false, options.compression_level);
+      }
+    }
+  };
+  std::vector<std::thread> threads{};
+  for (std::size_t i = 0; i < std::max(num_threads, std::size_t{1}); ++i) {
+    threads.emplace_back(worker);
+  }
+  for (std::thread& thread : threads) {
+    thread.join();
+  }
+  WriteGroundTruth(ground_truth_path, options);
+}
+
+}  // namespace synthetic_dataset
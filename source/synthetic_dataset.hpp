@@ -0,0 +1,38 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+#include "images.hpp"
+
+// Procedural datasets in the layout exported from Unreal Engine, for benchmarks and tests.
+// Each camera sits in a box shaped room w/ textured walls, and moves along a smooth path. The faces of all cameras and
+// frames are consistent w/ each other, and the output is deterministic for a given seed.
+namespace synthetic_dataset {
+
+struct DatasetOptions {
+  // Width and height of each cubemap face.
+  int face_size{1024};
+  std::size_t num_frames{10};
+  std::size_t num_cameras{1};
+  // zlib level of the PNG files. The default matches the outputs of the converter.
+  int compression_level{6};
+  uint32_t seed{0};
+  // Clip plane used to normalize inverse depth, as `RenderParams::ue_clip_plane_meters`.
+  float clip_plane_meters{0.1f};
+};
+
+// The 12 faces of camera `camera` at frame `frame`: 6 RGB (8-bit), then 6 inverse depth (16-bit). This is what
+// `images::LoadCubemapImages` returns for the files written by `WriteDataset`.
+std::vector<images::SimpleImage> MakeFaces(const DatasetOptions& options, std::size_t frame, std::size_t camera);
+
+// Write a dataset under `root`:
+//   image/cameraNN/FFFFFFFF_XX.png  - RGB face XX of frame FFFFFFFF
+//   depth/cameraNN/FFFFFFFF_XX.png  - inverse depth face XX of frame FFFFFFFF
+//   ground_truth_imu_pose_00.csv    - pose of the rig per frame: timestamp_ns,x,y,z,qw,qx,qy,qz
+// Faces are generated and written on `num_threads` threads. The ground truth is written last, so its presence marks a
+// complete dataset.
+void WriteDataset(const std::filesystem::path& root, const DatasetOptions& options, std::size_t num_threads);
+
+}  // namespace synthetic_dataset
@@ -1,65 +1,260 @@
 // Copyright 2023 Gareth Cross
 #pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string_view>
+
+#include <fmt/format.h>
+
+#include "perf_counters.hpp"
+#include "trace.hpp"
 
 namespace timing {
 
-// Very basic tic-toc mechanism to time to the different stages.
-// Just keeps a running average of the last `NumTics` measurements for each stage.
-struct SimpleTimer {
-  struct Tics {
-    static constexpr std::size_t NumTics = 20;
-
-    // Zero initialize:
-    Tics() { std::fill(tics.begin(), tics.end(), 0.0); }
-
-    // Time the lambda and add it to the tics.
-    template <typename F>
-    void Record(F&& func) {
-      const auto start = std::chrono::steady_clock::now();
-      std::invoke(std::forward<F>(func));
-      const auto end = std::chrono::steady_clock::now();
-      const auto nanos = std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count();
-      tics[counter % NumTics] = static_cast<double>(nanos) / 1.0e9;
-      if (++counter == std::numeric_limits<std::size_t>::max()) {
-        counter = 0;
-      }
+// Histogram of durations w/ logarithmically spaced buckets: `SubBuckets` per power of two, from 1us to ~137s.
+// Bucket edges are within ~9% of each other, which bounds the error of the percentiles.
+// Recording is lock-free (relaxed atomics), so any thread may record into the same histogram.
+class Histogram {
+ public:
+  static constexpr int SubBuckets = 8;
+  static constexpr int MinExponent = 10;  //  2^10 ns ~= 1us, everything faster lands in the first bucket.
+  static constexpr int MaxExponent = 37;  //  2^37 ns ~= 137s, everything slower lands in the last bucket.
+  static constexpr std::size_t NumBuckets = (MaxExponent - MinExponent) * SubBuckets + 1;
+
+  // Add a sample.
+  void Add(const std::chrono::nanoseconds duration) {
+    const uint64_t nanos = static_cast<uint64_t>(std::max(duration.count(), std::chrono::nanoseconds::rep{0}));
+    buckets_[BucketIndex(nanos)].fetch_add(1, std::memory_order_relaxed);
+    count_.fetch_add(1, std::memory_order_relaxed);
+    total_nanos_.fetch_add(nanos, std::memory_order_relaxed);
+    uint64_t max = max_nanos_.load(std::memory_order_relaxed);
+    while (nanos > max && !max_nanos_.compare_exchange_weak(max, nanos, std::memory_order_relaxed)) {
     }
+  }
+
+  // Number of samples.
+  [[nodiscard]] uint64_t Count() const { return count_.load(std::memory_order_relaxed); }
+
+  // Sum of all samples in seconds.
+  [[nodiscard]] double TotalSeconds() const {
+    return static_cast<double>(total_nanos_.load(std::memory_order_relaxed)) / 1.0e9;
+  }
+
+  // Mean in milliseconds, or zero if there are no samples.
+  [[nodiscard]] double MeanMillis() const {
+    const uint64_t count = Count();
+    return count > 0 ? TotalSeconds() * 1.0e3 / static_cast<double>(count) : 0.0;
+  }
+
+  // Largest sample in milliseconds.
+  [[nodiscard]] double MaxMillis() const {
+    return static_cast<double>(max_nanos_.load(std::memory_order_relaxed)) / 1.0e6;
+  }
 
-    // Get average time in milliseconds.
-    [[nodiscard]] double GetAverageMillis() const {
-      const std::size_t count = std::min(counter, NumTics);
-      if (count == 0) {
-        return -1.0;
+  // Approximate percentile (`fraction` in [0, 1]) in milliseconds: the upper edge of the bucket containing it (but
+  // never more than the max). Zero if there are no samples.
+  [[nodiscard]] double PercentileMillis(const double fraction) const {
+    const uint64_t count = Count();
+    if (count == 0) {
+      return 0.0;
+    }
+    const auto rank = static_cast<uint64_t>(std::ceil(fraction * static_cast<double>(count)));
+    uint64_t cumulative = 0;
+    for (std::size_t i = 0; i < NumBuckets; ++i) {
+      cumulative += buckets_[i].load(std::memory_order_relaxed);
+      if (cumulative >= std::max(rank, uint64_t{1})) {
+        return std::min(BucketUpperEdgeNanos(i) / 1.0e6, MaxMillis());
       }
-      return std::accumulate(tics.begin(), tics.end(), 0.0) * 1000.0 / static_cast<double>(count);
     }
+    return MaxMillis();
+  }
+
+ private:
+  static std::size_t BucketIndex(const uint64_t nanos) {
+    if (nanos < (uint64_t{1} << MinExponent)) {
+      return 0;
+    }
+    // Position of the leading bit, then the next `log2(SubBuckets)` bits select the sub-bucket.
+    int exponent = 63;
+    while (!(nanos >> exponent)) {
+      --exponent;
+    }
+    if (exponent >= MaxExponent) {
+      return NumBuckets - 1;
+    }
+    const uint64_t sub_bucket = (nanos >> (exponent - 3)) & (SubBuckets - 1);
+    return static_cast<std::size_t>((exponent - MinExponent) * SubBuckets) + static_cast<std::size_t>(sub_bucket) + 1;
+  }
+
+  static double BucketUpperEdgeNanos(const std::size_t index) {
+    if (index == 0) {
+      return static_cast<double>(uint64_t{1} << MinExponent);
+    }
+    const std::size_t exponent = (index - 1) / SubBuckets + MinExponent;
+    const std::size_t sub_bucket = (index - 1) % SubBuckets;
+    return std::ldexp(1.0 + static_cast<double>(sub_bucket + 1) / SubBuckets, static_cast<int>(exponent));
+  }
 
-   private:
-    std::size_t counter{0};
-    std::array<double, NumTics> tics{};
+  static_assert(SubBuckets == 8, "BucketIndex assumes 3 bits of sub-bucket");
+  std::array<std::atomic<uint64_t>, NumBuckets> buckets_{};
+  std::atomic<uint64_t> count_{0};
+  std::atomic<uint64_t> total_nanos_{0};
+  std::atomic<uint64_t> max_nanos_{0};
+};
+
+// Very basic tic-toc mechanism to time to the different stages.
+// Keeps a histogram of every measurement of each stage over the whole run. `Record` may be called from any thread.
+// If a `TraceRecorder` is attached, every measurement is also added to the trace. If hardware counters are enabled,
+// the counters of the recording thread are accumulated per stage as well, and the counters of the whole process are
+// totaled over the run.
+struct SimpleTimer {
+  // Stages of the pipeline. `Load`, `Unpack`, `Render`, `Pack` and `Write` are timed on the main loop (`Write` is the
+  // time spent handing images to the writers). `Decode` and `Encode` are timed by the worker threads, per PNG face
+  // and per output frame respectively. `GpuRender` and `GpuReadback` are GPU execution times of the render and the
+  // framebuffer -> PBO copy (`Render` and `Pack` only measure command submission on the CPU). `WaitWriters` and
+  // `WaitPbo` are the time the main loop spends blocked on the writer queue and on mapping a PBO, respectively (they
+  // overlap `Write` and `Pack`). `CpuRender` is timed on the thread of the CPU engine w/ `--engine hybrid`, per frame.
+  enum class Stages : std::size_t {
+    Load = 0,
+    Unpack,
+    Render,
+    Pack,
+    Write,
+    Decode,
+    Encode,
+    GpuRender,
+    GpuReadback,
+    WaitWriters,
+    WaitPbo,
+    CpuRender,
+    MAX_VALUE
   };
 
-  enum class Stages : std::size_t { Load = 0, Unpack, Render, Pack, Write, MAX_VALUE };
+  // Name of a stage, for printing.
+  static constexpr std::string_view StageName(const Stages stage) {
+    constexpr std::array<std::string_view, static_cast<std::size_t>(Stages::MAX_VALUE)> names = {
+        "load",   "unpack",     "render",       "pack",         "write",    "decode",
+        "encode", "gpu_render", "gpu_readback", "wait_writers", "wait_pbo", "cpu_render"};
+    return names[static_cast<std::size_t>(stage)];
+  }
 
   // Record the time taken in a stage.
   template <typename F>
   void Record(Stages stage, F&& func) {
-    stages_[static_cast<std::size_t>(stage)].Record(std::forward<F>(func));
+    Record(stage, std::nullopt, std::forward<F>(func));
+  }
+
+  // Record the time taken in a stage while processing frame `frame`.
+  template <typename F>
+  void Record(Stages stage, const std::optional<std::size_t> frame, F&& func) {
+    const ThreadCounters* const thread_counters = counters_enabled_ ? &ThreadCounters::ForCurrentThread() : nullptr;
+    const CounterValues counters_start = thread_counters ? thread_counters->Read() : CounterValues{};
+    const auto start = std::chrono::steady_clock::now();
+    std::invoke(std::forward<F>(func));
+    const auto end = std::chrono::steady_clock::now();
+    if (thread_counters) {
+      counters_[static_cast<std::size_t>(stage)].Add(thread_counters->Read() - counters_start);
+    }
+    Add(stage, std::chrono::duration_cast<std::chrono::nanoseconds>(end - start));
+    if (trace_ != nullptr) {
+      trace_->AddEvent(StageName(stage), start, end, frame);
+    }
   }
 
-  // Print the times.
+  // Record a duration measured elsewhere.
+  void Add(Stages stage, const std::chrono::nanoseconds duration) {
+    stages_[static_cast<std::size_t>(stage)].Add(duration);
+  }
+
+  // Count bytes of data processed by a stage (eg. the size of the PNG files read by `Decode`).
+  void AddBytes(Stages stage, const uint64_t bytes) {
+    bytes_[static_cast<std::size_t>(stage)].fetch_add(bytes, std::memory_order_relaxed);
+  }
+
+  // Total bytes counted w/ `AddBytes`.
+  [[nodiscard]] uint64_t Bytes(Stages stage) const {
+    return bytes_[static_cast<std::size_t>(stage)].load(std::memory_order_relaxed);
+  }
+
+  // Attach a trace to record events into (or detach w/ nullptr). The trace must outlive the timer.
+  void SetTrace(TraceRecorder* const trace) { trace_ = trace; }
+
+  // The attached trace, or nullptr.
+  [[nodiscard]] TraceRecorder* Trace() const { return trace_; }
+
+  // Accumulate hardware counters for each stage, and for the whole process. Call before starting the worker threads,
+  // so the process totals include them. Returns false if counters are unavailable on this machine.
+  bool EnableHardwareCounters() {
+    counters_enabled_ = ThreadCounters::ForCurrentThread().IsAvailable();
+    if (counters_enabled_) {
+      process_counters_ = std::make_unique<ProcessCounters>();
+      process_counters_start_ = process_counters_->Read();
+    }
+    return counters_enabled_;
+  }
+
+  // Access the histogram of a stage.
+  [[nodiscard]] const Histogram& GetHistogram(Stages stage) const { return stages_[static_cast<std::size_t>(stage)]; }
+
+  // Print the times. Stages that were never recorded are skipped.
   void Summarize() const {
-    fmt::print("Times: load = {:.5f}, unpack = {:.5f}, render = {:.5f}, pack = {:.5f}, write = {:.5f} (milliseconds)\n",
-               stages_[static_cast<std::size_t>(Stages::Load)].GetAverageMillis(),
-               stages_[static_cast<std::size_t>(Stages::Unpack)].GetAverageMillis(),
-               stages_[static_cast<std::size_t>(Stages::Render)].GetAverageMillis(),
-               stages_[static_cast<std::size_t>(Stages::Pack)].GetAverageMillis(),
-               stages_[static_cast<std::size_t>(Stages::Write)].GetAverageMillis());
+    fmt::print("{:<12} {:>8} {:>10} {:>10} {:>10} {:>10} {:>10} {:>10}\n", "stage", "count", "total [s]", "mean [ms]",
+               "p50 [ms]", "p90 [ms]", "p99 [ms]", "max [ms]");
+    for (std::size_t i = 0; i < stages_.size(); ++i) {
+      const Histogram& histogram = stages_[i];
+      if (histogram.Count() == 0) {
+        continue;
+      }
+      fmt::print("{:<12} {:>8} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f} {:>10.3f}\n",
+                 StageName(static_cast<Stages>(i)), histogram.Count(), histogram.TotalSeconds(),
+                 histogram.MeanMillis(), histogram.PercentileMillis(0.5), histogram.PercentileMillis(0.9),
+                 histogram.PercentileMillis(0.99), histogram.MaxMillis());
+    }
+  }
+
+  // Print the hardware counters of each stage (if enabled), normalized by the number of output pixels processed.
+  // A stage only counts the thread that recorded it. The last row is the whole process, including threads that
+  // record no stage (eg. the row threads of the CPU engine, whose work is missing from `render`).
+  void SummarizeCounters(const uint64_t num_output_pixels) const {
+    if (!counters_enabled_) {
+      return;
+    }
+    const double pixels = static_cast<double>(std::max(num_output_pixels, uint64_t{1}));
+    fmt::print("{:<12} {:>12} {:>8} {:>14} {:>14} {:>14}\n", "stage", "Gcycles", "IPC", "cycles/px", "LLC miss/px",
+               "br miss/px");
+    const auto print_row = [pixels](const std::string_view name, const CounterValues& values) {
+      if (values.cycles == 0) {
+        return;  //  Not recorded on the CPU (or never recorded).
+      }
+      fmt::print("{:<12} {:>12.3f} {:>8.2f} {:>14.2f} {:>14.4f} {:>14.4f}\n", name,
+                 static_cast<double>(values.cycles) / 1.0e9,
+                 static_cast<double>(values.instructions) / static_cast<double>(values.cycles),
+                 static_cast<double>(values.cycles) / pixels, static_cast<double>(values.llc_misses) / pixels,
+                 static_cast<double>(values.branch_misses) / pixels);
+    };
+    for (std::size_t i = 0; i < counters_.size(); ++i) {
+      print_row(StageName(static_cast<Stages>(i)), counters_[i].Load());
+    }
+    if (process_counters_) {
+      print_row("process", process_counters_->Read() - process_counters_start_);
+    }
   }
 
  private:
-  std::array<Tics, static_cast<std::size_t>(Stages::MAX_VALUE)> stages_{};
+  std::array<Histogram, static_cast<std::size_t>(Stages::MAX_VALUE)> stages_{};
+  std::array<std::atomic<uint64_t>, static_cast<std::size_t>(Stages::MAX_VALUE)> bytes_{};
+  TraceRecorder* trace_{nullptr};
+  bool counters_enabled_{false};
+  std::array<AccumulatedCounters, static_cast<std::size_t>(Stages::MAX_VALUE)> counters_{};
+  std::unique_ptr<ProcessCounters> process_counters_{};
+  CounterValues process_counters_start_{};
 };
 
 }  // namespace timing
@@ -0,0 +1,113 @@
+// Copyright 2023 Gareth Cross
+#include "trace.hpp"
+
+#include <fstream>
+
+#include <fmt/format.h>
+
+#include "assertions.hpp"
+
+namespace timing {
+
+// The lane borrowed by the calling thread w/ `ScopedLane`, if any.
+struct BorrowedLane {
+  const TraceRecorder* trace{nullptr};
+  int index{-1};
+};
+static thread_local BorrowedLane borrowed_lane{};
+
+void TraceRecorder::AddEvent(const std::string_view name, const Clock::time_point begin, const Clock::time_point end,
+                             const std::optional<std::size_t> frame) {
+  using std::chrono::duration_cast;
+  using std::chrono::microseconds;
+  const int64_t begin_micros = duration_cast<microseconds>(begin - start_).count();
+  const int64_t duration_micros = duration_cast<microseconds>(end - begin).count();
+  const std::lock_guard<std::mutex> lock{mutex_};
+  events_.push_back(Event{name, begin_micros, duration_micros, ThreadIndex(), frame});
+}
+
+void TraceRecorder::NameCurrentThread(const std::string_view name) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  thread_names_[ThreadIndex()] = std::string{name};
+}
+
+int TraceRecorder::ThreadIndex() {
+  if (borrowed_lane.trace == this) {
+    return borrowed_lane.index;
+  }
+  const auto [it, inserted] = thread_indices_.emplace(std::this_thread::get_id(), num_lanes_);
+  num_lanes_ += inserted ? 1 : 0;
+  return it->second;
+}
+
+int TraceRecorder::AcquireLane(const std::string_view pool) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  int pool_size = 0;
+  for (PooledLane& lane : pooled_lanes_) {
+    if (lane.pool == pool) {
+      if (!lane.in_use) {
+        lane.in_use = true;
+        return lane.index;
+      }
+      ++pool_size;
+    }
+  }
+  const int index = num_lanes_++;
+  pooled_lanes_.push_back(PooledLane{std::string{pool}, index, true});
+  thread_names_[index] = fmt::format("{} {}", pool, pool_size);
+  return index;
+}
+
+void TraceRecorder::ReleaseLane(const int index) {
+  const std::lock_guard<std::mutex> lock{mutex_};
+  for (PooledLane& lane : pooled_lanes_) {
+    if (lane.index == index) {
+      lane.in_use = false;
+    }
+  }
+}
+
+void TraceRecorder::Write(const std::filesystem::path& path) const {
+  std::ofstream stream{path, std::ios::out | std::ios::trunc};
+  ASSERT(stream.good(), "Failed to open trace file for writing: {}", path.u8string());
+
+  const std::lock_guard<std::mutex> lock{mutex_};
+  stream << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+  stream << R"({"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "cubemap_converter"}})";
+  for (int thread_index = 0; thread_index < num_lanes_; ++thread_index) {
+    const auto name = thread_names_.find(thread_index);
+    stream << fmt::format(",\n{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": {}, "
+                          "\"args\": {{\"name\": \"{}\"}}}}",
+                          thread_index,
+                          name != thread_names_.end() ? name->second : fmt::format("thread {}", thread_index));
+  }
+  for (const Event& event : events_) {
+    stream << fmt::format(",\n{{\"name\": \"{}\", \"cat\": \"stage\", \"ph\": \"X\", \"pid\": 1, \"tid\": {}, "
+                          "\"ts\": {}, \"dur\": {}",
+                          event.name, event.thread_index, event.begin_micros, event.duration_micros);
+    if (event.frame) {
+      stream << fmt::format(", \"args\": {{\"frame\": {}}}", *event.frame);
+    }
+    stream << "}";
+  }
+  stream << "\n]}\n";
+  ASSERT(stream.good(), "Failed to write trace file: {}", path.u8string());
+}
+
+ScopedLane::ScopedLane(TraceRecorder* const trace, const std::string_view pool) : trace_(trace) {
+  if (trace_ != nullptr) {
+    lane_ = trace_->AcquireLane(pool);
+    previous_trace_ = borrowed_lane.trace;
+    previous_lane_ = borrowed_lane.index;
+    borrowed_lane = BorrowedLane{trace_, lane_};
+  }
+}
+
+ScopedLane::~ScopedLane() {
+  if (trace_ != nullptr) {
+    borrowed_lane = BorrowedLane{previous_trace_, previous_lane_};
+    trace_->ReleaseLane(lane_);
+  }
+}
+
+}  // namespace timing
@@ -0,0 +1,89 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace timing {
+
+// Records complete (begin + duration) events from any thread, and writes them in the Chrome trace event format.
+// Open the output in Perfetto (ui.perfetto.dev) or chrome://tracing.
+// Each event is drawn on the lane of its thread. Short lived threads (eg. one per task) should borrow a pooled lane w/
+// `ScopedLane` instead, so the number of lanes is bounded by the number of tasks running at once.
+class TraceRecorder {
+ public:
+  using Clock = std::chrono::steady_clock;
+
+  TraceRecorder() : start_(Clock::now()) {}
+
+  // Record an event on the calling thread. `frame` is the index of the frame being processed, if any.
+  // `name` is not copied, so it must outlive the recorder (a string literal, for example).
+  void AddEvent(std::string_view name, Clock::time_point begin, Clock::time_point end,
+                std::optional<std::size_t> frame = std::nullopt);
+
+  // Name the calling thread in the trace. Unnamed threads are labelled by their index.
+  void NameCurrentThread(std::string_view name);
+
+  // Write all events recorded so far as JSON. Asserts if the file cannot be written.
+  void Write(const std::filesystem::path& path) const;
+
+ private:
+  friend class ScopedLane;
+
+  struct Event {
+    std::string_view name;
+    int64_t begin_micros;
+    int64_t duration_micros;
+    int thread_index;
+    std::optional<std::size_t> frame;
+  };
+
+  struct PooledLane {
+    std::string pool;
+    int index;
+    bool in_use;
+  };
+
+  // Lane of the calling thread: the lane it borrowed w/ `ScopedLane`, otherwise its own lane, assigned in order of
+  // first use. Requires `mutex_` to be held.
+  int ThreadIndex();
+
+  // Borrow the first free lane of `pool`, adding a lane named "<pool> <n>" if all of them are in use.
+  int AcquireLane(std::string_view pool);
+  void ReleaseLane(int index);
+
+  Clock::time_point start_;
+  mutable std::mutex mutex_{};
+  std::vector<Event> events_{};
+  int num_lanes_{0};
+  std::unordered_map<std::thread::id, int> thread_indices_{};
+  std::vector<PooledLane> pooled_lanes_{};
+  std::unordered_map<int, std::string> thread_names_{};
+};
+
+// Draws the events of the calling thread on a lane borrowed from `pool` of `trace`, until destroyed. The lane is
+// returned to the pool for the next task. Does nothing if `trace` is null.
+class ScopedLane {
+ public:
+  ScopedLane(TraceRecorder* trace, std::string_view pool);
+  ~ScopedLane();
+
+  ScopedLane(const ScopedLane&) = delete;
+  ScopedLane& operator=(const ScopedLane&) = delete;
+
+ private:
+  TraceRecorder* trace_;
+  int lane_{-1};
+  // Lane the thread was drawn on before, restored on destruction.
+  const TraceRecorder* previous_trace_{nullptr};
+  int previous_lane_{-1};
+};
+
+}  // namespace timing
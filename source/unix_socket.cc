@@ -0,0 +1,121 @@
+// Copyright 2023 Gareth Cross
+#include "unix_socket.hpp"
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+
+#include "assertions.hpp"
+
+namespace unix_socket {
+
+// Don't raise SIGPIPE when the other end went away, we handle the error instead.
+#ifdef MSG_NOSIGNAL
+constexpr int kSendFlags = MSG_NOSIGNAL;
+#else
+constexpr int kSendFlags = 0;
+#endif
+
+static sockaddr_un MakeAddress(const std::filesystem::path& path) {
+  sockaddr_un address{};
+  address.sun_family = AF_UNIX;
+  const std::string path_str = path.u8string();
+  ASSERT(path_str.size() < sizeof(address.sun_path), "Socket path is too long ({} characters): {}", path_str.size(),
+         path_str);
+  std::strncpy(address.sun_path, path_str.c_str(), sizeof(address.sun_path) - 1);
+  return address;
+}
+
+static int OpenSocket() {
+  const int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  ASSERT(fd >= 0, "Failed to create socket: {}", std::strerror(errno));
+#ifdef SO_NOSIGPIPE
+  const int enable = 1;
+  ::setsockopt(fd, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable));
+#endif
+  return fd;
+}
+
+int Listen(const std::filesystem::path& path) {
+  const sockaddr_un address = MakeAddress(path);
+  // Only replace a socket nobody is listening on (left behind by a process that died):
+  const int probe = OpenSocket();
+  const int connected = ::connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address));
+  const int probe_error = errno;
+  ::close(probe);
+  ASSERT(connected != 0, "Another process is already listening on: {}", path.u8string());
+  ASSERT(probe_error == ECONNREFUSED || probe_error == ENOENT, "Cannot replace {}: {}", path.u8string(),
+         std::strerror(probe_error));
+  if (probe_error == ECONNREFUSED) {
+    std::error_code err{};
+    std::filesystem::remove(path, err);
+  }
+  const int fd = OpenSocket();
+  ASSERT(::bind(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0, "Failed to bind socket {}: {}",
+         path.u8string(), std::strerror(errno));
+  ASSERT(::listen(fd, 64) == 0, "Failed to listen on {}: {}", path.u8string(), std::strerror(errno));
+  return fd;
+}
+
+int Accept(const int listener) {
+  const int fd = ::accept(listener, nullptr, nullptr);
+  ASSERT(fd >= 0 || errno == EINTR || errno == ECONNABORTED, "accept() failed: {}", std::strerror(errno));
+  return fd >= 0 ? fd : -1;
+}
+
+int Connect(const std::filesystem::path& path) {
+  const int fd = OpenSocket();
+  const sockaddr_un address = MakeAddress(path);
+  ASSERT(::connect(fd, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0,
+         "Failed to connect to {}: {}", path.u8string(), std::strerror(errno));
+  return fd;
+}
+
+void Close(const int fd) { ::close(fd); }
+
+bool SendLine(const int fd, const std::string& line) {
+  const std::string message = line + "\n";
+  std::size_t sent = 0;
+  while (sent < message.size()) {
+    const ssize_t result = ::send(fd, message.data() + sent, message.size() - sent, kSendFlags);
+    if (result < 0 && errno == EINTR) {
+      continue;
+    } else if (result <= 0) {
+      return false;
+    }
+    sent += static_cast<std::size_t>(result);
+  }
+  return true;
+}
+
+std::optional<std::string> PopLine(std::string& buffer) {
+  const std::size_t newline = buffer.find('\n');
+  if (newline == std::string::npos) {
+    return std::nullopt;
+  }
+  std::string line = buffer.substr(0, newline);
+  buffer.erase(0, newline + 1);
+  return line;
+}
+
+std::optional<std::string> ReceiveLine(const int fd, std::string& buffer) {
+  for (;;) {
+    if (std::optional<std::string> line = PopLine(buffer); line.has_value()) {
+      return line;
+    }
+    char chunk[4096];
+    const ssize_t num_received = ::recv(fd, chunk, sizeof(chunk), 0);
+    if (num_received < 0 && errno == EINTR) {
+      continue;
+    } else if (num_received <= 0) {
+      return std::nullopt;
+    }
+    buffer.append(chunk, static_cast<std::size_t>(num_received));
+  }
+}
+
+}  // namespace unix_socket
+#endif  // _WIN32
@@ -0,0 +1,33 @@
+// Copyright 2023 Gareth Cross
+#pragma once
+#include <filesystem>
+#include <optional>
+#include <string>
+
+// Line-based messaging over Unix domain sockets, shared by the coordinator and the daemon. POSIX only.
+namespace unix_socket {
+
+// Listen on `path`, replacing the stale socket of a previous run if there is one. Asserts on failure, or if another
+// process is still listening on `path`.
+int Listen(const std::filesystem::path& path);
+
+// Wait for a connection on a socket returned by `Listen`. Returns -1 if interrupted.
+int Accept(int listener);
+
+// Connect to the socket at `path`. Asserts on failure.
+int Connect(const std::filesystem::path& path);
+
+// Close a socket returned by `Listen` or `Connect`, or by accept() on a listening socket.
+void Close(int fd);
+
+// Send `line` and a newline. Returns false if the other end went away.
+bool SendLine(int fd, const std::string& line);
+
+// Remove the first complete line from `buffer`.
+std::optional<std::string> PopLine(std::string& buffer);
+
+// Receive the next line from `fd`, buffering any bytes after it in `buffer`. Returns nullopt if the other end went
+// away.
+std::optional<std::string> ReceiveLine(int fd, std::string& buffer);
+
+}  // namespace unix_socket
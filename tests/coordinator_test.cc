@@ -0,0 +1,147 @@
+// Copyright 2023 Gareth Cross
+#include <algorithm>
+#include <numeric>
+#include <optional>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+#include "coordinator.hpp"
+
+namespace coordinator {
+
+// Frames 0, 1, ..., `count - 1`.
+static std::vector<std::size_t> Frames(const std::size_t count) {
+  std::vector<std::size_t> frames(count);
+  std::iota(frames.begin(), frames.end(), std::size_t{0});
+  return frames;
+}
+
+// Take frames for `worker` until there are none left, finishing each one.
+static std::vector<std::size_t> Drain(WorkQueue& queue, const int worker) {
+  std::vector<std::size_t> taken{};
+  while (const std::optional<std::size_t> index = queue.Next(worker)) {
+    EXPECT_TRUE(queue.Finished(worker, *index));
+    taken.push_back(*index);
+  }
+  return taken;
+}
+
+TEST(WorkQueueTest, HandsOutRangesInOrder) {
+  WorkQueue queue{{10, 11, 12, 13, 14, 15, 16}, 3, 1};
+  queue.AddWorker(1);
+  queue.AddWorker(2);
+  // Each worker takes a whole range, and its frames in order:
+  EXPECT_EQ(queue.Next(1), 10u);
+  EXPECT_EQ(queue.Next(2), 13u);
+  EXPECT_EQ(queue.Next(1), 11u);
+  EXPECT_EQ(queue.Next(1), 12u);
+  // Worker 1 takes the last (shorter) range:
+  EXPECT_EQ(queue.Next(1), 16u);
+  EXPECT_EQ(queue.NumSteals(), 0u);
+  EXPECT_FALSE(queue.IsComplete());
+  for (const std::size_t index : {10, 11, 12, 16}) {
+    EXPECT_TRUE(queue.Finished(1, index));
+  }
+  EXPECT_EQ(Drain(queue, 2), (std::vector<std::size_t>{14, 15}));
+  EXPECT_TRUE(queue.Finished(2, 13));
+  EXPECT_TRUE(queue.IsComplete());
+  EXPECT_EQ(queue.NumFinished(), 7u);
+}
+
+TEST(WorkQueueTest, FinishedRequiresTheAssignedWorker) {
+  WorkQueue queue{Frames(4), 4, 1};
+  queue.AddWorker(1);
+  queue.AddWorker(2);
+  ASSERT_EQ(queue.Next(1), 0u);
+  EXPECT_FALSE(queue.Finished(2, 0));
+  EXPECT_FALSE(queue.Finished(1, 1));  //  Not handed out yet.
+  EXPECT_FALSE(queue.Finished(3, 0));  //  Unknown worker.
+  EXPECT_TRUE(queue.Finished(1, 0));
+  EXPECT_FALSE(queue.Finished(1, 0));  //  Already finished.
+  EXPECT_EQ(queue.NumFinished(), 1u);
+}
+
+TEST(WorkQueueTest, StealsTheBackHalfOfTheLargestRange) {
+  WorkQueue queue{Frames(9), 9, 1};
+  queue.AddWorker(1);
+  queue.AddWorker(2);
+  queue.AddWorker(3);
+  // Worker 1 takes the only range, and holds [1, 9):
+  ASSERT_EQ(queue.Next(1), 0u);
+  // Worker 2 steals [5, 9), and worker 3 then steals [3, 5) from worker 1, which holds the larger range [1, 5):
+  EXPECT_EQ(queue.Next(2), 5u);
+  EXPECT_EQ(queue.Next(3), 3u);
+  EXPECT_EQ(queue.NumSteals(), 2u);
+  // Worker 1 is left w/ [1, 3), and worker 2 w/ [6, 9):
+  EXPECT_EQ(queue.Next(1), 1u);
+  EXPECT_EQ(queue.Next(1), 2u);
+  // Worker 1 steals [7, 9) from worker 2. Worker 3 holds a single frame, which is not stolen:
+  EXPECT_EQ(queue.Next(1), 7u);
+  EXPECT_EQ(queue.NumSteals(), 3u);
+  EXPECT_EQ(queue.Next(2), 6u);
+  EXPECT_EQ(queue.Next(2), std::nullopt);
+  EXPECT_EQ(queue.Next(3), 4u);
+  EXPECT_EQ(queue.Next(3), std::nullopt);
+  EXPECT_EQ(queue.Next(1), 8u);
+  EXPECT_EQ(queue.Next(1), std::nullopt);
+}
+
+TEST(WorkQueueTest, RequeuesTheFramesOfARemovedWorker) {
+  WorkQueue queue{Frames(8), 4, 3};
+  queue.AddWorker(1);
+  queue.AddWorker(2);
+  // Worker 1 finishes frame 0, and is converting 1 and 2 when it goes away:
+  ASSERT_EQ(queue.Next(1), 0u);
+  ASSERT_EQ(queue.Next(1), 1u);
+  ASSERT_EQ(queue.Next(1), 2u);
+  EXPECT_TRUE(queue.Finished(1, 0));
+  queue.RemoveWorker(1);
+  EXPECT_EQ(queue.NumRequeued(), 2u);
+  EXPECT_FALSE(queue.Finished(1, 1));
+
+  // Worker 2 converts everything else, each frame exactly once:
+  std::vector<std::size_t> taken = Drain(queue, 2);
+  std::sort(taken.begin(), taken.end());
+  EXPECT_EQ(taken, (std::vector<std::size_t>{1, 2, 3, 4, 5, 6, 7}));
+  EXPECT_TRUE(queue.IsComplete());
+  EXPECT_TRUE(queue.Failed().empty());
+}
+
+TEST(WorkQueueTest, GivesUpAfterMaxAttempts) {
+  WorkQueue queue{Frames(3), 1, 2};
+  // Two workers in a row crash while converting frame 0:
+  for (const int worker : {1, 2}) {
+    queue.AddWorker(worker);
+    ASSERT_EQ(queue.Next(worker), 0u);
+    queue.RemoveWorker(worker);
+  }
+  EXPECT_EQ(queue.Failed(), (std::vector<std::size_t>{0}));
+  EXPECT_EQ(queue.NumRequeued(), 1u);
+
+  queue.AddWorker(3);
+  EXPECT_EQ(Drain(queue, 3), (std::vector<std::size_t>{1, 2}));
+  EXPECT_EQ(queue.NumFinished(), 2u);
+  EXPECT_TRUE(queue.IsComplete());
+}
+
+TEST(WorkQueueTest, LeaseExpiresWithoutProgress) {
+  const WorkQueue::Clock::time_point start{};
+  const auto seconds = [&](const int count) { return start + std::chrono::seconds(count); };
+  WorkQueue queue{Frames(4), 2, 3, std::chrono::seconds(10)};
+  queue.AddWorker(1);
+  queue.AddWorker(2);
+  ASSERT_EQ(queue.Next(1, seconds(0)), 0u);
+  // Worker 2 holds nothing, so it has no lease to lose:
+  EXPECT_TRUE(queue.ExpiredWorkers(seconds(5)).empty());
+  EXPECT_TRUE(queue.Finished(1, 0, seconds(8)));
+  EXPECT_TRUE(queue.ExpiredWorkers(seconds(15)).empty());
+  EXPECT_EQ(queue.ExpiredWorkers(seconds(19)), (std::vector<int>{1}));
+
+  // Its frames go to another worker once it is removed:
+  queue.RemoveWorker(1);
+  EXPECT_EQ(queue.Next(2, seconds(20)), 1u);
+  EXPECT_TRUE(queue.ExpiredWorkers(seconds(25)).empty());
+}
+
+}  // namespace coordinator